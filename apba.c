@@ -19,6 +19,7 @@
 #include <linux/interrupt.h>
 #include <linux/irq.h>
 #include <linux/kfifo.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/platform_device.h>
@@ -162,6 +163,12 @@ struct apba_ctrl {
 	void *mods_uart;
 	int desired_on;
 	int on;
+	struct mutex power_mutex;          /* protects on/fw_busy transitions */
+	bool fw_busy;                      /* fw check or flash owns the APBA */
+	ktime_t probe_time;
+	s64 det_enable_ms;                 /* probe to mod detection enabled */
+	s64 fw_done_ms;                    /* probe to firmware check done */
+	bool fw_flashed;
 	struct mutex log_mutex;
 	struct completion comp;
 	struct completion apbe_log_comp;
@@ -176,6 +183,15 @@ struct apba_ctrl {
 	uint32_t apbe_status;
 	uint32_t last_unipro_value;
 	uint32_t last_unipro_status;
+	struct mutex unipro_mutex;         /* single attr reqs share unipro_comp */
+	spinlock_t unipro_batch_lock;      /* protects unipro_batch_list/tag */
+	struct list_head unipro_batch_list;
+	uint16_t unipro_batch_tag;
+	bool unipro_batch_seen;            /* APBA answered a batch request */
+	bool unipro_batch_unsupported;     /* fall back to single requests */
+	struct mutex unipro_batch_mutex;   /* protects sysfs batch results */
+	struct apba_unipro_attr *unipro_batch_attrs;
+	unsigned int unipro_batch_count;
 	uint32_t unipro_stats[32];
 	struct notifier_block attach_nb;
 	unsigned long present;
@@ -199,10 +215,30 @@ static char fifo_overflow[MHB_MAX_MSG_SIZE];
 #define APBA_BAUD_REQ_TIMEOUT	1000 /* ms */
 #define APBA_UNIPRO_REQ_TIMEOUT	1000 /* ms */
 
+/* Attributes per batch request, bounded by the 8-bit count and MHB payload */
+#define APBA_UNIPRO_BATCH_MAX \
+	min_t(size_t, U8_MAX, (MHB_MAX_PAYLOAD_SIZE - \
+		sizeof(struct mhb_unipro_batch_attr_req)) / \
+		sizeof(struct mhb_unipro_batch_attr))
+
+/* An outstanding batch request, matched to its response by tag */
+struct apba_unipro_batch {
+	struct list_head list;
+	uint16_t tag;
+	struct completion comp;
+	struct apba_unipro_attr *attrs;
+	unsigned int count;
+	int status;
+};
+
 static struct work_struct apba_disable_work;
 static struct work_struct apba_enable_work;
 static struct work_struct apba_dettach_work;
 
+/* MTD device holding the APBA image, e.g. an mtdram stand-in for testing */
+static char *fw_partition = APBA_FIRMWARE_PARTITION;
+module_param(fw_partition, charp, 0444);
+
 static void apba_send_kobj_uevent(const char *event)
 {
 	struct kobj_uevent_env *env;
@@ -372,6 +408,45 @@ done:
 	complete(&g_ctrl->baud_comp);
 }
 
+static int apba_send_uart_features_req(void)
+{
+	int ret;
+	struct mhb_hdr req_hdr;
+	struct mhb_uart_features_req req;
+
+	if (!g_ctrl->mods_uart)
+		return -ENODEV;
+
+	memset(&req_hdr, 0, sizeof(req_hdr));
+	req_hdr.addr = MHB_ADDR_UART;
+	req_hdr.type = MHB_TYPE_UART_FEATURES_REQ;
+
+	req.features = cpu_to_le32(MHB_UART_FEATURE_AGG);
+	req.agg_max = cpu_to_le16(MHB_MAX_MSG_SIZE);
+
+	ret = mods_uart_send(g_ctrl->mods_uart, &req_hdr,
+		(uint8_t *)&req, sizeof(req), 0);
+	if (ret)
+		pr_err("%s: failed to send req\n", __func__);
+
+	return ret;
+}
+
+/* Firmware without the request answers with an error, leaving it off */
+static void apba_handle_uart_features_rsp(struct mhb_hdr *hdr,
+		uint8_t *payload, size_t len)
+{
+	struct mhb_uart_features_rsp *rsp;
+
+	if (hdr->result != MHB_RESULT_SUCCESS || len != sizeof(*rsp))
+		return;
+
+	rsp = (struct mhb_uart_features_rsp *)payload;
+	if (le32_to_cpu(rsp->features) & MHB_UART_FEATURE_AGG)
+		mods_uart_set_agg(g_ctrl->mods_uart,
+				  le16_to_cpu(rsp->agg_max));
+}
+
 static void apba_handle_uart_message(struct mhb_hdr *hdr, uint8_t *payload,
 		size_t len)
 {
@@ -379,6 +454,9 @@ static void apba_handle_uart_message(struct mhb_hdr *hdr, uint8_t *payload,
 	case MHB_TYPE_UART_CONFIG_RSP:
 		apba_handle_uart_config_rsp(hdr, payload, len);
 		break;
+	case MHB_TYPE_UART_FEATURES_RSP:
+		apba_handle_uart_features_rsp(hdr, payload, len);
+		break;
 	default:
 		pr_err("%s: Invalid type=0x%02x.\n", __func__, hdr->type);
 		break;
@@ -466,6 +544,147 @@ static int apba_send_unipro_gear_req(uint8_t tx, uint8_t rx, uint8_t pwrmode,
 	return ret;
 }
 
+/* Caller must hold unipro_mutex, single requests share unipro_comp */
+static int apba_unipro_attr_single(struct apba_unipro_attr *attr)
+{
+	int ret;
+
+	reinit_completion(&g_ctrl->unipro_comp);
+
+	if (attr->write)
+		ret = apba_send_unipro_write_attr_req(attr->attribute,
+				attr->selector, attr->peer, attr->value);
+	else
+		ret = apba_send_unipro_read_attr_req(attr->attribute,
+				attr->selector, attr->peer);
+	if (ret)
+		return -EIO;
+
+	if (!wait_for_completion_timeout(
+		    &g_ctrl->unipro_comp,
+		    msecs_to_jiffies(APBA_UNIPRO_REQ_TIMEOUT))) {
+		pr_err("%s: timeout\n", __func__);
+		return -ETIMEDOUT;
+	}
+
+	attr->result = g_ctrl->last_unipro_status;
+	if (!attr->write)
+		attr->value = g_ctrl->last_unipro_value;
+
+	return 0;
+}
+
+static int apba_unipro_batch_send(struct apba_unipro_attr *attrs,
+		unsigned int count)
+{
+	struct apba_unipro_batch batch;
+	struct mhb_unipro_batch_attr_req *req;
+	struct mhb_hdr req_hdr;
+	size_t size = sizeof(*req) + count * sizeof(req->attrs[0]);
+	unsigned long flags;
+	unsigned int i;
+	int ret;
+
+	req = kzalloc(size, GFP_KERNEL);
+	if (!req)
+		return -ENOMEM;
+
+	batch.attrs = attrs;
+	batch.count = count;
+	batch.status = -ETIMEDOUT;
+	init_completion(&batch.comp);
+
+	spin_lock_irqsave(&g_ctrl->unipro_batch_lock, flags);
+	batch.tag = ++g_ctrl->unipro_batch_tag;
+	list_add_tail(&batch.list, &g_ctrl->unipro_batch_list);
+	spin_unlock_irqrestore(&g_ctrl->unipro_batch_lock, flags);
+
+	memset(&req_hdr, 0, sizeof(req_hdr));
+	req_hdr.addr = MHB_ADDR_UNIPRO;
+	req_hdr.type = MHB_TYPE_UNIPRO_BATCH_ATTR_REQ;
+
+	req->tag = cpu_to_le16(batch.tag);
+	req->count = count;
+	for (i = 0; i < count; i++) {
+		req->attrs[i].attribute = cpu_to_le16(attrs[i].attribute);
+		req->attrs[i].selector = cpu_to_le16(attrs[i].selector);
+		req->attrs[i].peer = attrs[i].peer;
+		req->attrs[i].write = attrs[i].write;
+		req->attrs[i].value = cpu_to_le32(attrs[i].value);
+	}
+
+	ret = mods_uart_send(g_ctrl->mods_uart, &req_hdr, (uint8_t *)req,
+		size, 0);
+	kfree(req);
+	if (ret) {
+		pr_err("%s: failed to send\n", __func__);
+		batch.status = -EIO;
+	} else if (!wait_for_completion_timeout(&batch.comp,
+			msecs_to_jiffies(APBA_UNIPRO_REQ_TIMEOUT))) {
+		pr_err("%s: timeout, tag=%u\n", __func__, batch.tag);
+	}
+
+	/* The handler completes under the lock, so batch is safe to drop */
+	spin_lock_irqsave(&g_ctrl->unipro_batch_lock, flags);
+	if (!list_empty(&batch.list))
+		list_del(&batch.list);
+	ret = batch.status;
+	spin_unlock_irqrestore(&g_ctrl->unipro_batch_lock, flags);
+
+	return ret;
+}
+
+/**
+ * apba_unipro_attr_batch() - read and/or write a list of UniPro attributes
+ *
+ * Attributes are sent to the APBA in tagged batch requests, so concurrent
+ * callers each wait on their own response. Firmware without batch support
+ * is detected on first use and served one attribute at a time. Per
+ * attribute MHB results are returned in attrs[].result.
+ */
+int apba_unipro_attr_batch(struct apba_unipro_attr *attrs, unsigned int count)
+{
+	unsigned int done = 0;
+	unsigned int i;
+	int ret = 0;
+
+	if (!g_ctrl || !g_ctrl->mods_uart)
+		return -ENODEV;
+
+	while (done < count) {
+		unsigned int n = min_t(unsigned int, count - done,
+				       APBA_UNIPRO_BATCH_MAX);
+
+		if (!g_ctrl->unipro_batch_unsupported) {
+			ret = apba_unipro_batch_send(attrs + done, n);
+			if (!ret) {
+				g_ctrl->unipro_batch_seen = true;
+			} else if (ret == -EPROTONOSUPPORT ||
+				   (ret == -ETIMEDOUT &&
+				    !g_ctrl->unipro_batch_seen)) {
+				pr_info("%s: batch unsupported, falling back\n",
+					__func__);
+				g_ctrl->unipro_batch_unsupported = true;
+				ret = 0;
+			}
+		}
+
+		if (g_ctrl->unipro_batch_unsupported) {
+			mutex_lock(&g_ctrl->unipro_mutex);
+			for (i = 0; i < n && !ret; i++)
+				ret = apba_unipro_attr_single(&attrs[done + i]);
+			mutex_unlock(&g_ctrl->unipro_mutex);
+		}
+
+		if (ret)
+			return ret;
+
+		done += n;
+	}
+
+	return 0;
+}
+
 static void apba_handle_unipro_gear_rsp(struct mhb_hdr *hdr,
 		uint8_t *payload, size_t len)
 {
@@ -497,6 +716,55 @@ static void apba_handle_unipro_write_attr_rsp(struct mhb_hdr *hdr,
 	complete(&g_ctrl->unipro_comp);
 }
 
+static void apba_handle_unipro_batch_attr_rsp(struct mhb_hdr *hdr,
+		uint8_t *payload, size_t len)
+{
+	struct mhb_unipro_batch_attr_rsp *rsp =
+		(struct mhb_unipro_batch_attr_rsp *)payload;
+	struct apba_unipro_batch *batch;
+	bool tagged = len >= sizeof(*rsp);
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&g_ctrl->unipro_batch_lock, flags);
+	list_for_each_entry(batch, &g_ctrl->unipro_batch_list, list) {
+		/*
+		 * Error responses may come without a payload. Responses are
+		 * in order, so those belong to the oldest outstanding batch.
+		 */
+		if (tagged && batch->tag != le16_to_cpu(rsp->tag))
+			continue;
+
+		list_del_init(&batch->list);
+
+		if (hdr->result == MHB_RESULT_PROTOCOL_BAD ||
+		    hdr->result == MHB_RESULT_INVALID) {
+			batch->status = -EPROTONOSUPPORT;
+		} else if (hdr->result != MHB_RESULT_SUCCESS) {
+			batch->status = -EIO;
+		} else if (!tagged || rsp->count != batch->count ||
+			   len < sizeof(*rsp) +
+				 batch->count * sizeof(rsp->results[0])) {
+			batch->status = -EPROTO;
+		} else {
+			for (i = 0; i < batch->count; i++) {
+				struct apba_unipro_attr *attr = &batch->attrs[i];
+
+				attr->result = rsp->results[i].result;
+				if (!attr->write &&
+				    attr->result == MHB_RESULT_SUCCESS)
+					attr->value =
+					    le32_to_cpu(rsp->results[i].value);
+			}
+			batch->status = 0;
+		}
+
+		complete(&batch->comp);
+		break;
+	}
+	spin_unlock_irqrestore(&g_ctrl->unipro_batch_lock, flags);
+}
+
 static int apba_send_unipro_stats_req(void)
 {
 	int ret;
@@ -552,6 +820,9 @@ static void apba_handle_unipro_message(struct mhb_hdr *hdr, uint8_t *payload,
 	case MHB_TYPE_UNIPRO_WRITE_ATTR_RSP:
 		apba_handle_unipro_write_attr_rsp(hdr, payload, len);
 		break;
+	case MHB_TYPE_UNIPRO_BATCH_ATTR_RSP:
+		apba_handle_unipro_batch_attr_rsp(hdr, payload, len);
+		break;
 	case MHB_TYPE_UNIPRO_CONFIG_RSP:
 	case MHB_TYPE_UNIPRO_STATUS_RSP:
 		/* ignore */
@@ -608,6 +879,15 @@ static void apba_handle_diag_id_not(struct mhb_hdr *hdr, uint8_t *payload,
 		dest->minor_version = le16_to_cpu(src->minor_version);
 		memcpy(dest->build, src->build, sizeof(src->build));
 	}
+
+	/*
+	 * The APBA announces itself after every boot, so whatever it agreed
+	 * to before is gone. Stop aggregating until it agrees again.
+	 */
+	if (hdr->addr == MHB_ADDR_DIAG) {
+		mods_uart_set_agg(g_ctrl->mods_uart, 0);
+		apba_send_uart_features_req();
+	}
 }
 
 static void apba_handle_diag_message(struct mhb_hdr *hdr, uint8_t *payload,
@@ -862,6 +1142,10 @@ static void apba_on(struct apba_ctrl *ctrl, bool on)
 
 		apba_seq(ctrl, &ctrl->enable_postclk_seq);
 		enable_irq(ctrl->irq);
+
+		/* Firmware may have changed, re-detect batch support */
+		ctrl->unipro_batch_seen = false;
+		ctrl->unipro_batch_unsupported = false;
 	} else {
 		ctrl->mode = 0;
 		disable_irq(ctrl->irq);
@@ -984,6 +1268,31 @@ static void apba_flash_on(struct apba_ctrl *ctrl, bool on)
 	}
 }
 
+/*
+ * Power off the APBA and hand the flash to the AP. Requests to power the
+ * APBA on are only recorded in desired_on until apba_flash_end().
+ */
+static void apba_flash_begin(struct apba_ctrl *ctrl)
+{
+	mutex_lock(&ctrl->power_mutex);
+	ctrl->fw_busy = true;
+	apba_on(ctrl, false);
+	mutex_unlock(&ctrl->power_mutex);
+
+	apba_flash_on(ctrl, true);
+}
+
+static void apba_flash_end(struct apba_ctrl *ctrl, bool power_on)
+{
+	apba_flash_on(ctrl, false);
+
+	mutex_lock(&ctrl->power_mutex);
+	ctrl->fw_busy = false;
+	if (ctrl->desired_on && !ctrl->on && power_on)
+		apba_on(ctrl, true);
+	mutex_unlock(&ctrl->power_mutex);
+}
+
 static int apba_erase_partition(struct apba_ctrl *ctrl, const char *partition)
 {
 	struct mtd_info *mtd_info;
@@ -993,9 +1302,7 @@ static int apba_erase_partition(struct apba_ctrl *ctrl, const char *partition)
 		return -EINVAL;
 
 	/* Disable the APBA so that it does not access the flash. */
-	apba_on(ctrl, false);
-
-	apba_flash_on(ctrl, true);
+	apba_flash_begin(ctrl);
 
 	mtd_info = apba_init_mtd_module(partition);
 	if (!mtd_info) {
@@ -1019,9 +1326,7 @@ cleanup:
 	put_mtd_device(mtd_info);
 
 no_mtd:
-	apba_flash_on(ctrl, false);
-	if (ctrl->desired_on)
-		apba_on(ctrl, true);
+	apba_flash_end(ctrl, true);
 
 	return err;
 }
@@ -1149,6 +1454,85 @@ skip_compare:
 	return compare_result;
 }
 
+/*
+ * Compare only the headers of the flashed image against the firmware file:
+ * the FFFF element must describe an image of the same length and the TFTF
+ * header (timestamp, version and section table) must match byte for byte.
+ * This avoids reading back the whole partition on every boot. It relies
+ * on apba_flash_partition() writing the first FFFF header last.
+ *
+ * Return 0 if the firmware does not need to be flashed
+ * Return !0 otherwise
+ */
+static int apba_check_partition_header(struct apba_ctrl *ctrl,
+	struct mtd_info *mtd_info,
+	const struct firmware *fw)
+{
+	tftf_header *fsfw = (tftf_header *)fw->data;
+	ffff_header *ffff;
+	tftf_header *tftf;
+	void *buf;
+	size_t retlen = 0;
+	/* Assume different */
+	int compare_result = 1;
+	int err;
+
+	buf = kmalloc(PAGE_SIZE, GFP_KERNEL | GFP_DMA);
+	if (!buf)
+		return compare_result;
+
+	err = mtd_read(mtd_info, 0, FFFF_HEADER_SIZE, &retlen, buf);
+	if (err < 0 || retlen < FFFF_HEADER_SIZE) {
+		pr_err("%s: mtd_read failure. err:%d, retlen:%zd\n",
+		       __func__, err, retlen);
+		goto cleanup;
+	}
+
+	ffff = buf;
+	if (memcmp(ffff->leading_sentinel, FFFF_SENTINEL,
+		   FFFF_SENTINEL_LENGTH) ||
+	    ffff->element[0].type != FFFF_ELEMENT_TYPE_STAGE_2_FW) {
+		pr_debug("%s: flashed FFFF header not valid\n", __func__);
+		goto cleanup;
+	}
+
+	if (ffff->element[0].length != fw->size) {
+		pr_debug("%s: flashed length %u file length %zu\n", __func__,
+			 ffff->element[0].length, fw->size);
+		goto cleanup;
+	}
+
+	err = mtd_read(mtd_info, TFTF_OFFSET, TFTF_HEADER_SIZE, &retlen, buf);
+	if (err < 0 || retlen < TFTF_HEADER_SIZE) {
+		pr_err("%s: mtd_read failure. err:%d, retlen:%zd\n",
+		       __func__, err, retlen);
+		goto cleanup;
+	}
+
+	tftf = buf;
+	if (memcmp(tftf->sentinel, TFTF_SENTINEL, TFTF_SENTINEL_LENGTH)) {
+		pr_debug("%s: flashed sentinel value not valid\n", __func__);
+		goto cleanup;
+	}
+
+	ctrl->fw_version = tftf->version;
+	strlcpy(ctrl->fw_package_name, tftf->name, TFTF_NAME_LENGTH);
+
+	/* don't overwrite newer fw with older fw */
+	if (tftf->version > fsfw->version)
+		compare_result = 0;
+	else
+		compare_result = memcmp(tftf, fsfw, TFTF_HEADER_SIZE);
+
+	pr_debug("%s: flashed version %08x file version %08x comp: %d\n",
+		 __func__, tftf->version, fsfw->version, compare_result);
+
+cleanup:
+	kfree(buf);
+
+	return compare_result;
+}
+
 static void construct_ffff_header(ffff_header *header,
 				  const struct mtd_info *mtd_info,
 				  const struct firmware *fw)
@@ -1184,8 +1568,16 @@ static void construct_ffff_header(ffff_header *header,
 		sizeof(header->trailing_sentinel));
 }
 
+/*
+ * Flash fw into partition unless it is already there. With full_compare
+ * the whole partition is read back for the comparison, otherwise only the
+ * FFFF and TFTF headers are checked.
+ *
+ * Return 1 if the partition was written, 0 if it was left unchanged,
+ * negative errno on failure.
+ */
 static int apba_flash_partition(struct apba_ctrl *ctrl,
-	const char *partition, const struct firmware *fw)
+	const char *partition, const struct firmware *fw, bool full_compare)
 {
 	struct mtd_info *mtd_info;
 	int err;
@@ -1206,9 +1598,7 @@ static int apba_flash_partition(struct apba_ctrl *ctrl,
 	}
 
 	/* Disable the APBA so that it does not access the flash. */
-	apba_on(ctrl, false);
-
-	apba_flash_on(ctrl, true);
+	apba_flash_begin(ctrl);
 
 	mtd_info = apba_init_mtd_module(partition);
 	if (!mtd_info) {
@@ -1222,7 +1612,11 @@ static int apba_flash_partition(struct apba_ctrl *ctrl,
 	 * If they match, skip the process.  If anything fails during the
 	 * comparison, then flash.
 	 */
-	compare_result = apba_compare_partition(ctrl, mtd_info, fw);
+	if (full_compare)
+		compare_result = apba_compare_partition(ctrl, mtd_info, fw);
+	else
+		compare_result = apba_check_partition_header(ctrl, mtd_info,
+							     fw);
 	if (compare_result == 0) {
 		pr_info("%s: firmware unchanged or newer, skipping flash\n",
 			__func__);
@@ -1244,29 +1638,16 @@ static int apba_flash_partition(struct apba_ctrl *ctrl,
 		goto cleanup;
 	}
 
-	construct_ffff_header((ffff_header *)buffer, mtd_info, fw);
-
-	/* Write the first copy of the FFFF header to the flash */
-	err = mtd_write(mtd_info, 0, FFFF_HEADER_SIZE,
-			&retlen, (const u_char *)buffer);
-	if (err < 0) {
-		pr_err("%s: write error %d\n", __func__, err);
-		goto free_mem;
-	}
-
-	/* Write the second copy of the FFFF header to the flash */
-	err = mtd_write(mtd_info, FFFF_HEADER_SIZE, FFFF_HEADER_SIZE,
-			&retlen, (const u_char *)buffer);
-	if (err < 0) {
-		pr_err("%s: write error %d\n", __func__, err);
-		goto free_mem;
-	}
-
-	/* Write the TFTF header and firmware from the firmware file
-	   one page at a time to allow DMA to be used. */
-	data = fw->data;
-	offset = TFTF_OFFSET;
-	count = fw->size;
+	/*
+	 * Write the firmware body first and the headers last, one page at a
+	 * time to allow DMA to be used. The header check only looks at the
+	 * FFFF and TFTF headers, so they must not be in flash before the
+	 * body is complete: an interrupted flash then leaves no valid
+	 * FFFF header behind and the partition is rewritten next time.
+	 */
+	data = fw->data + PAGE_SIZE;
+	offset = TFTF_OFFSET + PAGE_SIZE;
+	count = fw->size - PAGE_SIZE;
 	while (count) {
 		size_t s = count > PAGE_SIZE ? PAGE_SIZE : count;
 
@@ -1283,6 +1664,33 @@ static int apba_flash_partition(struct apba_ctrl *ctrl,
 		count -= s;
 	}
 
+	/* Write the page with the TFTF header */
+	memcpy(buffer, fw->data, PAGE_SIZE);
+	err = mtd_write(mtd_info, TFTF_OFFSET, PAGE_SIZE, &retlen, buffer);
+	if (err < 0) {
+		pr_err("%s: write error %d\n", __func__, err);
+		goto free_mem;
+	}
+
+	memset(buffer, 0, PAGE_SIZE);
+	construct_ffff_header((ffff_header *)buffer, mtd_info, fw);
+
+	/* Write the second copy of the FFFF header to the flash */
+	err = mtd_write(mtd_info, FFFF_HEADER_SIZE, FFFF_HEADER_SIZE,
+			&retlen, (const u_char *)buffer);
+	if (err < 0) {
+		pr_err("%s: write error %d\n", __func__, err);
+		goto free_mem;
+	}
+
+	/* Write the first copy of the FFFF header, the flash is now valid */
+	err = mtd_write(mtd_info, 0, FFFF_HEADER_SIZE,
+			&retlen, (const u_char *)buffer);
+	if (err < 0) {
+		pr_err("%s: write error %d\n", __func__, err);
+		goto free_mem;
+	}
+
 	pr_debug("%s: %s write complete\n", __func__, partition);
 
 	/* Since fw file version is now in flash, store that version */
@@ -1293,13 +1701,14 @@ static int apba_flash_partition(struct apba_ctrl *ctrl,
 free_mem:
 	kfree(buffer);
 
+	if (!err)
+		err = 1;
+
 cleanup:
 	put_mtd_device(mtd_info);
 
 no_mtd:
-	apba_flash_on(ctrl, false);
-	if (ctrl->desired_on && !err)
-		apba_on(ctrl, true);
+	apba_flash_end(ctrl, err >= 0);
 
 	return err;
 }
@@ -1333,14 +1742,14 @@ static int request_fw_and_flash(struct apba_ctrl *ctrl,
 	err = apba_flash_partition(ctrl,
 		((tftf_header *)fw->data)->unipro_pid ==
 		  APBA_FIRMWARE_UNIPRO_PID_ES2 ? "es2_apba" : partition,
-		fw);
+		fw, true);
 	if (err < 0)
 		pr_err("%s: flashing failed for %s partition %s, err=%d\n",
 			__func__, name, partition, err);
 
 	release_firmware(fw);
 
-	return err;
+	return err < 0 ? err : 0;
 }
 
 /*
@@ -1370,7 +1779,7 @@ static ssize_t flash_file_store(struct device *dev,
 	memcpy(fw_name, buf, fw_name_sz);
 	fw_name[fw_name_sz] = 0;
 
-	err = request_fw_and_flash(ctrl, fw_name, APBA_FIRMWARE_PARTITION);
+	err = request_fw_and_flash(ctrl, fw_name, fw_partition);
 
 	return err ? err : count;
 }
@@ -1639,6 +2048,7 @@ static ssize_t apba_read_store(struct device *dev,
 	struct device_attribute *attr, const char *buf, size_t count)
 {
 	int ret;
+	struct apba_unipro_attr req = { 0 };
 	uint16_t attribute = 0;
 	uint16_t selector = 0;
 
@@ -1649,17 +2059,15 @@ static ssize_t apba_read_store(struct device *dev,
 	if (ret < 1) /* one required parameter */
 		return -EINVAL;
 
-	if (apba_send_unipro_read_attr_req(attribute, selector, 0))
-		return -EIO;
+	req.attribute = attribute;
+	req.selector = selector;
+	req.peer = 0;
 
-	if (!wait_for_completion_timeout(
-		    &g_ctrl->unipro_comp,
-		    msecs_to_jiffies(APBA_UNIPRO_REQ_TIMEOUT))) {
-		pr_err("%s: timeout\n", __func__);
-		return -ETIMEDOUT;
-	}
+	mutex_lock(&g_ctrl->unipro_mutex);
+	ret = apba_unipro_attr_single(&req);
+	mutex_unlock(&g_ctrl->unipro_mutex);
 
-	return count;
+	return ret ? ret : count;
 }
 
 static ssize_t apba_read_show(struct device *dev,
@@ -1678,6 +2086,7 @@ static ssize_t apba_write_store(struct device *dev,
 	struct device_attribute *attr, const char *buf, size_t count)
 {
 	int ret;
+	struct apba_unipro_attr req = { 0 };
 	uint16_t attribute = 0;
 	uint32_t value = 0;
 	uint16_t selector = 0;
@@ -1689,17 +2098,17 @@ static ssize_t apba_write_store(struct device *dev,
 	if (ret < 2) /* two required parameters */
 		return -EINVAL;
 
-	if (apba_send_unipro_write_attr_req(attribute, selector, 0, value))
-		return -EIO;
+	req.attribute = attribute;
+	req.selector = selector;
+	req.peer = 0;
+	req.write = true;
+	req.value = value;
 
-	if (!wait_for_completion_timeout(
-		    &g_ctrl->unipro_comp,
-		    msecs_to_jiffies(APBA_UNIPRO_REQ_TIMEOUT))) {
-		pr_err("%s: timeout\n", __func__);
-		return -ETIMEDOUT;
-	}
+	mutex_lock(&g_ctrl->unipro_mutex);
+	ret = apba_unipro_attr_single(&req);
+	mutex_unlock(&g_ctrl->unipro_mutex);
 
-	return count;
+	return ret ? ret : count;
 }
 
 static DEVICE_ATTR_WO(apba_write);
@@ -1708,6 +2117,7 @@ static ssize_t apbe_read_store(struct device *dev,
 	struct device_attribute *attr, const char *buf, size_t count)
 {
 	int ret;
+	struct apba_unipro_attr req = { 0 };
 	int attribute = 0;
 	unsigned int selector = 0;
 
@@ -1718,17 +2128,15 @@ static ssize_t apbe_read_store(struct device *dev,
 	if (ret < 1) /* one required parameter */
 		return -EINVAL;
 
-	if (apba_send_unipro_read_attr_req(attribute, selector, 1))
-		return -EIO;
+	req.attribute = attribute;
+	req.selector = selector;
+	req.peer = 1;
 
-	if (!wait_for_completion_timeout(
-		    &g_ctrl->unipro_comp,
-		    msecs_to_jiffies(APBA_UNIPRO_REQ_TIMEOUT))) {
-		pr_err("%s: timeout\n", __func__);
-		return -ETIMEDOUT;
-	}
+	mutex_lock(&g_ctrl->unipro_mutex);
+	ret = apba_unipro_attr_single(&req);
+	mutex_unlock(&g_ctrl->unipro_mutex);
 
-	return count;
+	return ret ? ret : count;
 }
 
 static ssize_t apbe_read_show(struct device *dev,
@@ -1747,6 +2155,7 @@ static ssize_t apbe_write_store(struct device *dev,
 	struct device_attribute *attr, const char *buf, size_t count)
 {
 	int ret;
+	struct apba_unipro_attr req = { 0 };
 	uint16_t attribute = 0;
 	uint32_t value = 0;
 	uint16_t selector = 0;
@@ -1758,17 +2167,17 @@ static ssize_t apbe_write_store(struct device *dev,
 	if (ret < 2) /* two required parameters */
 		return -EINVAL;
 
-	if (apba_send_unipro_write_attr_req(attribute, selector, 1, value))
-		return -EIO;
+	req.attribute = attribute;
+	req.selector = selector;
+	req.peer = 1;
+	req.write = true;
+	req.value = value;
 
-	if (!wait_for_completion_timeout(
-		    &g_ctrl->unipro_comp,
-		    msecs_to_jiffies(APBA_UNIPRO_REQ_TIMEOUT))) {
-		pr_err("%s: timeout\n", __func__);
-		return -ETIMEDOUT;
-	}
+	mutex_lock(&g_ctrl->unipro_mutex);
+	ret = apba_unipro_attr_single(&req);
+	mutex_unlock(&g_ctrl->unipro_mutex);
 
-	return count;
+	return ret ? ret : count;
 }
 
 static DEVICE_ATTR_WO(apbe_write);
@@ -1789,21 +2198,130 @@ static ssize_t gear_store(struct device *dev,
 	if (ret < 4)
 		return -EINVAL;
 
-	if (apba_send_unipro_gear_req(tx, rx, pwrmode, series))
-		return -EIO;
+	mutex_lock(&g_ctrl->unipro_mutex);
+	reinit_completion(&g_ctrl->unipro_comp);
+
+	if (apba_send_unipro_gear_req(tx, rx, pwrmode, series)) {
+		ret = -EIO;
+		goto out;
+	}
 
 	if (!wait_for_completion_timeout(
 		    &g_ctrl->unipro_comp,
 		    msecs_to_jiffies(APBA_UNIPRO_REQ_TIMEOUT))) {
 		pr_err("%s: timeout\n", __func__);
-		return -ETIMEDOUT;
+		ret = -ETIMEDOUT;
+		goto out;
 	}
 
-	return count;
+	ret = count;
+out:
+	mutex_unlock(&g_ctrl->unipro_mutex);
+
+	return ret;
 }
 
 static DEVICE_ATTR_WO(gear);
 
+/*
+ * Each line written is "<attr hex> <selector> <peer> [value hex]"; lines
+ * with a value are writes. Reading returns the results of the last batch.
+ */
+#define APBA_UNIPRO_BATCH_SYSFS_MAX	64
+static ssize_t unipro_batch_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct apba_unipro_attr *attrs;
+	char *str, *line, *cur;
+	unsigned int n = 0;
+	int ret;
+
+	if (!g_ctrl)
+		return -ENODEV;
+
+	attrs = kcalloc(APBA_UNIPRO_BATCH_SYSFS_MAX, sizeof(*attrs),
+			GFP_KERNEL);
+	if (!attrs)
+		return -ENOMEM;
+
+	str = kstrndup(buf, count, GFP_KERNEL);
+	if (!str) {
+		ret = -ENOMEM;
+		goto free_attrs;
+	}
+
+	cur = str;
+	while ((line = strsep(&cur, "\n;")) != NULL) {
+		unsigned int attribute, selector, peer, value;
+
+		ret = sscanf(line, "%x %u %u %x", &attribute, &selector,
+			     &peer, &value);
+		if (ret <= 0)
+			continue;
+		if (ret < 3 || n >= APBA_UNIPRO_BATCH_SYSFS_MAX) {
+			ret = -EINVAL;
+			goto free_str;
+		}
+
+		attrs[n].attribute = attribute;
+		attrs[n].selector = selector;
+		attrs[n].peer = !!peer;
+		attrs[n].write = (ret == 4);
+		attrs[n].value = (ret == 4) ? value : 0;
+		n++;
+	}
+
+	if (!n) {
+		ret = -EINVAL;
+		goto free_str;
+	}
+
+	ret = apba_unipro_attr_batch(attrs, n);
+	if (ret)
+		goto free_str;
+
+	mutex_lock(&g_ctrl->unipro_batch_mutex);
+	kfree(g_ctrl->unipro_batch_attrs);
+	g_ctrl->unipro_batch_attrs = attrs;
+	g_ctrl->unipro_batch_count = n;
+	mutex_unlock(&g_ctrl->unipro_batch_mutex);
+	attrs = NULL;
+
+	ret = count;
+
+free_str:
+	kfree(str);
+free_attrs:
+	kfree(attrs);
+
+	return ret;
+}
+
+static ssize_t unipro_batch_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct apba_unipro_attr *a;
+	unsigned int i;
+	int count = 0;
+
+	if (!g_ctrl)
+		return -ENODEV;
+
+	mutex_lock(&g_ctrl->unipro_batch_mutex);
+	for (i = 0; i < g_ctrl->unipro_batch_count; i++) {
+		a = &g_ctrl->unipro_batch_attrs[i];
+		count += scnprintf(buf + count, PAGE_SIZE - count,
+			"%04x %u %u %c value=%08x, status=%08x\n",
+			a->attribute, a->selector, a->peer,
+			a->write ? 'w' : 'r', a->value, a->result);
+	}
+	mutex_unlock(&g_ctrl->unipro_batch_mutex);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(unipro_batch);
+
 static ssize_t unipro_mid_show(struct device *dev,
 	struct device_attribute *attr, char *buf)
 {
@@ -1859,6 +2377,20 @@ static ssize_t fw_version_show(struct device *dev,
 
 static DEVICE_ATTR_RO(fw_version);
 
+static ssize_t boot_timing_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	if (!g_ctrl)
+		return -ENODEV;
+
+	return scnprintf(buf, PAGE_SIZE,
+			 "det_enable_ms=%lld fw_done_ms=%lld flashed=%d\n",
+			 g_ctrl->det_enable_ms, g_ctrl->fw_done_ms,
+			 g_ctrl->fw_flashed);
+}
+
+static DEVICE_ATTR_RO(boot_timing);
+
 static ssize_t fw_version_str_show(struct device *dev,
 	struct device_attribute *attr, char *buf)
 {
@@ -1922,18 +2454,34 @@ static struct attribute *apba_attrs[] = {
 	&dev_attr_apbe_read.attr,
 	&dev_attr_apbe_write.attr,
 	&dev_attr_gear.attr,
+	&dev_attr_unipro_batch.attr,
 	&dev_attr_unipro_mid.attr,
 	&dev_attr_unipro_pid.attr,
 	&dev_attr_vid.attr,
 	&dev_attr_pid.attr,
 	&dev_attr_fw_version.attr,
 	&dev_attr_fw_version_str.attr,
+	&dev_attr_boot_timing.attr,
 	&dev_attr_unipro_stats.attr,
 	NULL,
 };
 
 ATTRIBUTE_GROUPS(apba);
 
+static s64 apba_ms_since_probe(struct apba_ctrl *ctrl)
+{
+	return ktime_to_ms(ktime_sub(ktime_get(), ctrl->probe_time));
+}
+
+/* muc_enable_det() is one-shot, only the first call is timed */
+static void apba_enable_det(struct apba_ctrl *ctrl)
+{
+	if (ctrl->det_enable_ms < 0)
+		ctrl->det_enable_ms = apba_ms_since_probe(ctrl);
+
+	muc_enable_det();
+}
+
 static void apba_firmware_callback(const struct firmware *fw,
 					 void *context)
 {
@@ -1950,23 +2498,27 @@ static void apba_firmware_callback(const struct firmware *fw,
 
 	if (!fw) {
 		pr_err("%s: no firmware available\n", __func__);
-		apba_flash_on(ctrl, false);
-		if (ctrl->desired_on)
-			apba_on(ctrl, true);
+		apba_flash_end(ctrl, true);
 	} else {
 		pr_debug("%s: size=%zu data=%p\n", __func__, fw->size,
 			fw->data);
 
-		err = apba_flash_partition(ctrl, APBA_FIRMWARE_PARTITION, fw);
+		err = apba_flash_partition(ctrl, fw_partition, fw, false);
 		if (err < 0)
 			pr_err("%s: flashing failed err=%d\n", __func__, err);
+		else
+			ctrl->fw_flashed = err > 0;
 
 		/* TODO: notify system, in case of error */
 		release_firmware(fw);
 	}
 
+	ctrl->fw_done_ms = apba_ms_since_probe(ctrl);
+	pr_info("%s: firmware %s in %lld ms\n", __func__,
+		ctrl->fw_flashed ? "flashed" : "checked", ctrl->fw_done_ms);
+
 	/* Flashing is done, let's let muc core probe finish. */
-	muc_enable_det();
+	apba_enable_det(ctrl);
 	complete(&g_ctrl->fw_callback);
 }
 
@@ -2158,7 +2710,9 @@ static void apba_dettach_work_func(struct work_struct *work)
 	g_ctrl->desired_on = 0;
 	g_ctrl->apbe_status = MHB_PM_STATUS_PEER_NONE;
 
+	mutex_lock(&g_ctrl->power_mutex);
 	apba_on(g_ctrl, false);
+	mutex_unlock(&g_ctrl->power_mutex);
 }
 
 /*
@@ -2208,9 +2762,13 @@ int apba_enable(void)
 	if (!g_ctrl)
 		return -ENODEV;
 
+	mutex_lock(&g_ctrl->power_mutex);
 	g_ctrl->desired_on = 1;
 
-	apba_on(g_ctrl, true);
+	/* Powered on by apba_flash_end() once the flash is released */
+	if (!g_ctrl->fw_busy)
+		apba_on(g_ctrl, true);
+	mutex_unlock(&g_ctrl->power_mutex);
 
 	return 0;
 }
@@ -2225,7 +2783,9 @@ void apba_disable(void)
 	g_ctrl->desired_on = 0;
 	g_ctrl->apbe_status = MHB_PM_STATUS_PEER_NONE;
 
+	mutex_lock(&g_ctrl->power_mutex);
 	apba_on(g_ctrl, false);
+	mutex_unlock(&g_ctrl->power_mutex);
 }
 
 static int apba_ctrl_probe(struct platform_device *pdev)
@@ -2335,12 +2895,17 @@ static int apba_ctrl_probe(struct platform_device *pdev)
 	}
 
 	mutex_init(&ctrl->log_mutex);
+	mutex_init(&ctrl->power_mutex);
 	init_completion(&ctrl->comp);
 	init_completion(&ctrl->apbe_log_comp);
 	init_completion(&ctrl->baud_comp);
 	init_completion(&ctrl->mode_comp);
 	init_completion(&ctrl->unipro_comp);
 	init_completion(&ctrl->unipro_stats_comp);
+	mutex_init(&ctrl->unipro_mutex);
+	mutex_init(&ctrl->unipro_batch_mutex);
+	spin_lock_init(&ctrl->unipro_batch_lock);
+	INIT_LIST_HEAD(&ctrl->unipro_batch_list);
 
 	ctrl->unipro_mid = APBA_FIRMWARE_UNIPRO_MID;
 	ctrl->unipro_pid = APBA_FIRMWARE_UNIPRO_PID;
@@ -2397,6 +2962,17 @@ static int apba_ctrl_probe(struct platform_device *pdev)
 		 APBA_FIRMWARE_STAGE);
 	pr_debug("%s: requesting fw %s\n", __func__, ctrl->firmware_name);
 
+	/*
+	 * Hold off powering the APBA until the firmware check is done, but
+	 * let mods that do not need the APBA flash bus be detected now.
+	 */
+	ctrl->probe_time = ktime_get();
+	ctrl->det_enable_ms = -1;
+	ctrl->fw_done_ms = -1;
+	ctrl->fw_busy = true;
+	if (!muc_spi_shared_with_flash())
+		apba_enable_det(ctrl);
+
 	init_completion(&ctrl->fw_callback);
 	ret = request_firmware_nowait(THIS_MODULE, true, ctrl->firmware_name,
 				      g_ctrl->dev, GFP_KERNEL, g_ctrl,
@@ -2458,6 +3034,7 @@ static int apba_ctrl_remove(struct platform_device *pdev)
 	of_platform_depopulate(ctrl->dev);
 	of_node_clear_flag(ctrl->dev->of_node, OF_POPULATED_BUS);
 
+	kfree(ctrl->unipro_batch_attrs);
 	g_ctrl = NULL;
 
 	return 0;
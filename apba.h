@@ -27,6 +27,18 @@ int apba_send_pm_wake_rsp(void);
 int apba_send_pm_sleep_req(void);
 void apba_wake_assert(bool assert);
 
+/* UniPro */
+struct apba_unipro_attr {
+	uint16_t attribute;
+	uint16_t selector;
+	uint8_t peer;                  /* 0 = APBA, 1 = APBE */
+	bool write;
+	uint32_t value;                /* written, or read back on success */
+	uint8_t result;                /* MHB_RESULT_* */
+};
+
+int apba_unipro_attr_batch(struct apba_unipro_attr *attrs, unsigned int count);
+
 /* Driver Initializations */
 int apba_ctrl_init(void);
 void apba_ctrl_exit(void);
@@ -74,6 +74,23 @@ int gb_i2s_mgmt_deactivate_port(struct gb_connection *connection,
 				 &request, sizeof(request), NULL, 0);
 }
 
+int gb_i2s_mgmt_get_processing_delay(struct gb_connection *connection,
+				uint32_t *microseconds)
+{
+	struct gb_i2s_mgmt_get_processing_delay_response response;
+	int ret;
+
+	ret = gb_operation_sync(connection,
+				GB_I2S_MGMT_TYPE_GET_PROCESSING_DELAY,
+				NULL, 0, &response, sizeof(response));
+	if (ret)
+		return ret;
+
+	*microseconds = le32_to_cpu(response.microseconds);
+
+	return 0;
+}
+
 int gb_i2s_mgmt_get_supported_configurations(
 	struct gb_connection *connection,
 	struct gb_i2s_mgmt_get_supported_configurations_response *get_cfg,
@@ -278,6 +278,8 @@ static int gb_i2s_mgmt_report_event_recv(u8 type, struct gb_operation *op)
 {
 	struct gb_connection *connection = op->connection;
 	struct gb_i2s_mgmt_report_event_request *req = op->request->payload;
+	struct gb_snd_codec *codec =
+			(struct gb_snd_codec *)connection->private;
 	char *event_name;
 
 	if (type != GB_I2S_MGMT_TYPE_REPORT_EVENT) {
@@ -314,9 +316,11 @@ static int gb_i2s_mgmt_report_event_recv(u8 type, struct gb_operation *op)
 		event_name = "OUT_OF_SEQUENCE";
 		break;
 	case GB_I2S_MGMT_EVENT_UNDERRUN:
+		atomic_inc(&codec->i2s_underruns);
 		event_name = "UNDERRUN";
 		break;
 	case GB_I2S_MGMT_EVENT_OVERRUN:
+		atomic_inc(&codec->i2s_overruns);
 		event_name = "OVERRUN";
 		break;
 	case GB_I2S_MGMT_EVENT_CLOCKING:
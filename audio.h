@@ -58,6 +58,8 @@ struct gb_snd_codec {
 	struct kref mods_aud_kref;
 	struct kref mods_i2s_kref;
 	int (*report_devices)(struct gb_snd_codec *);
+	atomic_t i2s_underruns; /* module reported I2S xruns */
+	atomic_t i2s_overruns;
 };
 
 /* kref resource counting */
@@ -94,6 +96,8 @@ int gb_i2s_mgmt_activate_port(struct gb_connection *connection,
 				uint8_t port_type);
 int gb_i2s_mgmt_deactivate_port(struct gb_connection *connection,
 				uint8_t port_type);
+int gb_i2s_mgmt_get_processing_delay(struct gb_connection *connection,
+				uint32_t *microseconds);
 int gb_i2s_mgmt_send_start(struct gb_snd_codec *snd_codec, uint32_t port_type,
 			bool start);
 
@@ -30,6 +30,7 @@
 #define CAMERA_EXT_H
 
 #include <linux/byteorder/generic.h>
+#include <linux/ktime.h>
 #include <linux/types.h>
 #include <media/v4l2-dev.h>
 #include <media/v4l2-device.h>
@@ -38,6 +39,36 @@
 
 #define CAMERA_EXT_DEV_NAME "camera_ext"
 
+/*
+ * Metadata ring, an alternative to the MMAP buffer queue. Userspace maps
+ * CAMERA_EXT_META_RING_OFFSET of the mod device: a header page followed by
+ * size bytes of records. The driver advances head as records are added,
+ * userspace advances tail as it consumes them and poll()s for POLLIN.
+ * head and tail are free running byte counts, offsets are taken modulo
+ * size. Records are 8 byte aligned and never wrap, a PAD record fills the
+ * rest of the ring instead. Userspace has to mirror this layout.
+ */
+#define CAMERA_EXT_META_RING_OFFSET	0x10000000
+#define CAMERA_EXT_META_RING_VERSION	1
+
+struct camera_ext_meta_ring {
+	__u32 version;
+	__u32 size;
+	__u32 head;		/* written by the driver */
+	__u32 tail;		/* written by userspace */
+	__u32 dropped;		/* records lost to a full ring */
+	__u32 reserved[3];
+};
+
+#define CAMERA_EXT_META_REC_PAD		0xffffffff
+
+struct camera_ext_meta_rec {
+	__u32 len;		/* of data, or CAMERA_EXT_META_REC_PAD */
+	__u32 sequence;		/* report number since stream on */
+	__u64 timestamp_ns;	/* CLOCK_MONOTONIC link receive time */
+	__u8 data[0];
+};
+
 enum camera_ext_state {
 	CAMERA_EXT_READY = 0,
 	CAMERA_EXT_DESTROYED,
@@ -122,5 +153,5 @@ struct v4l2_ctrl_config *camera_ext_get_ctrl_config(uint32_t id);
 void camera_ext_mod_v4l2_event_notify(struct camera_ext *cam_dev,
 		struct v4l2_camera_ext_event *event);
 int camera_ext_mod_v4l2_buffer_notify(struct camera_ext *cam_dev,
-		const char *desc, size_t size);
+		const char *desc, size_t size, ktime_t recv_time);
 #endif /* CAMERA_EXT_H */
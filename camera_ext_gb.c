@@ -1080,7 +1080,7 @@ static int gb_camera_ext_async_msg_receive(u8 type, struct gb_operation *op)
 		}
 		metadata = (struct camera_ext_event_metadata *)msg_hdr->data;
 		camera_ext_mod_v4l2_buffer_notify(cam_dev,
-			metadata->desc, msg_data_size);
+			metadata->desc, msg_data_size, op->recv_time);
 		break;
 	default:
 		pr_err("unsupported event type %d\n", msg_type);
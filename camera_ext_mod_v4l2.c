@@ -32,6 +32,8 @@
 #include <linux/regulator/consumer.h>
 #include <linux/slab.h>
 #include <linux/of.h>
+#include <linux/poll.h>
+#include <linux/vmalloc.h>
 #include <media/v4l2-ioctl.h>
 #include <media/v4l2-event.h>
 #include <media/videobuf2-vmalloc.h>
@@ -45,6 +47,9 @@
 #define CAM_EXT_CTRL_NUM_HINT   100
 #define MAX_RETRY_TIMES         50
 
+/* Room for 64 full size reports, must be a power of 2 */
+#define CAM_EXT_META_RING_SIZE  (64 * CAMERA_EXT_EVENT_METADATA_DESC_LEN)
+
 #define CAM_DEV_FROM_V4L2_CTRL(ctrl) \
 	container_of(ctrl->handler, struct camera_ext, hdl_ctrls)
 
@@ -57,6 +62,15 @@ struct metastream_data {
 	struct list_head available_buffers;
 };
 
+struct metaring_data {
+	spinlock_t lock;
+	wait_queue_head_t wait;
+	struct camera_ext_meta_ring *ring; /* NULL until mmap()ed */
+	/* kernel copies, the mapped header is writable by userspace */
+	u32 head;
+	u32 sequence;
+};
+
 struct camera_ext_v4l2 {
 	struct regulator *cdsi_reg;
 	struct mutex mod_mutex;
@@ -65,6 +79,7 @@ struct camera_ext_v4l2 {
 	bool buf_requested;
 	bool streaming;
 	struct metastream_data strm;
+	struct metaring_data ring;
 };
 
 struct vb2_metadata_buffer {
@@ -217,6 +232,10 @@ static int stream_on(struct file *file, void *fh,
 
 	g_v4l2_data->streaming = true;
 
+	spin_lock_irq(&g_v4l2_data->ring.lock);
+	g_v4l2_data->ring.sequence = 0;
+	spin_unlock_irq(&g_v4l2_data->ring.lock);
+
 	if (g_v4l2_data->buf_requested)
 		ret = vb2_streamon(q, buf_type);
 	else
@@ -278,12 +297,130 @@ static int subscribe_event(struct v4l2_fh *fh,
 	}
 }
 
+/*
+ * Copy a report straight from the received message into the ring.
+ * Returns false if no ring is mapped, or the buffer queue is in use.
+ */
+static bool camera_ext_meta_ring_push(const char *desc, size_t size,
+				      ktime_t recv_time)
+{
+	struct metaring_data *mr = &g_v4l2_data->ring;
+	struct camera_ext_meta_ring *ring;
+	struct camera_ext_meta_rec *rec;
+	size_t need = ALIGN(sizeof(*rec) + size, 8);
+	unsigned long flags;
+	u32 head, tail, off, room;
+	u8 *data;
+
+	spin_lock_irqsave(&mr->lock, flags);
+	ring = mr->ring;
+	if (!ring || g_v4l2_data->buf_requested) {
+		spin_unlock_irqrestore(&mr->lock, flags);
+		return false;
+	}
+
+	data = (u8 *)ring + PAGE_SIZE;
+	head = mr->head;
+	/*
+	 * tail is written by userspace, don't trust it. It is only used
+	 * for the free space, so clamp it to at most one ring behind head.
+	 */
+	tail = smp_load_acquire(&ring->tail);
+	if (head - tail > CAM_EXT_META_RING_SIZE)
+		tail = head - CAM_EXT_META_RING_SIZE;
+
+	off = head & (CAM_EXT_META_RING_SIZE - 1);
+	room = CAM_EXT_META_RING_SIZE - off;
+	if (need > room)
+		need += room;
+
+	if (need > CAM_EXT_META_RING_SIZE - (head - tail)) {
+		ring->dropped++;
+		spin_unlock_irqrestore(&mr->lock, flags);
+		pr_warn_ratelimited("%s: ring full\n", __func__);
+		return true;
+	}
+
+	if (off + sizeof(*rec) + size > CAM_EXT_META_RING_SIZE) {
+		rec = (struct camera_ext_meta_rec *)(data + off);
+		rec->len = CAMERA_EXT_META_REC_PAD;
+		head += room;
+		off = 0;
+	}
+
+	rec = (struct camera_ext_meta_rec *)(data + off);
+	rec->len = size;
+	rec->sequence = mr->sequence++;
+	rec->timestamp_ns = ktime_to_ns(recv_time);
+	memcpy(rec->data, desc, size);
+	head += ALIGN(sizeof(*rec) + size, 8);
+
+	mr->head = head;
+	smp_store_release(&ring->head, head);
+	spin_unlock_irqrestore(&mr->lock, flags);
+
+	wake_up_interruptible(&mr->wait);
+
+	return true;
+}
+
+static int camera_ext_meta_ring_mmap(struct vm_area_struct *vma)
+{
+	struct metaring_data *mr = &g_v4l2_data->ring;
+	struct camera_ext_meta_ring *ring;
+	int ret;
+
+	if (vma->vm_end - vma->vm_start > PAGE_SIZE + CAM_EXT_META_RING_SIZE)
+		return -EINVAL;
+
+	mutex_lock(&g_v4l2_data->mod_mutex);
+	ring = mr->ring;
+	if (!ring) {
+		ring = vmalloc_user(PAGE_SIZE + CAM_EXT_META_RING_SIZE);
+		if (!ring) {
+			mutex_unlock(&g_v4l2_data->mod_mutex);
+			return -ENOMEM;
+		}
+		ring->version = CAMERA_EXT_META_RING_VERSION;
+		ring->size = CAM_EXT_META_RING_SIZE;
+
+		spin_lock_irq(&mr->lock);
+		mr->ring = ring;
+		mr->head = 0;
+		mr->sequence = 0;
+		spin_unlock_irq(&mr->lock);
+	}
+
+	ret = remap_vmalloc_range(vma, ring, 0);
+	mutex_unlock(&g_v4l2_data->mod_mutex);
+
+	return ret;
+}
+
+/* Only once the last user is gone, so nothing maps the ring any more */
+static void camera_ext_meta_ring_free(void)
+{
+	struct metaring_data *mr = &g_v4l2_data->ring;
+	struct camera_ext_meta_ring *ring;
+
+	spin_lock_irq(&mr->lock);
+	ring = mr->ring;
+	mr->ring = NULL;
+	spin_unlock_irq(&mr->lock);
+
+	vfree(ring);
+}
+
 int camera_ext_mod_v4l2_buffer_notify(struct camera_ext *cam_dev,
-				const char *desc, size_t size)
+				const char *desc, size_t size,
+				ktime_t recv_time)
 {
 	struct vb2_metadata_buffer *available_buf;
 	void *metadata;
 
+	if (camera_ext_meta_ring_push(desc, size, recv_time))
+		return 0;
+
 	if (!vb2_is_streaming(&g_v4l2_data->strm.vb2_q))
 		return 0;
 	mutex_lock(&g_v4l2_data->strm.list_lock);
@@ -649,6 +786,7 @@ static int mod_v4l2_close(struct file *file)
 	--g_v4l2_data->mod_users;
 	if (g_v4l2_data->mod_users == 0) {
 		vb2_queue_release(&g_v4l2_data->strm.vb2_q);
+		camera_ext_meta_ring_free();
 		mod_v4l2_reg_control(false);
 		g_open_mode = CAMERA_EXT_BOOTMODE_NORMAL;
 		if (cam_dev->state == CAMERA_EXT_READY)
@@ -667,6 +805,8 @@ static unsigned int mod_v4l2_poll(struct file *file,
 	struct metastream_data *strm = &g_v4l2_data->strm;
 	struct vb2_queue *q = &strm->vb2_q;
 	struct v4l2_fh *fh = file->private_data;
+	struct metaring_data *mr = &g_v4l2_data->ring;
+	struct camera_ext_meta_ring *ring;
 
 	if (vb2_is_streaming(q)) {
 		ret = vb2_poll(q, file, pll_table);
@@ -674,6 +814,13 @@ static unsigned int mod_v4l2_poll(struct file *file,
 		poll_wait(file, &fh->wait, pll_table);
 		if (v4l2_event_pending(fh))
 			ret = POLLPRI;
+
+		poll_wait(file, &mr->wait, pll_table);
+		spin_lock_irq(&mr->lock);
+		ring = mr->ring;
+		if (ring && mr->head != READ_ONCE(ring->tail))
+			ret |= POLLIN | POLLRDNORM;
+		spin_unlock_irq(&mr->lock);
 	}
 
 	return ret;
@@ -684,6 +831,9 @@ static int mod_v4l2_mmap(struct file *file, struct vm_area_struct *vma)
 	struct metastream_data *strm = &g_v4l2_data->strm;
 	struct vb2_queue *q = &strm->vb2_q;
 
+	if (vma->vm_pgoff == CAMERA_EXT_META_RING_OFFSET >> PAGE_SHIFT)
+		return camera_ext_meta_ring_mmap(vma);
+
 	return vb2_mmap(q, vma);
 }
 
@@ -961,6 +1111,8 @@ static int camera_ext_v4l2_probe(struct platform_device *pdev)
 
 	mutex_init(&data->mod_mutex);
 	mutex_init(&data->strm.list_lock);
+	spin_lock_init(&data->ring.lock);
+	init_waitqueue_head(&data->ring.wait);
 	g_v4l2_data = data;
 
 	return 0;
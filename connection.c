@@ -188,6 +188,7 @@ gb_connection_create(struct gb_host_device *hd, int hd_cport_id,
 	atomic_set(&connection->op_cycle, 0);
 	spin_lock_init(&connection->lock);
 	INIT_LIST_HEAD(&connection->operations);
+	gb_operation_async_init(connection);
 
 	connection->wq = alloc_workqueue("%s:%d", WQ_UNBOUND, 1,
 					 dev_name(&hd->dev), hd_cport_id);
@@ -487,6 +488,8 @@ void gb_connection_exit(struct gb_connection *connection)
 	if (connection->state == GB_CONNECTION_STATE_DESTROYING)
 		gb_connection_cancel_operations(connection, -ESHUTDOWN);
 
+	gb_operation_async_flush(connection);
+
 	connection->protocol->connection_exit(connection);
 	gb_connection_control_disconnected(connection);
 	gb_connection_svc_connection_destroy(connection);
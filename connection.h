@@ -12,6 +12,7 @@
 
 #include <linux/list.h>
 #include <linux/kfifo.h>
+#include <linux/workqueue.h>
 
 enum gb_connection_state {
 	GB_CONNECTION_STATE_INVALID	= 0,
@@ -49,6 +50,12 @@ struct gb_connection {
 
 	atomic_t			op_cycle;
 
+	/* Asynchronous unidirectional sends, protected by lock */
+	struct list_head		async_done;
+	struct list_head		async_cache;
+	unsigned int			async_cached;
+	struct work_struct		async_work;
+
 	void				*private;
 };
 
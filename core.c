@@ -12,6 +12,7 @@
 #define CREATE_TRACE_POINTS
 #include "greybus.h"
 #include "greybus_trace.h"
+#include "gballoc.h"
 
 EXPORT_TRACEPOINT_SYMBOL_GPL(gb_host_device_send);
 EXPORT_TRACEPOINT_SYMBOL_GPL(gb_host_device_recv);
@@ -194,6 +195,12 @@ static int __init gb_init(void)
 
 	gb_debugfs_init();
 
+	retval = gb_alloc_init();
+	if (retval) {
+		pr_err("gb_alloc_init failed (%d)\n", retval);
+		goto error_alloc;
+	}
+
 	retval = bus_register(&greybus_bus_type);
 	if (retval) {
 		pr_err("bus_register failed (%d)\n", retval);
@@ -243,6 +250,8 @@ error_operation:
 error_hd:
 	bus_unregister(&greybus_bus_type);
 error_bus:
+	gb_alloc_exit();
+error_alloc:
 	gb_debugfs_cleanup();
 
 	return retval;
@@ -257,6 +266,7 @@ static void __exit gb_exit(void)
 	gb_operation_exit();
 	gb_hd_exit();
 	bus_unregister(&greybus_bus_type);
+	gb_alloc_exit();
 	gb_debugfs_cleanup();
 	tracepoint_synchronize_unregister();
 }
@@ -12,15 +12,40 @@
 #include <linux/device.h>
 #include <linux/kdev_t.h>
 #include <linux/idr.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
 
 #include <linux/mod_display_comm.h>
 
 #include "greybus.h"
 
+/* Window in which back-to-back module events are folded into one uevent */
+#define DISPLAY_EVENT_COALESCE_MS	20
+
 struct gb_display_device {
 	struct gb_connection	*connection;
 	struct device		*dev;
 	int			minor;		/* display minor number */
+
+	/*
+	 * Last config and state read from (or written to) the module. Events
+	 * mark them stale so that readers only go over the link when the
+	 * module has actually changed something. The config is replaced in
+	 * place and only freed on connection exit.
+	 */
+	struct mutex		lock;
+	struct mod_display_panel_config *config;
+	bool			config_stale;
+	u8			state;
+	bool			state_valid;
+
+	/* Coalesced event reporting */
+	spinlock_t		event_lock;
+	u32			event_seq;
+	u32			event_seq_reported;
+	u8			last_event;
+	struct delayed_work	event_work;
+	bool			removing;	/* no more reports, under event_lock */
 };
 
 /* Helper Functions */
@@ -34,24 +59,72 @@ char* display_event_values[] = {
 	"DISPLAY_EXT=disconnect",
 };
 
-void report_display_event(struct device *dev,
-	enum mod_display_notification event)
+static void display_event_work(struct work_struct *work)
 {
-	char *envp[2];
+	struct gb_display_device *disp = container_of(to_delayed_work(work),
+			struct gb_display_device, event_work);
+	char seq_env[32];
+	char *envp[3];
+	u32 seq, skipped;
+	u8 event;
+
+	spin_lock_irq(&disp->event_lock);
+	event = disp->last_event;
+	seq = disp->event_seq;
+	skipped = seq - disp->event_seq_reported - 1;
+	disp->event_seq_reported = seq;
+	spin_unlock_irq(&disp->event_lock);
 
 	envp[0] = display_event_values[event < GB_DISPLAY_NOTIFY_NUM_EVENTS ?
 		event : GB_DISPLAY_NOTIFY_INVALID];
-	envp[1] = NULL;
+	snprintf(seq_env, sizeof(seq_env), "DISPLAY_EXT_SEQ=%u", seq);
+	envp[1] = seq_env;
+	envp[2] = NULL;
+
+	dev_dbg(disp->dev, "%s: %s seq=%u (%u coalesced)\n", __func__,
+		envp[0], seq, skipped);
+
+	kobject_uevent_env(&disp->dev->kobj, KOBJ_CHANGE, envp);
+	sysfs_notify(&disp->dev->kobj, NULL, "event_seq");
+}
 
-	dev_dbg(dev, "%s: %s\n", __func__, envp[0]);
+/*
+ * Events are stamped with a sequence number right away, but reported to
+ * userspace at most once per DISPLAY_EVENT_COALESCE_MS carrying the latest
+ * event. Pollers of event_seq can tell from the sequence how many events
+ * were folded into one report.
+ */
+void report_display_event(struct device *dev,
+	enum mod_display_notification event)
+{
+	struct gb_display_device *disp = dev_get_drvdata(dev);
+	unsigned long flags;
+
+	spin_lock_irqsave(&disp->event_lock, flags);
+	disp->event_seq++;
+	disp->last_event = event;
+	if (!disp->removing)
+		schedule_delayed_work(&disp->event_work,
+				msecs_to_jiffies(DISPLAY_EVENT_COALESCE_MS));
+	spin_unlock_irqrestore(&disp->event_lock, flags);
+}
 
-	kobject_uevent_env(&dev->kobj, KOBJ_CHANGE, envp);
+static void display_invalidate_cache(struct gb_display_device *disp)
+{
+	mutex_lock(&disp->lock);
+	disp->config_stale = true;
+	disp->state_valid = false;
+	mutex_unlock(&disp->lock);
 }
 
 int handle_notification(struct device *dev, enum mod_display_notification event)
 {
+	struct gb_display_device *disp = dev_get_drvdata(dev);
 	int ret = -EINVAL;
 
+	/* any module event may come with a new config or state */
+	display_invalidate_cache(disp);
+
 	switch(event) {
 	case GB_DISPLAY_NOTIFY_FAILURE:
 		dev_err(dev, "GB_DISPLAY_NOTIFY_FAILURE\n");
@@ -100,9 +173,9 @@ static int host_ready(void *data)
 
 #define MAX_DISPLAY_CONFIG_SIZE 1024
 
-static int get_display_config(void *data, struct mod_display_panel_config **display_config)
+static int __get_display_config(struct gb_display_device *disp,
+				struct mod_display_panel_config **display_config)
 {
-	struct gb_display_device *disp = (struct gb_display_device *)data;
 	struct gb_display_get_display_config_size_response size_response;
 	struct gb_display_get_display_config_response *config_response;
 	struct mod_display_panel_config *config;
@@ -155,6 +228,52 @@ exit:
 	return ret;
 }
 
+/* Fetch the config into the cache, disp->lock must be held */
+static int display_refresh_config(struct gb_display_device *disp)
+{
+	struct mod_display_panel_config *config;
+	int ret;
+
+	ret = __get_display_config(disp, &config);
+	if (ret)
+		return ret;
+
+	kfree(disp->config);
+	disp->config = config;
+	disp->config_stale = false;
+
+	return 0;
+}
+
+/* Returns a copy of the cached config, fetching it first if needed */
+static int get_display_config(void *data, struct mod_display_panel_config **display_config)
+{
+	struct gb_display_device *disp = (struct gb_display_device *)data;
+	struct mod_display_panel_config *config;
+	int ret = 0;
+
+	mutex_lock(&disp->lock);
+	if (!disp->config || disp->config_stale) {
+		ret = display_refresh_config(disp);
+		if (ret)
+			goto exit;
+	}
+
+	config = kmemdup(disp->config,
+			 sizeof(*config) + disp->config->config_size,
+			 GFP_KERNEL);
+	if (!config) {
+		ret = -ENOMEM;
+		goto exit;
+	}
+
+	*display_config = config;
+
+exit:
+	mutex_unlock(&disp->lock);
+	return ret;
+}
+
 static int set_display_config(void *data, u8 index)
 {
 	struct gb_display_device *disp = (struct gb_display_device *)data;
@@ -163,8 +282,13 @@ static int set_display_config(void *data, u8 index)
 
 	request.index = index;
 
+	mutex_lock(&disp->lock);
 	ret = gb_operation_sync(disp->connection, GB_DISPLAY_SET_CONFIG,
 				&request, sizeof(request), NULL, 0);
+	/* Bring the cache up to date here rather than in the next reader */
+	if (ret || display_refresh_config(disp))
+		disp->config_stale = true;
+	mutex_unlock(&disp->lock);
 
 	return ret;
 }
@@ -173,16 +297,23 @@ static int get_display_state(void *data, u8 *state)
 {
 	struct gb_display_device *disp = (struct gb_display_device *)data;
 	struct gb_display_get_display_state_response response;
-	int ret;
+	int ret = 0;
+
+	mutex_lock(&disp->lock);
+	if (disp->state_valid)
+		goto out;
 
 	ret = gb_operation_sync(disp->connection, GB_DISPLAY_GET_STATE,
 				NULL, 0, &response, sizeof(response));
 	if (ret)
 		goto exit;
 
-	*state = response.state;
-
+	disp->state = response.state;
+	disp->state_valid = true;
+out:
+	*state = disp->state;
 exit:
+	mutex_unlock(&disp->lock);
 	return ret;
 }
 
@@ -196,8 +327,12 @@ static int set_display_state(void *data, u8 state)
 
 	request.state = state;
 
+	mutex_lock(&disp->lock);
 	ret = gb_operation_sync_timeout(disp->connection, GB_DISPLAY_SET_STATE,
 				&request, sizeof(request), NULL, 0, SET_STATE_TIMEOUT);
+	disp->state = state;
+	disp->state_valid = !ret;
+	mutex_unlock(&disp->lock);
 
 	return ret;
 }
@@ -322,10 +457,30 @@ static ssize_t state_store(struct device *dev,
 }
 static DEVICE_ATTR_RW(state);
 
+/* poll()-able: sysfs_notify() is raised each time an event is reported */
+static ssize_t event_seq_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct gb_display_device *disp = dev_get_drvdata(dev);
+	u32 seq;
+	u8 event;
+
+	spin_lock_irq(&disp->event_lock);
+	seq = disp->event_seq;
+	event = disp->last_event;
+	spin_unlock_irq(&disp->event_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%u %s\n", seq,
+		display_event_values[event < GB_DISPLAY_NOTIFY_NUM_EVENTS ?
+			event : GB_DISPLAY_NOTIFY_INVALID]);
+}
+static DEVICE_ATTR_RO(event_seq);
+
 static struct attribute *display_attrs[] = {
 	&dev_attr_config.attr,
 	&dev_attr_notification.attr,
 	&dev_attr_state.attr,
+	&dev_attr_event_seq.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(display);
@@ -411,6 +566,9 @@ static int gb_display_connection_init(struct gb_connection *connection)
 		return -ENOMEM;
 
 	disp->connection = connection;
+	mutex_init(&disp->lock);
+	spin_lock_init(&disp->event_lock);
+	INIT_DELAYED_WORK(&disp->event_work, display_event_work);
 
 	disp->minor = ida_simple_get(&minors, 0, 0, GFP_KERNEL);
 	if (disp->minor < 0) {
@@ -446,11 +604,23 @@ static void gb_display_connection_exit(struct gb_connection *connection)
 	mod_display_unregister_comm(&mod_display_comm);
 	mod_display_comm_ops.data = NULL;
 
+	connection->private = NULL;
+	/* Let notifications already being handled finish with disp */
+	flush_workqueue(connection->wq);
+
+	/* sysfs stays live until the device is gone, stop it reporting */
+	spin_lock_irq(&disp->event_lock);
+	disp->removing = true;
+	spin_unlock_irq(&disp->event_lock);
+	cancel_delayed_work_sync(&disp->event_work);
+
 #if LINUX_VERSION_CODE <= KERNEL_VERSION(3,11,0)
 	sysfs_remove_group(&disp->dev->kobj, display_groups[0]);
 #endif
 	device_unregister(disp->dev);
 	ida_simple_remove(&minors, disp->minor);
+	kfree(disp->config);
+	mutex_destroy(&disp->lock);
 	kfree(disp);
 }
 
@@ -7,24 +7,212 @@
  * Released under the GPLv2 only.
  */
 
+#include <linux/crc32.h>
 #include <linux/firmware.h>
+#include <linux/moduleparam.h>
 
 #include "greybus.h"
 
 #define ES2_UNIPRO_MFG_ID	0x00000126
 #define ES2_UNIPRO_PROD_ID	0x00001000
 
+#define FIRMWARE_NAME_LEN	48
+
+/*
+ * A loaded firmware image. Images stay cached for a while after the last
+ * connection using them goes away, so a module that resets or loses its
+ * link mid-download can resume against the same image instead of starting
+ * over. Several modules may download the same image, so the checkpoints
+ * are kept per interface.
+ */
+struct gb_firmware_image {
+	struct list_head	list;
+	char			name[FIRMWARE_NAME_LEN];
+	const struct firmware	*fw;
+	unsigned int		users;
+	unsigned long		expires;	/* Valid while users == 0 */
+	struct list_head	ckpts;
+};
+
+struct gb_firmware_ckpt {
+	struct list_head	list;
+	u8			interface_id;
+	u32			offset;		/* Last offset the module verified */
+	u32			state;		/* Running crc32 up to offset */
+};
+
 struct gb_firmware {
 	struct gb_connection	*connection;
-	const struct firmware	*fw;
+	struct gb_firmware_image *image;
 	u32			vendor_id;
 	u32			product_id;
 };
 
+static unsigned int cache_secs = 60;
+module_param(cache_secs, uint, 0644);
+MODULE_PARM_DESC(cache_secs, "Seconds to keep an unused firmware image");
+
+static LIST_HEAD(image_cache);
+static DEFINE_MUTEX(image_cache_lock);
+
+static void image_cache_reap(struct work_struct *work);
+static DECLARE_DELAYED_WORK(image_cache_work, image_cache_reap);
+
+static void image_free(struct gb_firmware_image *image)
+{
+	struct gb_firmware_ckpt *ckpt, *tmp;
+
+	list_for_each_entry_safe(ckpt, tmp, &image->ckpts, list)
+		kfree(ckpt);
+
+	list_del(&image->list);
+	release_firmware(image->fw);
+	kfree(image);
+}
+
+/* Drop expired images and rearm for the next one to expire */
+static void image_cache_reap(struct work_struct *work)
+{
+	struct gb_firmware_image *image, *tmp;
+	unsigned long next = 0;
+	bool pending = false;
+
+	mutex_lock(&image_cache_lock);
+	list_for_each_entry_safe(image, tmp, &image_cache, list) {
+		if (image->users)
+			continue;
+
+		if (time_after_eq(jiffies, image->expires)) {
+			image_free(image);
+		} else if (!pending || time_before(image->expires, next)) {
+			next = image->expires;
+			pending = true;
+		}
+	}
+
+	if (pending)
+		mod_delayed_work(system_wq, &image_cache_work, next - jiffies);
+	mutex_unlock(&image_cache_lock);
+}
+
+static struct gb_firmware_image *image_lookup(const char *name)
+{
+	struct gb_firmware_image *image;
+
+	list_for_each_entry(image, &image_cache, list) {
+		if (!strcmp(image->name, name)) {
+			image->users++;
+			return image;
+		}
+	}
+
+	return NULL;
+}
+
+static struct gb_firmware_image *image_get(const char *name, struct device *dev)
+{
+	struct gb_firmware_image *image, *cached;
+	int ret;
+
+	mutex_lock(&image_cache_lock);
+	image = image_lookup(name);
+	mutex_unlock(&image_cache_lock);
+	if (image)
+		return image;
+
+	image = kzalloc(sizeof(*image), GFP_KERNEL);
+	if (!image)
+		return ERR_PTR(-ENOMEM);
+
+	/* May go through the usermode helper, don't hold up other lookups */
+	ret = request_firmware(&image->fw, name, dev);
+	if (ret) {
+		kfree(image);
+		return ERR_PTR(ret);
+	}
+
+	strlcpy(image->name, name, sizeof(image->name));
+	INIT_LIST_HEAD(&image->ckpts);
+	image->users = 1;
+
+	/* Someone else may have loaded the same image meanwhile */
+	mutex_lock(&image_cache_lock);
+	cached = image_lookup(name);
+	if (!cached)
+		list_add(&image->list, &image_cache);
+	mutex_unlock(&image_cache_lock);
+
+	if (cached) {
+		release_firmware(image->fw);
+		kfree(image);
+		image = cached;
+	}
+
+	return image;
+}
+
+static void image_put(struct gb_firmware_image *image)
+{
+	mutex_lock(&image_cache_lock);
+	if (--image->users)
+		goto unlock;
+
+	if (!cache_secs) {
+		image_free(image);
+		goto unlock;
+	}
+
+	image->expires = jiffies + cache_secs * HZ;
+	if (!delayed_work_pending(&image_cache_work))
+		mod_delayed_work(system_wq, &image_cache_work,
+				 cache_secs * HZ);
+unlock:
+	mutex_unlock(&image_cache_lock);
+}
+
 static void free_firmware(struct gb_firmware *firmware)
 {
-	release_firmware(firmware->fw);
-	firmware->fw = NULL;
+	image_put(firmware->image);
+	firmware->image = NULL;
+}
+
+/* Checkpoint of this interface's download, called with image_cache_lock held */
+static struct gb_firmware_ckpt *firmware_ckpt(struct gb_firmware *firmware,
+					      bool create)
+{
+	u8 interface_id = firmware->connection->bundle->intf->interface_id;
+	struct gb_firmware_ckpt *ckpt;
+
+	list_for_each_entry(ckpt, &firmware->image->ckpts, list) {
+		if (ckpt->interface_id == interface_id)
+			return ckpt;
+	}
+
+	if (!create)
+		return NULL;
+
+	ckpt = kzalloc(sizeof(*ckpt), GFP_KERNEL);
+	if (!ckpt)
+		return NULL;
+
+	ckpt->interface_id = interface_id;
+	ckpt->state = ~0;
+	list_add(&ckpt->list, &firmware->image->ckpts);
+
+	return ckpt;
+}
+
+static void firmware_ckpt_clear(struct gb_firmware *firmware)
+{
+	struct gb_firmware_ckpt *ckpt;
+
+	mutex_lock(&image_cache_lock);
+	ckpt = firmware_ckpt(firmware, false);
+	if (ckpt) {
+		list_del(&ckpt->list);
+		kfree(ckpt);
+	}
+	mutex_unlock(&image_cache_lock);
 }
 
 /*
@@ -71,10 +259,11 @@ static int download_firmware(struct gb_firmware *firmware, u8 stage)
 {
 	struct gb_connection *connection = firmware->connection;
 	struct gb_interface *intf = connection->bundle->intf;
-	char firmware_name[48];
+	struct gb_firmware_image *image;
+	char firmware_name[FIRMWARE_NAME_LEN];
 
 	/* Already have a firmware, free it */
-	if (firmware->fw)
+	if (firmware->image)
 		free_firmware(firmware);
 
 	/*
@@ -89,8 +278,13 @@ static int download_firmware(struct gb_firmware *firmware, u8 stage)
 
 	dev_info(&connection->bundle->dev, "requesting %s\n", firmware_name);
 
-	return request_firmware(&firmware->fw, firmware_name,
-				&connection->bundle->dev);
+	image = image_get(firmware_name, &connection->bundle->dev);
+	if (IS_ERR(image))
+		return PTR_ERR(image);
+
+	firmware->image = image;
+
+	return 0;
 }
 
 static int gb_firmware_size_request(struct gb_operation *op)
@@ -124,16 +318,128 @@ static int gb_firmware_size_request(struct gb_operation *op)
 	}
 
 	size_response = op->response->payload;
-	size_response->size = cpu_to_le32(firmware->fw->size);
+	size_response->size = cpu_to_le32(firmware->image->fw->size);
 
 	return 0;
 }
 
+static int gb_firmware_get_resume(struct gb_operation *op)
+{
+	struct gb_connection *connection = op->connection;
+	struct gb_firmware *firmware = connection->private;
+	struct gb_firmware_get_resume_request *request = op->request->payload;
+	struct gb_firmware_get_resume_response *response;
+	struct device *dev = &connection->bundle->dev;
+	struct gb_firmware_image *image;
+	struct gb_firmware_ckpt *ckpt;
+	int ret;
+
+	if (op->request->payload_size != sizeof(*request)) {
+		dev_err(dev, "%s: illegal size of get resume request (%zu != %zu)\n",
+			__func__, op->request->payload_size,
+			sizeof(*request));
+		return -EINVAL;
+	}
+
+	ret = download_firmware(firmware, request->stage);
+	if (ret) {
+		dev_err(dev, "%s: failed to download firmware (%d)\n", __func__,
+			ret);
+		return ret;
+	}
+
+	if (!gb_operation_response_alloc(op, sizeof(*response), GFP_KERNEL)) {
+		dev_err(dev, "%s: error allocating response\n", __func__);
+		free_firmware(firmware);
+		return -ENOMEM;
+	}
+
+	image = firmware->image;
+	response = op->response->payload;
+	response->size = cpu_to_le32(image->fw->size);
+
+	mutex_lock(&image_cache_lock);
+	ckpt = firmware_ckpt(firmware, false);
+	if (ckpt && ckpt->offset) {
+		response->offset = cpu_to_le32(ckpt->offset);
+		response->crc = cpu_to_le32(~ckpt->state);
+		dev_info(dev, "%s: resume at %u of %zu\n", image->name,
+			 ckpt->offset, image->fw->size);
+	}
+	mutex_unlock(&image_cache_lock);
+
+	return 0;
+}
+
+static int gb_firmware_checkpoint(struct gb_operation *op)
+{
+	struct gb_connection *connection = op->connection;
+	struct gb_firmware *firmware = connection->private;
+	struct gb_firmware_checkpoint_request *request = op->request->payload;
+	struct device *dev = &connection->bundle->dev;
+	struct gb_firmware_image *image = firmware->image;
+	struct gb_firmware_ckpt *ckpt;
+	u32 offset, start, state;
+	int ret = 0;
+
+	if (op->request->payload_size != sizeof(*request)) {
+		dev_err(dev, "%s: illegal size of checkpoint request (%zu != %zu)\n",
+			__func__, op->request->payload_size,
+			sizeof(*request));
+		return -EINVAL;
+	}
+
+	if (!image) {
+		dev_err(dev, "%s: firmware not available\n", __func__);
+		return -EINVAL;
+	}
+
+	offset = le32_to_cpu(request->offset);
+	if (offset > image->fw->size) {
+		dev_warn(dev, "bad checkpoint (offs = %u)\n", offset);
+		return -EINVAL;
+	}
+
+	mutex_lock(&image_cache_lock);
+
+	ckpt = firmware_ckpt(firmware, true);
+	if (!ckpt) {
+		ret = -ENOMEM;
+		goto unlock;
+	}
+
+	/* Checkpoints normally advance, so only CRC the new bytes */
+	if (offset >= ckpt->offset) {
+		start = ckpt->offset;
+		state = ckpt->state;
+	} else {
+		start = 0;
+		state = ~0;
+	}
+	state = crc32_le(state, image->fw->data + start, offset - start);
+
+	if (~state != le32_to_cpu(request->crc)) {
+		dev_warn(dev, "checkpoint at %u failed CRC, restarting\n",
+			 offset);
+		ckpt->offset = 0;
+		ckpt->state = ~0;
+		ret = -EILSEQ;
+	} else {
+		ckpt->offset = offset;
+		ckpt->state = state;
+	}
+
+unlock:
+	mutex_unlock(&image_cache_lock);
+
+	return ret;
+}
+
 static int gb_firmware_get_firmware(struct gb_operation *op)
 {
 	struct gb_connection *connection = op->connection;
 	struct gb_firmware *firmware = connection->private;
-	const struct firmware *fw = firmware->fw;
+	const struct firmware *fw;
 	struct gb_firmware_get_firmware_request *firmware_request;
 	struct gb_firmware_get_firmware_response *firmware_response;
 	struct device *dev = &connection->bundle->dev;
@@ -146,11 +452,12 @@ static int gb_firmware_get_firmware(struct gb_operation *op)
 		return -EINVAL;
 	}
 
-	if (!fw) {
+	if (!firmware->image) {
 		dev_err(dev, "%s: firmware not available\n", __func__);
 		return -EINVAL;
 	}
 
+	fw = firmware->image->fw;
 	firmware_request = op->request->payload;
 	offset = le32_to_cpu(firmware_request->offset);
 	size = le32_to_cpu(firmware_request->size);
@@ -161,6 +468,10 @@ static int gb_firmware_get_firmware(struct gb_operation *op)
 		return -EINVAL;
 	}
 
+	/* A download starting over invalidates the old checkpoint */
+	if (!offset)
+		firmware_ckpt_clear(firmware);
+
 	if (!gb_operation_response_alloc(op, sizeof(*firmware_response) + size,
 					 GFP_KERNEL)) {
 		dev_err(dev, "%s: error allocating response\n", __func__);
@@ -176,6 +487,7 @@ static int gb_firmware_get_firmware(struct gb_operation *op)
 static int gb_firmware_ready_to_boot(struct gb_operation *op)
 {
 	struct gb_connection *connection = op->connection;
+	struct gb_firmware *firmware = connection->private;
 	struct gb_firmware_ready_to_boot_request *rtb_request;
 	struct device *dev = &connection->bundle->dev;
 	u8 status;
@@ -190,6 +502,10 @@ static int gb_firmware_ready_to_boot(struct gb_operation *op)
 	rtb_request = op->request->payload;
 	status = rtb_request->status;
 
+	/* The download is over either way, don't offer it for resume */
+	if (firmware->image)
+		firmware_ckpt_clear(firmware);
+
 	/* Return error if the blob was invalid */
 	if (status == GB_FIRMWARE_BOOT_STATUS_INVALID)
 		return -EINVAL;
@@ -217,6 +533,10 @@ static int gb_firmware_request_recv(u8 type, struct gb_operation *op)
 		return gb_firmware_get_firmware(op);
 	case GB_FIRMWARE_TYPE_READY_TO_BOOT:
 		return gb_firmware_ready_to_boot(op);
+	case GB_FIRMWARE_TYPE_CHECKPOINT:
+		return gb_firmware_checkpoint(op);
+	case GB_FIRMWARE_TYPE_GET_RESUME:
+		return gb_firmware_get_resume(op);
 	default:
 		dev_err(&op->connection->bundle->dev,
 			"unsupported request: %u\n", type);
@@ -264,8 +584,8 @@ static void gb_firmware_connection_exit(struct gb_connection *connection)
 {
 	struct gb_firmware *firmware = connection->private;
 
-	/* Release firmware */
-	if (firmware->fw)
+	/* Release firmware, it stays cached for a possible resume */
+	if (firmware->image)
 		free_firmware(firmware);
 
 	connection->private = NULL;
@@ -282,4 +602,19 @@ static struct gb_protocol firmware_protocol = {
 	.request_recv		= gb_firmware_request_recv,
 	.flags			= GB_PROTOCOL_SKIP_CONTROL_DISCONNECTED,
 };
-gb_builtin_protocol_driver(firmware_protocol);
+
+int __init gb_firmware_protocol_init(void)
+{
+	return gb_protocol_register(&firmware_protocol);
+}
+
+void gb_firmware_protocol_exit(void)
+{
+	struct gb_firmware_image *image, *tmp;
+
+	gb_protocol_deregister(&firmware_protocol);
+
+	cancel_delayed_work_sync(&image_cache_work);
+	list_for_each_entry_safe(image, tmp, &image_cache, list)
+		image_free(image);
+}
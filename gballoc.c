@@ -0,0 +1,415 @@
+/*
+ * Greybus message buffer allocator
+ *
+ * Copyright (C) 2016 Motorola Mobility, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/debugfs.h>
+#include <linux/gfp.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+
+#include "greybus.h"
+#include "gballoc.h"
+
+/* Slab size classes, from 64 bytes up to PAGE_SIZE */
+#define GB_ALLOC_MIN_SHIFT	6
+#define GB_ALLOC_SLAB_CLASSES	(PAGE_SHIFT - GB_ALLOC_MIN_SHIFT + 1)
+
+/*
+ * Buffers larger than a page come from compound pages of order 1 up to
+ * GB_ALLOC_POOL_MAX_ORDER. Up to GB_ALLOC_POOL_DEPTH freed blocks of each
+ * order are kept around so that back-to-back large messages do not hit
+ * the page allocator.
+ */
+#define GB_ALLOC_POOL_MAX_ORDER	3
+#define GB_ALLOC_POOL_DEPTH	4
+
+/* Anything above the largest pool order is served by vmalloc */
+#define GB_ALLOC_OVERSIZE	(GB_ALLOC_SLAB_CLASSES + GB_ALLOC_POOL_MAX_ORDER)
+#define GB_ALLOC_CLASSES	(GB_ALLOC_OVERSIZE + 1)
+
+struct gb_alloc_stats {
+	atomic64_t allocs;
+	atomic64_t failures;
+	atomic64_t pool_hits;
+	atomic64_t fallbacks;		/* vmalloc used for a pool class */
+	atomic64_t time_ns;		/* total time spent in gballoc() */
+};
+
+struct gb_alloc_pool {
+	spinlock_t lock;
+	struct list_head pages;
+	unsigned int count;
+};
+
+static struct kmem_cache *gb_alloc_caches[GB_ALLOC_SLAB_CLASSES];
+static char gb_alloc_cache_names[GB_ALLOC_SLAB_CLASSES][16];
+static struct gb_alloc_pool gb_alloc_pools[GB_ALLOC_POOL_MAX_ORDER + 1];
+static struct gb_alloc_stats gb_alloc_stats[GB_ALLOC_CLASSES];
+
+static struct dentry *gb_alloc_stats_dentry;
+static struct dentry *gb_alloc_bench_dentry;
+
+static int gb_alloc_class(size_t size)
+{
+	unsigned int order;
+
+	if (size <= PAGE_SIZE) {
+		if (size <= (1 << GB_ALLOC_MIN_SHIFT))
+			return 0;
+		return order_base_2(size) - GB_ALLOC_MIN_SHIFT;
+	}
+
+	order = get_order(size);
+	if (order > GB_ALLOC_POOL_MAX_ORDER)
+		return GB_ALLOC_OVERSIZE;
+
+	return GB_ALLOC_SLAB_CLASSES + order - 1;
+}
+
+static size_t gb_alloc_class_size(int class)
+{
+	if (class < GB_ALLOC_SLAB_CLASSES)
+		return 1 << (class + GB_ALLOC_MIN_SHIFT);
+
+	if (class < GB_ALLOC_OVERSIZE)
+		return PAGE_SIZE << (class - GB_ALLOC_SLAB_CLASSES + 1);
+
+	return 0;
+}
+
+static void *gb_alloc_pages(unsigned int order, size_t size, gfp_t gfp_flags,
+			    struct gb_alloc_stats *stats)
+{
+	struct gb_alloc_pool *pool = &gb_alloc_pools[order];
+	struct page *page = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	if (!list_empty(&pool->pages)) {
+		page = list_first_entry(&pool->pages, struct page, lru);
+		list_del(&page->lru);
+		pool->count--;
+	}
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	if (page) {
+		atomic64_inc(&stats->pool_hits);
+		if (gfp_flags & __GFP_ZERO)
+			memset(page_address(page), 0, size);
+		return page_address(page);
+	}
+
+	/*
+	 * Don't try hard for high-order pages; a fragmented system is
+	 * better served by the vmalloc fallback when the caller can sleep.
+	 */
+	page = alloc_pages((gfp_flags & ~__GFP_HIGHMEM) | __GFP_COMP |
+			   __GFP_NOWARN | __GFP_NORETRY, order);
+
+	return page ? page_address(page) : NULL;
+}
+
+void *gballoc(size_t size, gfp_t gfp_flags)
+{
+	int class = gb_alloc_class(size);
+	struct gb_alloc_stats *stats = &gb_alloc_stats[class];
+	ktime_t start = ktime_get();
+	void *ptr = NULL;
+
+	if (class < GB_ALLOC_SLAB_CLASSES)
+		ptr = kmem_cache_alloc(gb_alloc_caches[class], gfp_flags);
+	else if (class < GB_ALLOC_OVERSIZE)
+		ptr = gb_alloc_pages(class - GB_ALLOC_SLAB_CLASSES + 1, size,
+				     gfp_flags, stats);
+
+	/* vmalloc may sleep, so only fall back to it when the caller can */
+	if (!ptr && class >= GB_ALLOC_SLAB_CLASSES &&
+	    gfpflags_allow_blocking(gfp_flags)) {
+		if (gfp_flags & __GFP_ZERO)
+			ptr = vzalloc(size);
+		else
+			ptr = vmalloc(size);
+		if (ptr && class < GB_ALLOC_OVERSIZE)
+			atomic64_inc(&stats->fallbacks);
+	}
+
+	if (!ptr) {
+		atomic64_inc(&stats->failures);
+		return NULL;
+	}
+
+	atomic64_inc(&stats->allocs);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &stats->time_ns);
+
+	return ptr;
+}
+EXPORT_SYMBOL_GPL(gballoc);
+
+void gbfree(void *ptr)
+{
+	struct gb_alloc_pool *pool;
+	struct page *page;
+	unsigned int order;
+	unsigned long flags;
+
+	if (!ptr)
+		return;
+
+	if (is_vmalloc_addr(ptr)) {
+		vfree(ptr);
+		return;
+	}
+
+	page = virt_to_head_page(ptr);
+	if (PageSlab(page)) {
+		kmem_cache_free(page->slab_cache, ptr);
+		return;
+	}
+
+	order = compound_order(page);
+	if (WARN_ON_ONCE(!order || order > GB_ALLOC_POOL_MAX_ORDER)) {
+		__free_pages(page, order);
+		return;
+	}
+
+	pool = &gb_alloc_pools[order];
+	spin_lock_irqsave(&pool->lock, flags);
+	if (pool->count < GB_ALLOC_POOL_DEPTH) {
+		list_add(&page->lru, &pool->pages);
+		pool->count++;
+		page = NULL;
+	}
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	if (page)
+		__free_pages(page, order);
+}
+EXPORT_SYMBOL_GPL(gbfree);
+
+#define GB_ALLOC_STATS_BUF_SZ	2048
+static ssize_t gb_alloc_stats_read(struct file *f, char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	char *tmp;
+	ssize_t ret;
+	int size = 0;
+	int i;
+
+	tmp = kmalloc(GB_ALLOC_STATS_BUF_SZ, GFP_KERNEL);
+	if (!tmp)
+		return -ENOMEM;
+
+	size += scnprintf(tmp + size, GB_ALLOC_STATS_BUF_SZ - size,
+			  "%-8s %10s %8s %10s %8s %8s\n", "class", "allocs",
+			  "fails", "pool_hits", "vmalloc", "avg_ns");
+
+	for (i = 0; i < GB_ALLOC_CLASSES; i++) {
+		struct gb_alloc_stats *stats = &gb_alloc_stats[i];
+		u64 allocs = atomic64_read(&stats->allocs);
+		u64 avg = allocs ? div64_u64(atomic64_read(&stats->time_ns),
+					     allocs) : 0;
+		char name[12];
+
+		if (i == GB_ALLOC_OVERSIZE)
+			snprintf(name, sizeof(name), ">%zu",
+				 gb_alloc_class_size(i - 1));
+		else
+			snprintf(name, sizeof(name), "%zu",
+				 gb_alloc_class_size(i));
+
+		size += scnprintf(tmp + size, GB_ALLOC_STATS_BUF_SZ - size,
+				  "%-8s %10llu %8llu %10llu %8llu %8llu\n",
+				  name, allocs,
+				  (u64)atomic64_read(&stats->failures),
+				  (u64)atomic64_read(&stats->pool_hits),
+				  (u64)atomic64_read(&stats->fallbacks), avg);
+	}
+
+	for (i = 1; i <= GB_ALLOC_POOL_MAX_ORDER; i++)
+		size += scnprintf(tmp + size, GB_ALLOC_STATS_BUF_SZ - size,
+				  "pool order %d: %u/%u\n", i,
+				  gb_alloc_pools[i].count, GB_ALLOC_POOL_DEPTH);
+
+	ret = simple_read_from_buffer(buf, count, ppos, tmp, size);
+	kfree(tmp);
+
+	return ret;
+}
+
+static const struct file_operations gb_alloc_stats_fops = {
+	.read	= gb_alloc_stats_read,
+};
+
+/*
+ * Microbenchmark: writing an iteration count to gballoc_bench times
+ * gballoc()/gbfree() against the previous kzalloc()/vzalloc() scheme for
+ * typical message sizes. Reading the file returns the last results.
+ */
+static const size_t gb_alloc_bench_sizes[] = {
+	64, 256, 1024, 2048, 4096, 8192, 16384, 65536,
+};
+
+static DEFINE_MUTEX(gb_alloc_bench_mutex);
+static char gb_alloc_bench_result[GB_ALLOC_STATS_BUF_SZ];
+static int gb_alloc_bench_len;
+
+static u64 gb_alloc_bench_one(size_t size, unsigned int iters, bool legacy)
+{
+	ktime_t start = ktime_get();
+	unsigned int i;
+	void *ptr;
+
+	for (i = 0; i < iters; i++) {
+		if (legacy) {
+			ptr = size <= PAGE_SIZE ? kzalloc(size, GFP_KERNEL) :
+						  vzalloc(size);
+			kvfree(ptr);
+		} else {
+			ptr = gballoc(size, GFP_KERNEL);
+			gbfree(ptr);
+		}
+		cond_resched();
+	}
+
+	return div64_u64(ktime_to_ns(ktime_sub(ktime_get(), start)), iters);
+}
+
+static ssize_t gb_alloc_bench_write(struct file *f, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	unsigned int iters;
+	int size = 0;
+	int ret;
+	int i;
+
+	ret = kstrtouint_from_user(buf, count, 0, &iters);
+	if (ret)
+		return ret;
+
+	if (!iters || iters > 1000000)
+		return -EINVAL;
+
+	mutex_lock(&gb_alloc_bench_mutex);
+
+	size += scnprintf(gb_alloc_bench_result, GB_ALLOC_STATS_BUF_SZ,
+			  "%-8s %10s %10s\n", "size", "gballoc", "legacy");
+
+	for (i = 0; i < ARRAY_SIZE(gb_alloc_bench_sizes); i++) {
+		size_t sz = gb_alloc_bench_sizes[i];
+
+		size += scnprintf(gb_alloc_bench_result + size,
+				  GB_ALLOC_STATS_BUF_SZ - size,
+				  "%-8zu %10llu %10llu\n", sz,
+				  gb_alloc_bench_one(sz, iters, false),
+				  gb_alloc_bench_one(sz, iters, true));
+	}
+	gb_alloc_bench_len = size;
+
+	mutex_unlock(&gb_alloc_bench_mutex);
+
+	return count;
+}
+
+static ssize_t gb_alloc_bench_read(struct file *f, char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	ssize_t ret;
+
+	mutex_lock(&gb_alloc_bench_mutex);
+	ret = simple_read_from_buffer(buf, count, ppos, gb_alloc_bench_result,
+				      gb_alloc_bench_len);
+	mutex_unlock(&gb_alloc_bench_mutex);
+
+	return ret;
+}
+
+static const struct file_operations gb_alloc_bench_fops = {
+	.read	= gb_alloc_bench_read,
+	.write	= gb_alloc_bench_write,
+};
+
+static void gb_alloc_pools_drain(void)
+{
+	struct page *page, *next;
+	int order;
+
+	for (order = 1; order <= GB_ALLOC_POOL_MAX_ORDER; order++) {
+		struct gb_alloc_pool *pool = &gb_alloc_pools[order];
+
+		list_for_each_entry_safe(page, next, &pool->pages, lru) {
+			list_del(&page->lru);
+			__free_pages(page, order);
+		}
+		pool->count = 0;
+	}
+}
+
+int gb_alloc_init(void)
+{
+	int i;
+
+	for (i = 0; i < GB_ALLOC_SLAB_CLASSES; i++) {
+		snprintf(gb_alloc_cache_names[i],
+			 sizeof(gb_alloc_cache_names[i]), "gb_buf_%zu",
+			 gb_alloc_class_size(i));
+		gb_alloc_caches[i] = kmem_cache_create(gb_alloc_cache_names[i],
+						gb_alloc_class_size(i), 0,
+						SLAB_HWCACHE_ALIGN, NULL);
+		if (!gb_alloc_caches[i])
+			goto err_destroy_caches;
+	}
+
+	for (i = 1; i <= GB_ALLOC_POOL_MAX_ORDER; i++) {
+		spin_lock_init(&gb_alloc_pools[i].lock);
+		INIT_LIST_HEAD(&gb_alloc_pools[i].pages);
+	}
+
+	gb_alloc_stats_dentry = debugfs_create_file("gballoc", S_IRUGO,
+					gb_debugfs_get(), NULL,
+					&gb_alloc_stats_fops);
+	gb_alloc_bench_dentry = debugfs_create_file("gballoc_bench",
+					S_IRUGO | S_IWUSR, gb_debugfs_get(),
+					NULL, &gb_alloc_bench_fops);
+
+	return 0;
+
+err_destroy_caches:
+	while (--i >= 0)
+		kmem_cache_destroy(gb_alloc_caches[i]);
+
+	return -ENOMEM;
+}
+
+void gb_alloc_exit(void)
+{
+	int i;
+
+	debugfs_remove(gb_alloc_bench_dentry);
+	debugfs_remove(gb_alloc_stats_dentry);
+
+	gb_alloc_pools_drain();
+
+	for (i = 0; i < GB_ALLOC_SLAB_CLASSES; i++)
+		kmem_cache_destroy(gb_alloc_caches[i]);
+}
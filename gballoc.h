@@ -15,36 +15,24 @@
 #ifndef __GBALLOC_H
 #define __GBALLOC_H
 
-#include <linux/mm.h>
-#include <linux/slab.h>
 #include <linux/types.h>
-#include <linux/vmalloc.h>
 
 /**
- * gballoc() - Use either kzalloc or vzalloc to allocate memory
+ * gballoc() - Allocate a greybus message buffer
  *
- * Allocate a block of memory - if it is small try to allocate it
- * from kmalloc (fast!) otherwise we need to go with vmalloc (safe!)
+ * Small buffers come from per size-class slab caches and larger ones from
+ * a pool of physically contiguous pages, so gfp_flags are honoured for
+ * every size (GFP_ATOMIC never ends up in vmalloc). Memory is only zeroed
+ * when __GFP_ZERO is passed.
  */
-static inline void *gballoc(size_t size, gfp_t gfp_flags)
-{
-	if (size <= PAGE_SIZE)
-		return kzalloc(size, gfp_flags);
-
-	return vzalloc(size);
-}
+void *gballoc(size_t size, gfp_t gfp_flags);
 
 /**
  * gbfree() - Free memory allocated by gballoc()
- *
- * Free the memory be it in vmalloc or kmalloc space
  */
-static inline void gbfree(void *ptr)
-{
-	if (ptr != NULL && is_vmalloc_addr(ptr))
-		return vfree(ptr);
+void gbfree(void *ptr);
 
-	kfree(ptr);
-}
+int gb_alloc_init(void);
+void gb_alloc_exit(void);
 
 #endif /* __GBALLOC_H */
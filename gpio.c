@@ -10,10 +10,14 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/debugfs.h>
 #include <linux/gpio.h>
 #include <linux/irq.h>
 #include <linux/irqdomain.h>
 #include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
 
 #include "greybus.h"
 
@@ -27,8 +31,16 @@ struct gb_gpio_line {
 
 	u8			irq_type;
 	bool			irq_type_pending;
-	bool			masked;
-	bool			masked_pending;
+	bool			masked;		/* as the IRQ core wants it */
+	bool			hw_masked;	/* as last sent to the module */
+	bool			mask_pending;	/* event arrived while masked */
+};
+
+struct gb_gpio_irq_stats {
+	u32			events;
+	u32			ops;		/* mask/unmask/type round trips */
+	u64			latency_us;	/* receipt to handler, summed */
+	u32			latency_max_us;
 };
 
 struct gb_gpio_controller {
@@ -44,6 +56,12 @@ struct gb_gpio_controller {
 	irq_flow_handler_t	irq_handler;
 	unsigned int		irq_default_type;
 	struct mutex		irq_lock;
+	struct work_struct	irq_work;
+	spinlock_t		line_lock;	/* masked, hw_masked, mask_pending */
+
+	spinlock_t		stats_lock;
+	struct gb_gpio_irq_stats stats;
+	struct dentry		*stats_dentry;
 };
 #define gpio_chip_to_gb_gpio_controller(chip) \
 	container_of(chip, struct gb_gpio_controller, chip)
@@ -240,6 +258,18 @@ static void _gb_gpio_irq_unmask(struct gb_gpio_controller *ggc, u8 hwirq)
 		dev_err(ggc->chip.dev, "failed to unmask irq: %d\n", ret);
 }
 
+static void _gb_gpio_irq_mask_set(struct gb_gpio_controller *ggc,
+				  struct gb_gpio_irq_mask_set_request *request)
+{
+	int ret;
+
+	ret = gb_operation_sync(ggc->connection,
+				GB_GPIO_TYPE_IRQ_MASK_SET,
+				request, sizeof(*request), NULL, 0);
+	if (ret)
+		dev_err(ggc->chip.dev, "failed to set irq masks: %d\n", ret);
+}
+
 static void _gb_gpio_irq_set_type(struct gb_gpio_controller *ggc,
 					u8 hwirq, u8 type)
 {
@@ -256,14 +286,22 @@ static void _gb_gpio_irq_set_type(struct gb_gpio_controller *ggc,
 		dev_err(ggc->chip.dev, "failed to set irq type: %d\n", ret);
 }
 
+/*
+ * Masking is lazy: the module is only told once an event shows up for a
+ * line that is masked, so the mask/unmask pair around each handler run
+ * costs no round trips. Events on masked lines still reach the IRQ core,
+ * which marks them pending just as it would for a lazily disabled IRQ.
+ */
 static void gb_gpio_irq_mask(struct irq_data *d)
 {
 	struct gpio_chip *chip = irq_data_to_gpio_chip(d);
 	struct gb_gpio_controller *ggc = gpio_chip_to_gb_gpio_controller(chip);
 	struct gb_gpio_line *line = &ggc->lines[d->hwirq];
+	unsigned long flags;
 
+	spin_lock_irqsave(&ggc->line_lock, flags);
 	line->masked = true;
-	line->masked_pending = true;
+	spin_unlock_irqrestore(&ggc->line_lock, flags);
 }
 
 static void gb_gpio_irq_unmask(struct irq_data *d)
@@ -271,9 +309,11 @@ static void gb_gpio_irq_unmask(struct irq_data *d)
 	struct gpio_chip *chip = irq_data_to_gpio_chip(d);
 	struct gb_gpio_controller *ggc = gpio_chip_to_gb_gpio_controller(chip);
 	struct gb_gpio_line *line = &ggc->lines[d->hwirq];
+	unsigned long flags;
 
+	spin_lock_irqsave(&ggc->line_lock, flags);
 	line->masked = false;
-	line->masked_pending = true;
+	spin_unlock_irqrestore(&ggc->line_lock, flags);
 }
 
 static int gb_gpio_irq_set_type(struct irq_data *d, unsigned int type)
@@ -321,25 +361,103 @@ static void gb_gpio_irq_bus_lock(struct irq_data *d)
 	mutex_lock(&ggc->irq_lock);
 }
 
-static void gb_gpio_irq_bus_sync_unlock(struct irq_data *d)
+/* Bring the module in line with the IRQ core, irq_lock must be held */
+static void gb_gpio_irq_sync(struct gb_gpio_controller *ggc)
 {
-	struct gpio_chip *chip = irq_data_to_gpio_chip(d);
-	struct gb_gpio_controller *ggc = gpio_chip_to_gb_gpio_controller(chip);
-	struct gb_gpio_line *line = &ggc->lines[d->hwirq];
+	struct gb_gpio_irq_mask_set_request request;
+	struct gb_gpio_line *line;
+	unsigned int ops = 0;
+	unsigned int count = 0;
+	unsigned int last = 0;
+	unsigned int i;
+
+	memset(&request, 0, sizeof(request));
 
-	if (line->irq_type_pending) {
-		_gb_gpio_irq_set_type(ggc, d->hwirq, line->irq_type);
-		line->irq_type_pending = false;
+	for (i = 0; i <= ggc->line_max; i++) {
+		line = &ggc->lines[i];
+
+		if (line->irq_type_pending) {
+			_gb_gpio_irq_set_type(ggc, i, line->irq_type);
+			line->irq_type_pending = false;
+			ops++;
+		}
 	}
 
-	if (line->masked_pending) {
+	/* Events may mark lines pending meanwhile, they reschedule us */
+	spin_lock_irq(&ggc->line_lock);
+	for (i = 0; i <= ggc->line_max; i++) {
+		line = &ggc->lines[i];
+
+		if (line->masked == line->hw_masked) {
+			line->mask_pending = false;
+			continue;
+		}
+
+		if (line->masked && !line->mask_pending)
+			continue;
+
 		if (line->masked)
-			_gb_gpio_irq_mask(ggc, d->hwirq);
+			request.mask[i / 8] |= BIT(i % 8);
 		else
-			_gb_gpio_irq_unmask(ggc, d->hwirq);
-		line->masked_pending = false;
+			request.unmask[i / 8] |= BIT(i % 8);
+		count++;
+		last = i;
+	}
+	spin_unlock_irq(&ggc->line_lock);
+
+	if (count > 1 &&
+	    ggc->connection->module_minor >= GB_GPIO_VER_IRQ_MASK_SET) {
+		_gb_gpio_irq_mask_set(ggc, &request);
+		ops++;
+	} else {
+		for (i = 0; count && i <= last; i++) {
+			if (request.mask[i / 8] & BIT(i % 8))
+				_gb_gpio_irq_mask(ggc, i);
+			else if (request.unmask[i / 8] & BIT(i % 8))
+				_gb_gpio_irq_unmask(ggc, i);
+			else
+				continue;
+			ops++;
+		}
 	}
 
+	/* Record what was sent, the IRQ core may have moved on since */
+	spin_lock_irq(&ggc->line_lock);
+	for (i = 0; count && i <= last; i++) {
+		line = &ggc->lines[i];
+		if (request.mask[i / 8] & BIT(i % 8)) {
+			line->hw_masked = true;
+			line->mask_pending = false;
+		} else if (request.unmask[i / 8] & BIT(i % 8)) {
+			line->hw_masked = false;
+		}
+	}
+	spin_unlock_irq(&ggc->line_lock);
+
+	if (ops) {
+		spin_lock_irq(&ggc->stats_lock);
+		ggc->stats.ops += ops;
+		spin_unlock_irq(&ggc->stats_lock);
+	}
+}
+
+static void gb_gpio_irq_work(struct work_struct *work)
+{
+	struct gb_gpio_controller *ggc =
+		container_of(work, struct gb_gpio_controller, irq_work);
+
+	mutex_lock(&ggc->irq_lock);
+	gb_gpio_irq_sync(ggc);
+	mutex_unlock(&ggc->irq_lock);
+}
+
+static void gb_gpio_irq_bus_sync_unlock(struct irq_data *d)
+{
+	struct gpio_chip *chip = irq_data_to_gpio_chip(d);
+	struct gb_gpio_controller *ggc = gpio_chip_to_gb_gpio_controller(chip);
+
+	gb_gpio_irq_sync(ggc);
+
 	mutex_unlock(&ggc->irq_lock);
 }
 
@@ -349,8 +467,11 @@ static int gb_gpio_request_recv(u8 type, struct gb_operation *op)
 	struct gb_gpio_controller *ggc = connection->private;
 	struct gb_message *request;
 	struct gb_gpio_irq_event_request *event;
+	struct gb_gpio_line *line;
 	int irq;
 	struct irq_desc *desc;
+	unsigned long flags;
+	u32 latency;
 
 	if (type != GB_GPIO_TYPE_IRQ_EVENT) {
 		dev_err(&connection->bundle->dev,
@@ -383,17 +504,66 @@ static int gb_gpio_request_recv(u8 type, struct gb_operation *op)
 		return -EINVAL;
 	}
 
-	local_irq_disable();
+	/* The module only learns about a mask once it is needed */
+	line = &ggc->lines[event->which];
+	spin_lock_irqsave(&ggc->line_lock, flags);
+	if (line->masked && !line->hw_masked && !line->mask_pending) {
+		line->mask_pending = true;
+		schedule_work(&ggc->irq_work);
+	}
+	spin_unlock_irqrestore(&ggc->line_lock, flags);
+
+	/* may already run with interrupts off, see ATOMIC_REQUEST_RECV */
+	local_irq_save(flags);
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 3, 0)
 	generic_handle_irq_desc(irq, desc);
 #else
 	generic_handle_irq_desc(desc);
 #endif
-	local_irq_enable();
+	latency = (u32)ktime_us_delta(ktime_get(), op->recv_time);
+
+	spin_lock(&ggc->stats_lock);
+	ggc->stats.events++;
+	ggc->stats.latency_us += latency;
+	ggc->stats.latency_max_us = max(ggc->stats.latency_max_us, latency);
+	spin_unlock(&ggc->stats_lock);
+	local_irq_restore(flags);
 
 	return 0;
 }
 
+static int gb_gpio_irq_stats_show(struct seq_file *s, void *unused)
+{
+	struct gb_gpio_controller *ggc = s->private;
+	struct gb_gpio_irq_stats stats;
+
+	spin_lock_irq(&ggc->stats_lock);
+	stats = ggc->stats;
+	spin_unlock_irq(&ggc->stats_lock);
+
+	seq_printf(s, "events: %u\n", stats.events);
+	seq_printf(s, "ops: %u\n", stats.ops);
+	seq_printf(s, "ops_per_100_events: %u\n", stats.events ?
+		   (u32)div_u64((u64)stats.ops * 100, stats.events) : 0);
+	seq_printf(s, "latency_avg_us: %u\n", stats.events ?
+		   (u32)div_u64(stats.latency_us, stats.events) : 0);
+	seq_printf(s, "latency_max_us: %u\n", stats.latency_max_us);
+
+	return 0;
+}
+
+static int gb_gpio_irq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, gb_gpio_irq_stats_show, inode->i_private);
+}
+
+static const struct file_operations gb_gpio_irq_stats_ops = {
+	.open		= gb_gpio_irq_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int gb_gpio_request(struct gpio_chip *chip, unsigned offset)
 {
 	struct gb_gpio_controller *ggc = gpio_chip_to_gb_gpio_controller(chip);
@@ -473,6 +643,7 @@ static int gb_gpio_set_debounce(struct gpio_chip *chip, unsigned offset,
 
 static int gb_gpio_controller_setup(struct gb_gpio_controller *ggc)
 {
+	unsigned int i;
 	int ret;
 
 	/* Now find out how many lines there are */
@@ -485,6 +656,12 @@ static int gb_gpio_controller_setup(struct gb_gpio_controller *ggc)
 	if (!ggc->lines)
 		return -ENOMEM;
 
+	/* Module IRQs start out masked, the first unmask goes out */
+	for (i = 0; i <= ggc->line_max; i++) {
+		ggc->lines[i].masked = true;
+		ggc->lines[i].hw_masked = true;
+	}
+
 	return ret;
 }
 
@@ -623,6 +800,7 @@ static int gb_gpio_connection_init(struct gb_connection *connection)
 	struct gb_gpio_controller *ggc;
 	struct gpio_chip *gpio;
 	struct irq_chip *irqc;
+	char *name;
 	int ret;
 
 	ggc = kzalloc(sizeof(*ggc), GFP_KERNEL);
@@ -644,6 +822,9 @@ static int gb_gpio_connection_init(struct gb_connection *connection)
 	irqc->name = "greybus_gpio";
 
 	mutex_init(&ggc->irq_lock);
+	spin_lock_init(&ggc->line_lock);
+	INIT_WORK(&ggc->irq_work, gb_gpio_irq_work);
+	spin_lock_init(&ggc->stats_lock);
 
 	gpio = &ggc->chip;
 
@@ -679,6 +860,15 @@ static int gb_gpio_connection_init(struct gb_connection *connection)
 		goto irqchip_err;
 	}
 
+	name = kasprintf(GFP_KERNEL, "gpio_irq-%s",
+			 dev_name(&connection->bundle->dev));
+	if (name) {
+		ggc->stats_dentry = debugfs_create_file(name, S_IRUGO,
+							gb_debugfs_get(), ggc,
+							&gb_gpio_irq_stats_ops);
+		kfree(name);
+	}
+
 	return 0;
 
 irqchip_err:
@@ -697,7 +887,9 @@ static void gb_gpio_connection_exit(struct gb_connection *connection)
 	if (!ggc)
 		return;
 
+	debugfs_remove(ggc->stats_dentry);
 	gb_gpio_irqchip_remove(ggc);
+	cancel_work_sync(&ggc->irq_work);
 	gb_gpiochip_remove(&ggc->chip);
 	/* kref_put(ggc->connection) */
 	kfree(ggc->lines);
@@ -712,6 +904,7 @@ static struct gb_protocol gpio_protocol = {
 	.connection_init	= gb_gpio_connection_init,
 	.connection_exit	= gb_gpio_connection_exit,
 	.request_recv		= gb_gpio_request_recv,
+	.flags			= GB_PROTOCOL_ATOMIC_REQUEST_RECV,
 };
 
 gb_builtin_protocol_driver(gpio_protocol);
@@ -151,7 +151,7 @@ struct gb_control_disconnected_request {
 
 /* Version of the Greybus firmware protocol we support */
 #define GB_FIRMWARE_VERSION_MAJOR		0x00
-#define GB_FIRMWARE_VERSION_MINOR		0x01
+#define GB_FIRMWARE_VERSION_MINOR		0x02
 
 /* Greybus firmware request types */
 #define GB_FIRMWARE_TYPE_FIRMWARE_SIZE		0x02
@@ -159,6 +159,8 @@ struct gb_control_disconnected_request {
 #define GB_FIRMWARE_TYPE_READY_TO_BOOT		0x04
 #define GB_FIRMWARE_TYPE_AP_READY		0x05	/* Request with no-payload */
 #define GB_FIRMWARE_TYPE_GET_VID_PID		0x06	/* Request with no-payload */
+#define GB_FIRMWARE_TYPE_CHECKPOINT		0x07	/* Since 0.2 */
+#define GB_FIRMWARE_TYPE_GET_RESUME		0x08	/* Since 0.2 */
 
 /* Greybus firmware boot stages */
 #define GB_FIRMWARE_BOOT_STAGE_ONE		0x01 /* Reserved for the boot ROM */
@@ -198,6 +200,32 @@ struct gb_firmware_ready_to_boot_request {
 } __packed;
 /* Firmware protocol Ready to boot response has no payload */
 
+/*
+ * Firmware protocol checkpoint request, sent by the module once the image
+ * up to offset is verified and stored. crc is the CRC-32 (as in
+ * crc32_le(~0, ...) ^ ~0) of those bytes.
+ */
+struct gb_firmware_checkpoint_request {
+	__le32			offset;
+	__le32			crc;
+} __packed;
+/* Firmware protocol checkpoint response has no payload */
+
+/*
+ * Firmware protocol get resume request/response. Like FIRMWARE_SIZE, but
+ * also returns the last checkpoint the AP holds for the image so a module
+ * that reattached mid-download can continue from there.
+ */
+struct gb_firmware_get_resume_request {
+	__u8			stage;
+} __packed;
+
+struct gb_firmware_get_resume_response {
+	__le32			size;
+	__le32			offset;
+	__le32			crc;
+} __packed;
+
 /* Firmware protocol get VID/PID request has no payload */
 struct gb_firmware_get_vid_pid_response {
 	__le32			vendor_id;
@@ -481,13 +509,18 @@ struct gb_hid_input_report_request {
 
 /* Version of the Greybus i2c protocol we support */
 #define GB_I2C_VERSION_MAJOR		0x00
-#define GB_I2C_VERSION_MINOR		0x01
+#define GB_I2C_VERSION_MINOR		0x02
+
+/* Minimum module minor version supporting CONFIG and TRANSFER_CONFIG */
+#define GB_I2C_VER_CONFIG		0x02
 
 /* Greybus i2c request types */
 #define GB_I2C_TYPE_FUNCTIONALITY	0x02
 #define GB_I2C_TYPE_TIMEOUT		0x03
 #define GB_I2C_TYPE_RETRIES		0x04
 #define GB_I2C_TYPE_TRANSFER		0x05
+#define GB_I2C_TYPE_CONFIG		0x06
+#define GB_I2C_TYPE_TRANSFER_CONFIG	0x07
 
 #define GB_I2C_RETRIES_DEFAULT		3
 #define GB_I2C_TIMEOUT_DEFAULT		1000	/* milliseconds */
@@ -531,12 +564,38 @@ struct gb_i2c_transfer_response {
 	__u8				data[0];	/* inbound data */
 } __packed;
 
+/* Sets the default timeout and retries, returns the functionality */
+struct gb_i2c_config_request {
+	__le16	timeout_msec;
+	__u8	retries;
+	__u8	pad;
+} __packed;
+
+struct gb_i2c_config_response {
+	__le32	functionality;
+} __packed;
+
+/*
+ * A transfer that brings its own timeout and retries, they apply to this
+ * transfer only. Otherwise laid out as, and answered like, TRANSFER.
+ */
+struct gb_i2c_transfer_config_request {
+	__le16				timeout_msec;
+	__u8				retries;
+	__u8				pad;
+	__le16				op_count;
+	struct gb_i2c_transfer_op	ops[0];		/* op_count of these */
+} __packed;
+
 
 /* GPIO */
 
 /* Version of the Greybus GPIO protocol we support */
 #define GB_GPIO_VERSION_MAJOR		0x00
-#define GB_GPIO_VERSION_MINOR		0x01
+#define GB_GPIO_VERSION_MINOR		0x02
+
+/* Minimum module minor version supporting IRQ_MASK_SET */
+#define GB_GPIO_VER_IRQ_MASK_SET	0x02
 
 /* Greybus GPIO request types */
 #define GB_GPIO_TYPE_LINE_COUNT		0x02
@@ -552,6 +611,7 @@ struct gb_i2c_transfer_response {
 #define GB_GPIO_TYPE_IRQ_MASK		0x0c
 #define GB_GPIO_TYPE_IRQ_UNMASK		0x0d
 #define GB_GPIO_TYPE_IRQ_EVENT		0x0e
+#define GB_GPIO_TYPE_IRQ_MASK_SET	0x0f
 
 #define GB_GPIO_IRQ_TYPE_NONE		0x00
 #define GB_GPIO_IRQ_TYPE_EDGE_RISING	0x01
@@ -628,6 +688,15 @@ struct gb_gpio_irq_unmask_request {
 } __packed;
 /* irq unmask response has no payload */
 
+/* Bit n of each bitmap is line n, lines in neither keep their state */
+#define GB_GPIO_IRQ_BITMAP_SIZE		32
+
+struct gb_gpio_irq_mask_set_request {
+	__u8	mask[GB_GPIO_IRQ_BITMAP_SIZE];
+	__u8	unmask[GB_GPIO_IRQ_BITMAP_SIZE];
+} __packed;
+/* irq mask set response has no payload */
+
 /* irq event requests originate on another module and are handled on the AP */
 struct gb_gpio_irq_event_request {
 	__u8	which;
@@ -1060,7 +1129,10 @@ struct gb_audio_get_mic_params_response {
 
 /* Version of the Greybus spi protocol we support */
 #define GB_SPI_VERSION_MAJOR		0x00
-#define GB_SPI_VERSION_MINOR		0x01
+#define GB_SPI_VERSION_MINOR		0x02
+
+/* Minimum module minor version supporting DEVICE_TABLE */
+#define GB_SPI_VER_DEVICE_TABLE		0x02
 
 /* Should match up with modes in linux/spi/spi.h */
 #define GB_SPI_MODE_CPHA		0x01		/* clock phase */
@@ -1085,6 +1157,7 @@ struct gb_audio_get_mic_params_response {
 #define GB_SPI_TYPE_MASTER_CONFIG	0x02
 #define GB_SPI_TYPE_DEVICE_CONFIG	0x03
 #define GB_SPI_TYPE_TRANSFER		0x04
+#define GB_SPI_TYPE_DEVICE_TABLE	0x05	/* added in ver 00.02 */
 
 /* mode request has no payload */
 struct gb_spi_master_config_response {
@@ -1107,6 +1180,22 @@ struct gb_spi_device_config_response {
 	__u8	name[32];
 } __packed;
 
+/*
+ * Paged device table: the module returns the configuration of up to
+ * max_count consecutive chip selects starting at start_cs, each entry the
+ * same as the DEVICE_CONFIG response.
+ */
+struct gb_spi_device_table_request {
+	__u8	start_cs;
+	__u8	max_count;
+} __packed;
+
+struct gb_spi_device_table_response {
+	__u8					count;
+	__u8					reserved[3];
+	struct gb_spi_device_config_response	devices[0];
+} __packed;
+
 /**
  * struct gb_spi_transfer - a read/write buffer pair
  * @speed_hz: Select a speed other than the device default for this transfer. If
@@ -1143,7 +1232,10 @@ struct gb_spi_transfer_response {
 
 /* Version of the Greybus SVC protocol we support */
 #define GB_SVC_VERSION_MAJOR		0x00
-#define GB_SVC_VERSION_MINOR		0x01
+#define GB_SVC_VERSION_MINOR		0x02
+
+/* Minimum SVC protocol minor version for each feature */
+#define GB_SVC_VER_DME_PEER_BATCH	0x02
 
 /* Greybus SVC request types */
 #define GB_SVC_TYPE_SVC_HELLO		0x02
@@ -1157,6 +1249,7 @@ struct gb_spi_transfer_response {
 #define GB_SVC_TYPE_DME_PEER_SET	0x0a
 #define GB_SVC_TYPE_ROUTE_CREATE	0x0b
 #define GB_SVC_TYPE_ROUTE_DESTROY	0x0c
+#define GB_SVC_TYPE_DME_PEER_BATCH	0x0d
 
 /*
  * SVC version request/response has the same payload as
@@ -1238,6 +1331,38 @@ struct gb_svc_dme_peer_set_response {
 	__le16	result_code;
 } __packed;
 
+/* DME peer batch: several attribute gets/sets in one operation */
+#define GB_SVC_DME_BATCH_OP_GET		0x00
+#define GB_SVC_DME_BATCH_OP_SET		0x01
+
+struct gb_svc_dme_batch_attr {
+	__le16	attr;
+	__le16	selector;
+	__u8	op;		/* GB_SVC_DME_BATCH_OP_* */
+	__u8	pad;
+	__le32	value;		/* ignored for gets */
+} __packed;
+
+struct gb_svc_dme_peer_batch_request {
+	__u8	intf_id;
+	__u8	count;
+	__le16	tag;
+	struct gb_svc_dme_batch_attr	attrs[0];
+} __packed;
+
+struct gb_svc_dme_batch_result {
+	__le16	result_code;
+	__le16	pad;
+	__le32	attr_value;	/* valid for successful gets */
+} __packed;
+
+struct gb_svc_dme_peer_batch_response {
+	__le16	tag;
+	__u8	count;
+	__u8	pad;
+	struct gb_svc_dme_batch_result	results[0];
+} __packed;
+
 /* Attributes for peer get/set operations */
 #define DME_ATTR_SELECTOR_INDEX		0
 #define DME_ATTR_T_TST_SRC_INCREMENT	0x4083
@@ -1606,7 +1731,10 @@ struct gb_camera_metadata_request {
 /* Lights */
 
 #define GB_LIGHTS_VERSION_MAJOR 0x00
-#define GB_LIGHTS_VERSION_MINOR 0x01
+#define GB_LIGHTS_VERSION_MINOR 0x02
+
+/* Minimum module minor version supporting GET_ALL_CONFIG */
+#define GB_LIGHTS_VER_GET_ALL_CONFIG	0x02
 
 /* Greybus Lights request types */
 #define GB_LIGHTS_TYPE_GET_LIGHTS		0x02
@@ -1622,6 +1750,7 @@ struct gb_camera_metadata_request {
 #define GB_LIGHTS_TYPE_SET_FLASH_STROBE		0x0C
 #define GB_LIGHTS_TYPE_SET_FLASH_TIMEOUT	0x0D
 #define GB_LIGHTS_TYPE_GET_FLASH_FAULT		0x0E
+#define GB_LIGHTS_TYPE_GET_ALL_CONFIG		0x0F /* added in ver 00.02 */
 
 /* Greybus Light modes */
 
@@ -1699,6 +1828,33 @@ struct gb_lights_get_channel_flash_config_response {
 	__le32	timeout_step_us;
 } __packed;
 
+/*
+ * Paged light/channel configuration: the module returns up to max_count
+ * channel descriptors, walking lights and their channels in order starting
+ * at light_id:channel_id. The flash part is only valid on flash, torch and
+ * indicator channels.
+ */
+struct gb_lights_get_all_config_request {
+	__u8	light_id;
+	__u8	channel_id;
+	__u8	max_count;
+} __packed;
+
+struct gb_lights_channel_desc {
+	__u8	light_id;
+	__u8	channel_id;
+	__u8	channel_count;
+	__u8	light_name[32];
+	struct gb_lights_get_channel_config_response		config;
+	struct gb_lights_get_channel_flash_config_response	flash;
+} __packed;
+
+struct gb_lights_get_all_config_response {
+	__u8				count;
+	__u8				reserved[3];
+	struct gb_lights_channel_desc	desc[0];
+} __packed;
+
 /* blink request payload: response have no payload */
 struct gb_lights_blink_request {
 	__u8	light_id;
@@ -1893,7 +2049,10 @@ struct gb_usb_ext_attach_request {
 
 /* Version of the Greybus protocol we support */
 #define	GB_SENSORS_EXT_VERSION_MAJOR		0x00
-#define	GB_SENSORS_EXT_VERSION_MINOR		0x02
+#define	GB_SENSORS_EXT_VERSION_MINOR		0x03
+
+/* Minimum module minor version supporting SENSOR_INFO_ALL */
+#define	GB_SENSORS_EXT_VER_SENSOR_INFO_ALL	0x03
 
 /* Greybus Motorola vendor specific request types */
 #define GB_SENSORS_EXT_TYPE_SENSOR_COUNT	0x02
@@ -1902,6 +2061,7 @@ struct gb_usb_ext_attach_request {
 #define GB_SENSORS_EXT_TYPE_FLUSH		0x05
 #define GB_SENSORS_EXT_TYPE_STOP_REPORTING	0x06
 #define GB_SENSORS_EXT_TYPE_EVENT		0x07
+#define GB_SENSORS_EXT_TYPE_SENSOR_INFO_ALL	0x08
 
 /* get count of sensors in module */
 struct gb_sensors_get_sensor_count_response {
@@ -1913,6 +2073,22 @@ struct gb_sensors_ext_sensor_info_request {
 } __packed;
 /* sensor info response structure is gb_sensor */
 
+/*
+ * Paged sensor info: the module returns up to max_count consecutive sensor
+ * descriptors starting at start_id. Each entry is a gb_sensor truncated at
+ * END_OF_GB_STRUCT, the same layout as the SENSOR_INFO response.
+ */
+struct gb_sensors_ext_sensor_info_all_request {
+	__u8	start_id;
+	__u8	max_count;
+} __packed;
+
+struct gb_sensors_ext_sensor_info_all_response {
+	__u8	count;
+	__u8	reserved[3];
+	__u8	data[];
+} __packed;
+
 /* this request has no response payload */
 struct gb_sensors_ext_start_reporting_request {
 	__u8	sensor_id;
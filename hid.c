@@ -489,6 +489,7 @@ static struct gb_protocol hid_protocol = {
 	.connection_init	= gb_hid_connection_init,
 	.connection_exit	= gb_hid_connection_exit,
 	.request_recv		= gb_hid_irq_handler,
+	.flags			= GB_PROTOCOL_ATOMIC_REQUEST_RECV,
 };
 
 gb_protocol_driver(&hid_protocol);
@@ -9,6 +9,7 @@
 
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/i2c.h>
 
@@ -18,12 +19,113 @@ struct gb_i2c_device {
 	struct gb_connection	*connection;
 
 	u32			functionality;
-	u16			timeout_msec;
+	u16			timeout_msec;	/* as last sent to the module */
 	u8			retries;
+	bool			xfer_config;	/* transfers carry both */
 
 	struct i2c_adapter	adapter;
 };
 
+/*
+ * Functionality of the adapters seen so far, so a module that is detached
+ * and attached again need not be asked for it twice.
+ */
+struct gb_i2c_cache_entry {
+	struct list_head	list;
+	u32			vendor_id;
+	u32			product_id;
+	u8			bundle_id;
+	u16			cport_id;
+	u8			module_minor;
+	u32			functionality;
+};
+
+#define GB_I2C_CACHE_MAX	16
+
+static LIST_HEAD(gb_i2c_cache);
+static DEFINE_MUTEX(gb_i2c_cache_mutex);
+static unsigned int gb_i2c_cache_count;
+
+static bool gb_i2c_cache_match(struct gb_i2c_cache_entry *entry,
+			       struct gb_connection *connection)
+{
+	struct gb_bundle *bundle = connection->bundle;
+
+	return entry->vendor_id == bundle->intf->vendor_id &&
+	       entry->product_id == bundle->intf->product_id &&
+	       entry->bundle_id == bundle->id &&
+	       entry->cport_id == connection->intf_cport_id &&
+	       entry->module_minor == connection->module_minor;
+}
+
+static bool gb_i2c_cache_get(struct gb_i2c_device *gb_i2c_dev)
+{
+	struct gb_i2c_cache_entry *entry;
+	bool found = false;
+
+	mutex_lock(&gb_i2c_cache_mutex);
+	list_for_each_entry(entry, &gb_i2c_cache, list) {
+		if (gb_i2c_cache_match(entry, gb_i2c_dev->connection)) {
+			gb_i2c_dev->functionality = entry->functionality;
+			list_move(&entry->list, &gb_i2c_cache);
+			found = true;
+			break;
+		}
+	}
+	mutex_unlock(&gb_i2c_cache_mutex);
+
+	return found;
+}
+
+static void gb_i2c_cache_put(struct gb_i2c_device *gb_i2c_dev)
+{
+	struct gb_connection *connection = gb_i2c_dev->connection;
+	struct gb_i2c_cache_entry *entry;
+
+	mutex_lock(&gb_i2c_cache_mutex);
+	list_for_each_entry(entry, &gb_i2c_cache, list) {
+		if (gb_i2c_cache_match(entry, connection)) {
+			entry->functionality = gb_i2c_dev->functionality;
+			goto out;
+		}
+	}
+
+	/* Recycle the least recently used entry once full */
+	if (gb_i2c_cache_count == GB_I2C_CACHE_MAX) {
+		entry = list_last_entry(&gb_i2c_cache,
+					struct gb_i2c_cache_entry, list);
+		list_del(&entry->list);
+	} else {
+		entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+		if (!entry)
+			goto out;
+		gb_i2c_cache_count++;
+	}
+
+	entry->vendor_id = connection->bundle->intf->vendor_id;
+	entry->product_id = connection->bundle->intf->product_id;
+	entry->bundle_id = connection->bundle->id;
+	entry->cport_id = connection->intf_cport_id;
+	entry->module_minor = connection->module_minor;
+	entry->functionality = gb_i2c_dev->functionality;
+	list_add(&entry->list, &gb_i2c_cache);
+out:
+	mutex_unlock(&gb_i2c_cache_mutex);
+}
+
+static void gb_i2c_cache_clear(void)
+{
+	struct gb_i2c_cache_entry *entry, *tmp;
+
+	mutex_lock(&gb_i2c_cache_mutex);
+	list_for_each_entry_safe(entry, tmp, &gb_i2c_cache, list) {
+		list_del(&entry->list);
+		kfree(entry);
+	}
+	gb_i2c_cache_count = 0;
+	mutex_unlock(&gb_i2c_cache_mutex);
+}
+
 /*
  * Map Greybus i2c functionality bits into Linux ones
  */
@@ -50,6 +152,31 @@ static int gb_i2c_functionality_operation(struct gb_i2c_device *gb_i2c_dev)
 	return 0;
 }
 
+static int gb_i2c_config_operation(struct gb_i2c_device *gb_i2c_dev,
+				   u16 msec, u8 retries)
+{
+	struct gb_i2c_config_request request;
+	struct gb_i2c_config_response response;
+	u32 functionality;
+	int ret;
+
+	request.timeout_msec = cpu_to_le16(msec);
+	request.retries = retries;
+	request.pad = 0;
+	ret = gb_operation_sync(gb_i2c_dev->connection, GB_I2C_TYPE_CONFIG,
+				&request, sizeof(request),
+				&response, sizeof(response));
+	if (ret)
+		return ret;
+
+	functionality = le32_to_cpu(response.functionality);
+	gb_i2c_dev->functionality = gb_i2c_functionality_map(functionality);
+	gb_i2c_dev->timeout_msec = msec;
+	gb_i2c_dev->retries = retries;
+
+	return 0;
+}
+
 static int gb_i2c_timeout_operation(struct gb_i2c_device *gb_i2c_dev, u16 msec)
 {
 	struct gb_i2c_timeout_request request;
@@ -102,10 +229,39 @@ gb_i2c_fill_transfer_op(struct gb_i2c_transfer_op *op, struct i2c_msg *msg)
 	op->size = cpu_to_le16(msg->len);
 }
 
+static u16 gb_i2c_adapter_timeout(struct gb_i2c_device *gb_i2c_dev)
+{
+	return min_t(unsigned int, jiffies_to_msecs(gb_i2c_dev->adapter.timeout),
+		     U16_MAX);
+}
+
+static u8 gb_i2c_adapter_retries(struct gb_i2c_device *gb_i2c_dev)
+{
+	return min_t(int, gb_i2c_dev->adapter.retries, U8_MAX);
+}
+
+/*
+ * Older modules keep a single timeout and retry count, bring those in
+ * line with the adapter's (e.g. after I2C_TIMEOUT) only when they differ.
+ */
+static void gb_i2c_settings_sync(struct gb_i2c_device *gb_i2c_dev)
+{
+	u16 msec = gb_i2c_adapter_timeout(gb_i2c_dev);
+	u8 retries = gb_i2c_adapter_retries(gb_i2c_dev);
+
+	if (msec != gb_i2c_dev->timeout_msec)
+		gb_i2c_timeout_operation(gb_i2c_dev, msec);
+
+	if (retries != gb_i2c_dev->retries)
+		gb_i2c_retries_operation(gb_i2c_dev, retries);
+}
+
 static struct gb_operation *
-gb_i2c_operation_create(struct gb_connection *connection,
+gb_i2c_operation_create(struct gb_i2c_device *gb_i2c_dev,
 			struct i2c_msg *msgs, u32 msg_count)
 {
+	struct gb_connection *connection = gb_i2c_dev->connection;
+	struct gb_i2c_transfer_config_request *config;
 	struct gb_i2c_transfer_request *request;
 	struct gb_operation *operation;
 	struct gb_i2c_transfer_op *op;
@@ -115,6 +271,7 @@ gb_i2c_operation_create(struct gb_connection *connection,
 	size_t request_size;
 	void *data;
 	u16 op_count;
+	int type;
 	u32 i;
 
 	if (msg_count > (u32)U16_MAX) {
@@ -135,20 +292,37 @@ gb_i2c_operation_create(struct gb_connection *connection,
 		else
 			data_out_size += (u32)msg->len;
 
-	request_size = sizeof(*request);
+	if (gb_i2c_dev->xfer_config) {
+		type = GB_I2C_TYPE_TRANSFER_CONFIG;
+		request_size = sizeof(*config);
+	} else {
+		type = GB_I2C_TYPE_TRANSFER;
+		request_size = sizeof(*request);
+	}
 	request_size += msg_count * sizeof(*op);
 	request_size += data_out_size;
 
 	/* Response consists only of incoming data */
-	operation = gb_operation_create(connection, GB_I2C_TYPE_TRANSFER,
+	operation = gb_operation_create(connection, type,
 				request_size, data_in_size, GFP_KERNEL);
 	if (!operation)
 		return NULL;
 
-	request = operation->request->payload;
-	request->op_count = cpu_to_le16(op_count);
+	if (gb_i2c_dev->xfer_config) {
+		config = operation->request->payload;
+		config->timeout_msec =
+			cpu_to_le16(gb_i2c_adapter_timeout(gb_i2c_dev));
+		config->retries = gb_i2c_adapter_retries(gb_i2c_dev);
+		config->pad = 0;
+		config->op_count = cpu_to_le16(op_count);
+		op = &config->ops[0];
+	} else {
+		request = operation->request->payload;
+		request->op_count = cpu_to_le16(op_count);
+		op = &request->ops[0];
+	}
+
 	/* Fill in the ops array */
-	op = &request->ops[0];
 	msg = msgs;
 	for (i = 0; i < msg_count; i++)
 		gb_i2c_fill_transfer_op(op++, msg++);
@@ -200,15 +374,25 @@ static bool gb_i2c_expected_transfer_error(int errno)
 static int gb_i2c_transfer_operation(struct gb_i2c_device *gb_i2c_dev,
 					struct i2c_msg *msgs, u32 msg_count)
 {
-	struct gb_connection *connection = gb_i2c_dev->connection;
 	struct gb_operation *operation;
+	unsigned int timeout;
 	int ret;
 
-	operation = gb_i2c_operation_create(connection, msgs, msg_count);
+	if (!gb_i2c_dev->xfer_config)
+		gb_i2c_settings_sync(gb_i2c_dev);
+
+	operation = gb_i2c_operation_create(gb_i2c_dev, msgs, msg_count);
 	if (!operation)
 		return -ENOMEM;
 
-	ret = gb_operation_request_send_sync(operation);
+	/* Leave the module time to run out of its own retries first */
+	timeout = gb_i2c_dev->xfer_config ?
+		gb_i2c_adapter_timeout(gb_i2c_dev) :
+		gb_i2c_dev->timeout_msec;
+	timeout *= gb_i2c_adapter_retries(gb_i2c_dev) + 1;
+	timeout = max_t(unsigned int, timeout, GB_OPERATION_TIMEOUT_DEFAULT);
+
+	ret = gb_operation_request_send_sync_timeout(operation, timeout);
 	if (!ret) {
 		struct gb_i2c_transfer_response *response;
 
@@ -267,16 +451,39 @@ static const struct i2c_algorithm gb_i2c_algorithm = {
  * If that's OK, we get and cached its functionality bits, and
  * set up the retry count and timeout.
  *
+ * Modules that know CONFIG get all of that in one operation, and none at
+ * all once their functionality is cached, as their transfers carry the
+ * timeout and retries anyway.
+ *
  * Note: gb_i2c_dev->connection is assumed to have been valid.
  */
 static int gb_i2c_device_setup(struct gb_i2c_device *gb_i2c_dev)
 {
+	bool cached;
 	int ret;
 
 	/* Assume the functionality never changes, just get it once */
-	ret = gb_i2c_functionality_operation(gb_i2c_dev);
-	if (ret)
+	cached = gb_i2c_cache_get(gb_i2c_dev);
+
+	if (gb_i2c_dev->connection->module_minor >= GB_I2C_VER_CONFIG) {
+		gb_i2c_dev->xfer_config = true;
+		if (cached)
+			return 0;
+
+		ret = gb_i2c_config_operation(gb_i2c_dev,
+					      GB_I2C_TIMEOUT_DEFAULT,
+					      GB_I2C_RETRIES_DEFAULT);
+		if (!ret)
+			gb_i2c_cache_put(gb_i2c_dev);
 		return ret;
+	}
+
+	if (!cached) {
+		ret = gb_i2c_functionality_operation(gb_i2c_dev);
+		if (ret)
+			return ret;
+		gb_i2c_cache_put(gb_i2c_dev);
+	}
 
 	/* Set up our default retry count and timeout */
 	ret = gb_i2c_retries_operation(gb_i2c_dev, GB_I2C_RETRIES_DEFAULT);
@@ -309,8 +516,8 @@ static int gb_i2c_connection_init(struct gb_connection *connection)
 	adapter->class = I2C_CLASS_HWMON | I2C_CLASS_SPD;
 	adapter->algo = &gb_i2c_algorithm;
 	/* adapter->algo_data = what? */
-	adapter->timeout = gb_i2c_dev->timeout_msec * HZ / 1000;
-	adapter->retries = gb_i2c_dev->retries;
+	adapter->timeout = msecs_to_jiffies(GB_I2C_TIMEOUT_DEFAULT);
+	adapter->retries = GB_I2C_RETRIES_DEFAULT;
 
 	adapter->dev.parent = &connection->bundle->dev;
 	snprintf(adapter->name, sizeof(adapter->name), "Greybus i2c adapter");
@@ -347,4 +554,13 @@ static struct gb_protocol i2c_protocol = {
 	.request_recv		= NULL,	/* no incoming requests */
 };
 
-gb_builtin_protocol_driver(i2c_protocol);
+int __init gb_i2c_protocol_init(void)
+{
+	return gb_protocol_register(&i2c_protocol);
+}
+
+void gb_i2c_protocol_exit(void)
+{
+	gb_protocol_deregister(&i2c_protocol);
+	gb_i2c_cache_clear();
+}
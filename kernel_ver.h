@@ -330,4 +330,14 @@ static inline struct snd_soc_dapm_context
 }
 #endif
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 4, 0)
+/* Commit: d0164ad mm, page_alloc: distinguish between being unable to sleep... */
+#include <linux/gfp.h>
+
+static inline bool gfpflags_allow_blocking(const gfp_t gfp_flags)
+{
+	return !!(gfp_flags & __GFP_WAIT);
+}
+#endif
+
 #endif	/* __GREYBUS_KERNEL_VER_H */
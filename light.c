@@ -7,7 +7,10 @@
  * Released under the GPLv2 only.
  */
 
+#include <linux/async.h>
+#include <linux/debugfs.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/leds.h>
 #include <linux/module.h>
 #include <linux/slab.h>
@@ -51,8 +54,10 @@ struct gb_light {
 	struct gb_lights	*glights;
 	u32			flags;
 	u8			channels_count;
+	u8			channels_ready;	/* Configured so far */
 	struct gb_channel	*channels;
 	bool			has_flash;
+	int			register_ret;
 #ifdef V4L2_HAVE_FLASH
 	struct v4l2_flash	*v4l2_flash;
 #endif
@@ -63,8 +68,12 @@ struct gb_lights {
 	u8			lights_count;
 	struct gb_light		*lights;
 	struct mutex		lights_lock;
+	u32			setup_us;
+	struct dentry		*setup_dentry;
 };
 
+static ASYNC_DOMAIN_EXCLUSIVE(gb_lights_async_domain);
+
 static void gb_lights_channel_free(struct gb_channel *channel);
 
 static struct gb_connection *get_conn_from_channel(struct gb_channel *channel)
@@ -747,24 +756,12 @@ static void __gb_lights_flash_led_unregister(struct gb_channel *channel)
 	led_classdev_flash_unregister(&channel->fled);
 }
 
-static int gb_lights_channel_flash_config(struct gb_channel *channel)
+static int gb_lights_channel_flash_apply(struct gb_channel *channel,
+		const struct gb_lights_get_channel_flash_config_response *conf)
 {
-	struct gb_connection *connection = get_conn_from_channel(channel);
-	struct gb_lights_get_channel_flash_config_request req;
-	struct gb_lights_get_channel_flash_config_response conf;
 	struct led_flash_setting *fset;
-	int ret;
-
-	req.light_id = channel->light->id;
-	req.channel_id = channel->id;
-
-	ret = gb_operation_sync(connection,
-				GB_LIGHTS_TYPE_GET_CHANNEL_FLASH_CONFIG,
-				&req, sizeof(req), &conf, sizeof(conf));
-	if (ret < 0)
-		return ret;
 
-	if (!conf.intensity_step_uA)
+	if (!conf->intensity_step_uA)
 		return -EINVAL;
 
 	/*
@@ -772,9 +769,9 @@ static int gb_lights_channel_flash_config(struct gb_channel *channel)
 	 * indicator.  They will be needed for v4l2 registration.
 	 */
 	fset = &channel->intensity_uA;
-	fset->min = le32_to_cpu(conf.intensity_min_uA);
-	fset->max = le32_to_cpu(conf.intensity_max_uA);
-	fset->step = le32_to_cpu(conf.intensity_step_uA);
+	fset->min = le32_to_cpu(conf->intensity_min_uA);
+	fset->max = le32_to_cpu(conf->intensity_max_uA);
+	fset->step = le32_to_cpu(conf->intensity_step_uA);
 
 	/*
 	 * On flash type, max brightness is set as the number of intensity steps
@@ -785,15 +782,35 @@ static int gb_lights_channel_flash_config(struct gb_channel *channel)
 	/* Only the flash mode have the timeout constraints settings */
 	if (channel->mode & GB_CHANNEL_MODE_FLASH) {
 		fset = &channel->timeout_us;
-		fset->min = le32_to_cpu(conf.timeout_min_us);
-		fset->max = le32_to_cpu(conf.timeout_max_us);
-		fset->step = le32_to_cpu(conf.timeout_step_us);
+		fset->min = le32_to_cpu(conf->timeout_min_us);
+		fset->max = le32_to_cpu(conf->timeout_max_us);
+		fset->step = le32_to_cpu(conf->timeout_step_us);
 	}
 
 	return 0;
 }
-#else
+
 static int gb_lights_channel_flash_config(struct gb_channel *channel)
+{
+	struct gb_connection *connection = get_conn_from_channel(channel);
+	struct gb_lights_get_channel_flash_config_request req;
+	struct gb_lights_get_channel_flash_config_response conf;
+	int ret;
+
+	req.light_id = channel->light->id;
+	req.channel_id = channel->id;
+
+	ret = gb_operation_sync(connection,
+				GB_LIGHTS_TYPE_GET_CHANNEL_FLASH_CONFIG,
+				&req, sizeof(req), &conf, sizeof(conf));
+	if (ret < 0)
+		return ret;
+
+	return gb_lights_channel_flash_apply(channel, &conf);
+}
+#else
+static int gb_lights_channel_flash_apply(struct gb_channel *channel,
+		const struct gb_lights_get_channel_flash_config_response *conf)
 {
 	struct gb_connection *connection = get_conn_from_channel(channel);
 
@@ -801,6 +818,11 @@ static int gb_lights_channel_flash_config(struct gb_channel *channel)
 	return 0;
 }
 
+static int gb_lights_channel_flash_config(struct gb_channel *channel)
+{
+	return gb_lights_channel_flash_apply(channel, NULL);
+}
+
 static int __gb_lights_flash_led_register(struct gb_channel *channel)
 {
 	return 0;
@@ -870,32 +892,45 @@ static void gb_lights_channel_unregister(struct gb_channel *channel)
 		__gb_lights_flash_led_unregister(channel);
 }
 
-static int gb_lights_channel_config(struct gb_light *light,
-				    struct gb_channel *channel)
+/*
+ * A channel is applied again when the per-light path takes over after a
+ * failed GET_ALL_CONFIG, drop whatever the earlier attempt allocated.
+ */
+static void gb_lights_channel_apply_undo(struct gb_channel *channel,
+					 struct led_classdev *cdev)
+{
+	kfree(cdev->name);
+	cdev->name = NULL;
+	kfree(channel->attrs);
+	channel->attrs = NULL;
+	kfree(channel->attr_group);
+	channel->attr_group = NULL;
+	kfree(channel->attr_groups);
+	channel->attr_groups = NULL;
+	kfree(channel->color_name);
+	channel->color_name = NULL;
+	kfree(channel->mode_name);
+	channel->mode_name = NULL;
+}
+
+static int gb_lights_channel_apply(struct gb_light *light,
+		struct gb_channel *channel,
+		const struct gb_lights_get_channel_config_response *conf)
 {
-	struct gb_lights_get_channel_config_response conf;
-	struct gb_lights_get_channel_config_request req;
-	struct gb_connection *connection = get_conn_from_light(light);
 	struct led_classdev *cdev = get_channel_cdev(channel);
 	char *name;
 	int ret;
 
-	req.light_id = light->id;
-	req.channel_id = channel->id;
-
-	ret = gb_operation_sync(connection, GB_LIGHTS_TYPE_GET_CHANNEL_CONFIG,
-				&req, sizeof(req), &conf, sizeof(conf));
-	if (ret < 0)
-		return ret;
+	gb_lights_channel_apply_undo(channel, cdev);
 
 	channel->light = light;
-	channel->mode = le32_to_cpu(conf.mode);
-	channel->flags = le32_to_cpu(conf.flags);
-	channel->color = le32_to_cpu(conf.color);
-	channel->color_name = kstrndup(conf.color_name, NAMES_MAX, GFP_KERNEL);
+	channel->mode = le32_to_cpu(conf->mode);
+	channel->flags = le32_to_cpu(conf->flags);
+	channel->color = le32_to_cpu(conf->color);
+	channel->color_name = kstrndup(conf->color_name, NAMES_MAX, GFP_KERNEL);
 	if (!channel->color_name)
 		return -ENOMEM;
-	channel->mode_name = kstrndup(conf.mode_name, NAMES_MAX, GFP_KERNEL);
+	channel->mode_name = kstrndup(conf->mode_name, NAMES_MAX, GFP_KERNEL);
 	if (!channel->mode_name)
 		return -ENOMEM;
 
@@ -908,7 +943,7 @@ static int gb_lights_channel_config(struct gb_light *light,
 
 	cdev->name = name;
 
-	cdev->max_brightness = conf.max_brightness;
+	cdev->max_brightness = conf->max_brightness;
 
 	ret = channel_attr_groups_set(channel, cdev);
 	if (ret < 0)
@@ -916,6 +951,33 @@ static int gb_lights_channel_config(struct gb_light *light,
 
 	gb_lights_led_operations_set(channel, cdev);
 
+	/* Flash related channels still need their flash configuration */
+	if (is_channel_flash(channel))
+		light->has_flash = true;
+
+	return 0;
+}
+
+static int gb_lights_channel_config(struct gb_light *light,
+				    struct gb_channel *channel)
+{
+	struct gb_lights_get_channel_config_response conf;
+	struct gb_lights_get_channel_config_request req;
+	struct gb_connection *connection = get_conn_from_light(light);
+	int ret;
+
+	req.light_id = light->id;
+	req.channel_id = channel->id;
+
+	ret = gb_operation_sync(connection, GB_LIGHTS_TYPE_GET_CHANNEL_CONFIG,
+				&req, sizeof(req), &conf, sizeof(conf));
+	if (ret < 0)
+		return ret;
+
+	ret = gb_lights_channel_apply(light, channel, &conf);
+	if (ret < 0)
+		return ret;
+
 	/*
 	 * If it is not a flash related channel (flash, torch or indicator) we
 	 * are done here. If not, continue and fetch flash related
@@ -924,60 +986,85 @@ static int gb_lights_channel_config(struct gb_light *light,
 	if (!is_channel_flash(channel))
 		return ret;
 
-	light->has_flash = true;
-
-	ret = gb_lights_channel_flash_config(channel);
-	if (ret < 0)
-		return ret;
-
-	return ret;
+	return gb_lights_channel_flash_config(channel);
 }
 
-static int gb_lights_light_config(struct gb_lights *glights, u8 id)
+static int gb_lights_light_init(struct gb_lights *glights, u8 id,
+				u8 channel_count, const char *name)
 {
 	struct gb_light *light = &glights->lights[id];
-	struct gb_lights_get_light_config_request req;
-	struct gb_lights_get_light_config_response conf;
-	int ret;
 	int i;
 
 	light->glights = glights;
 	light->id = id;
 
-	req.id = id;
-
-	ret = gb_operation_sync(glights->connection,
-				GB_LIGHTS_TYPE_GET_LIGHT_CONFIG,
-				&req, sizeof(req), &conf, sizeof(conf));
-	if (ret < 0)
-		return ret;
-
-	if (!conf.channel_count)
+	if (!channel_count)
 		return -EINVAL;
-	if (!strlen(conf.name))
+	if (!strnlen(name, NAMES_MAX))
 		return -EINVAL;
 
-	light->channels_count = conf.channel_count;
-	light->name = kstrndup(conf.name, NAMES_MAX, GFP_KERNEL);
+	light->name = kstrndup(name, NAMES_MAX, GFP_KERNEL);
+	if (!light->name)
+		return -ENOMEM;
 
-	light->channels = kzalloc(light->channels_count *
-				  sizeof(struct gb_channel), GFP_KERNEL);
-	if (!light->channels)
+	light->channels = kzalloc(channel_count * sizeof(struct gb_channel),
+				  GFP_KERNEL);
+	if (!light->channels) {
+		kfree(light->name);
+		light->name = NULL;
 		return -ENOMEM;
+	}
 
-	/* First we collect all the configurations for all channels */
-	for (i = 0; i < light->channels_count; i++) {
+	light->channels_count = channel_count;
+	for (i = 0; i < light->channels_count; i++)
 		light->channels[i].id = i;
-		ret = gb_lights_channel_config(light, &light->channels[i]);
+
+	return 0;
+}
+
+/* Collect the configuration of the channels not configured yet */
+static int gb_lights_light_fetch(struct gb_lights *glights, u8 id)
+{
+	struct gb_light *light = &glights->lights[id];
+	struct gb_lights_get_light_config_request req;
+	struct gb_lights_get_light_config_response conf;
+	int ret;
+
+	if (!light->channels) {
+		req.id = id;
+
+		ret = gb_operation_sync(glights->connection,
+					GB_LIGHTS_TYPE_GET_LIGHT_CONFIG,
+					&req, sizeof(req), &conf, sizeof(conf));
+		if (ret < 0)
+			return ret;
+
+		ret = gb_lights_light_init(glights, id, conf.channel_count,
+					   conf.name);
 		if (ret < 0)
 			return ret;
 	}
 
-	/*
-	 * Then, if everything went ok in getting configurations, we register
-	 * the classdev, flash classdev and v4l2 subsystem, if a flash device is
-	 * found.
-	 */
+	for (; light->channels_ready < light->channels_count;
+	     light->channels_ready++) {
+		ret = gb_lights_channel_config(light,
+				&light->channels[light->channels_ready]);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Once all configurations are in, register the classdev, flash classdev
+ * and v4l2 subsystem, if a flash device is found.
+ */
+static int gb_lights_light_register(struct gb_light *light)
+{
+	int ret;
+	int i;
+
 	for (i = 0; i < light->channels_count; i++) {
 		ret = gb_lights_channel_register(&light->channels[i]);
 		if (ret < 0)
@@ -995,6 +1082,209 @@ static int gb_lights_light_config(struct gb_lights *glights, u8 id)
 	return 0;
 }
 
+static int gb_lights_light_config(struct gb_lights *glights, u8 id)
+{
+	int ret;
+
+	ret = gb_lights_light_fetch(glights, id);
+	if (ret < 0)
+		return ret;
+
+	return gb_lights_light_register(&glights->lights[id]);
+}
+
+static void gb_lights_light_register_async(void *data, async_cookie_t cookie)
+{
+	struct gb_light *light = data;
+
+	light->register_ret = gb_lights_light_register(light);
+}
+
+/*
+ * Check a GET_ALL_CONFIG page continues exactly where the configuration
+ * stands, before any of it is applied.
+ */
+static int gb_lights_config_page_check(struct gb_lights *glights,
+		const struct gb_lights_get_all_config_response *resp,
+		u8 light_id, u8 channel_id)
+{
+	const struct gb_lights_channel_desc *desc;
+	struct gb_light *light;
+	u8 channel_count = 0;
+	int i;
+
+	for (i = 0; i < resp->count; i++) {
+		desc = &resp->desc[i];
+		if (desc->light_id != light_id ||
+		    desc->channel_id != channel_id ||
+		    light_id >= glights->lights_count)
+			return -EPROTO;
+
+		/*
+		 * The channel count of a light is set by its first descriptor,
+		 * or by the light itself if already initialised, every other
+		 * descriptor of the light has to agree with it.
+		 */
+		light = &glights->lights[light_id];
+		if (!channel_count)
+			channel_count = light->channels ?
+					light->channels_count :
+					desc->channel_count;
+		if (desc->channel_count != channel_count ||
+		    channel_id >= channel_count)
+			return -EPROTO;
+
+		if (++channel_id == channel_count) {
+			light_id++;
+			channel_id = 0;
+			channel_count = 0;
+		}
+	}
+
+	return 0;
+}
+
+static int gb_lights_desc_apply(struct gb_lights *glights,
+				const struct gb_lights_channel_desc *desc)
+{
+	struct gb_light *light = &glights->lights[desc->light_id];
+	struct gb_channel *channel;
+	int ret;
+
+	if (!light->channels) {
+		ret = gb_lights_light_init(glights, desc->light_id,
+					   desc->channel_count,
+					   desc->light_name);
+		if (ret < 0)
+			return ret;
+	}
+
+	channel = &light->channels[desc->channel_id];
+	ret = gb_lights_channel_apply(light, channel, &desc->config);
+	if (ret < 0)
+		return ret;
+
+	if (is_channel_flash(channel)) {
+		ret = gb_lights_channel_flash_apply(channel, &desc->flash);
+		if (ret < 0)
+			return ret;
+	}
+
+	light->channels_ready++;
+
+	return 0;
+}
+
+static int gb_lights_config_page(struct gb_lights *glights, u8 light_id,
+				 u8 channel_id, u8 max_count)
+{
+	struct gb_connection *connection = glights->connection;
+	struct gb_lights_get_all_config_request *req;
+	struct gb_lights_get_all_config_response *resp;
+	struct gb_operation *op;
+	size_t count;
+	int ret;
+	int i;
+
+	op = gb_operation_create_flags(connection,
+				GB_LIGHTS_TYPE_GET_ALL_CONFIG, sizeof(*req),
+				sizeof(*resp) + max_count * sizeof(resp->desc[0]),
+				GB_OPERATION_FLAG_SHORT_RESPONSE, GFP_KERNEL);
+	if (!op)
+		return -ENOMEM;
+
+	req = op->request->payload;
+	req->light_id = light_id;
+	req->channel_id = channel_id;
+	req->max_count = max_count;
+
+	ret = gb_operation_request_send_sync(op);
+	if (ret)
+		goto out;
+
+	resp = op->response->payload;
+	if (op->response->payload_size < sizeof(*resp)) {
+		ret = -EPROTO;
+		goto out;
+	}
+
+	count = (op->response->payload_size - sizeof(*resp)) /
+		sizeof(resp->desc[0]);
+	if (!resp->count || resp->count > count) {
+		dev_err(&connection->bundle->dev,
+			"invalid lights config page (count=%u, size=%zu)\n",
+			resp->count, op->response->payload_size);
+		ret = -EPROTO;
+		goto out;
+	}
+
+	ret = gb_lights_config_page_check(glights, resp, light_id, channel_id);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < resp->count; i++) {
+		ret = gb_lights_desc_apply(glights, &resp->desc[i]);
+		if (ret)
+			goto out;
+	}
+
+	ret = 0;
+out:
+	gb_operation_put(op);
+
+	return ret;
+}
+
+/* Find where the configuration stands, false once everything is in */
+static bool gb_lights_config_next(struct gb_lights *glights, u8 *light_id,
+				  u8 *channel_id)
+{
+	struct gb_light *light;
+	int i;
+
+	for (i = 0; i < glights->lights_count; i++) {
+		light = &glights->lights[i];
+		if (!light->channels ||
+		    light->channels_ready < light->channels_count) {
+			*light_id = i;
+			*channel_id = light->channels_ready;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Collect the configuration of every light and channel through
+ * GET_ALL_CONFIG, a page of channel descriptors per operation. On failure
+ * whatever was applied stays, the per-light path picks up from there.
+ */
+static int gb_lights_config_all(struct gb_lights *glights)
+{
+	const struct gb_lights_get_all_config_response *resp;
+	size_t payload_max;
+	u8 light_id, channel_id;
+	u8 page_max;
+	int ret;
+
+	payload_max = gb_operation_get_payload_size_max(glights->connection);
+	if (payload_max < sizeof(*resp) + sizeof(resp->desc[0]))
+		return -EMSGSIZE;
+
+	page_max = min_t(size_t, (payload_max - sizeof(*resp)) /
+			 sizeof(resp->desc[0]), U8_MAX);
+
+	while (gb_lights_config_next(glights, &light_id, &channel_id)) {
+		ret = gb_lights_config_page(glights, light_id, channel_id,
+					    page_max);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
 static void gb_lights_channel_free(struct gb_channel *channel)
 {
 	if (&channel->work_brightness_set)
@@ -1040,6 +1330,7 @@ static void gb_lights_light_release(struct gb_light *light)
 
 	/* Cleanup pointers/flags to avoid double free/unregister */
 	light->channels = NULL;
+	light->channels_ready = 0;
 	light->name = NULL;
 	light->has_flash = false;
 }
@@ -1087,6 +1378,7 @@ static int gb_lights_get_count(struct gb_lights *glights)
 static int gb_lights_setup(struct gb_lights *glights)
 {
 	struct gb_connection *connection = glights->connection;
+	ktime_t start = ktime_get();
 	int ret;
 	int i;
 
@@ -1102,8 +1394,23 @@ static int gb_lights_setup(struct gb_lights *glights)
 		goto out;
 	}
 
+	/*
+	 * Out of memory is not going to get better on the per-light path,
+	 * and would leak a half applied channel.
+	 */
+	if (connection->module_minor >= GB_LIGHTS_VER_GET_ALL_CONFIG) {
+		ret = gb_lights_config_all(glights);
+		if (ret == -ENOMEM)
+			goto out;
+		if (ret < 0)
+			dev_warn(&connection->bundle->dev,
+				 "bulk lights config failed (%d), falling back\n",
+				 ret);
+	}
+
+	/* per-light path for older modules, or to finish a failed bulk fetch */
 	for (i = 0; i < glights->lights_count; i++) {
-		ret = gb_lights_light_config(glights, i);
+		ret = gb_lights_light_fetch(glights, i);
 		if (ret < 0) {
 			dev_err(&connection->bundle->dev,
 				"Fail to configure lights device\n");
@@ -1111,6 +1418,26 @@ static int gb_lights_setup(struct gb_lights *glights)
 		}
 	}
 
+	/* The lights are independent, register their classdevs in parallel */
+	for (i = 0; i < glights->lights_count; i++)
+		async_schedule_domain(gb_lights_light_register_async,
+				      &glights->lights[i],
+				      &gb_lights_async_domain);
+	async_synchronize_full_domain(&gb_lights_async_domain);
+
+	for (i = 0; i < glights->lights_count; i++) {
+		ret = glights->lights[i].register_ret;
+		if (ret < 0) {
+			dev_err(&connection->bundle->dev,
+				"Fail to register lights device\n");
+			goto out;
+		}
+	}
+
+	glights->setup_us = ktime_us_delta(ktime_get(), start);
+	dev_info(&connection->bundle->dev, "%u lights set up in %u us\n",
+		 glights->lights_count, glights->setup_us);
+
 out:
 	mutex_unlock(&glights->lights_lock);
 	return ret;
@@ -1171,6 +1498,7 @@ static int gb_lights_event_recv(u8 type, struct gb_operation *op)
 static int gb_lights_connection_init(struct gb_connection *connection)
 {
 	struct gb_lights *glights;
+	char *name;
 	int ret;
 
 	glights = kzalloc(sizeof(*glights), GFP_KERNEL);
@@ -1191,6 +1519,15 @@ static int gb_lights_connection_init(struct gb_connection *connection)
 
 	connection->private = glights;
 
+	name = kasprintf(GFP_KERNEL, "lights_setup_us-%s",
+			 dev_name(&connection->bundle->dev));
+	if (name) {
+		glights->setup_dentry = debugfs_create_u32(name, S_IRUGO,
+							   gb_debugfs_get(),
+							   &glights->setup_us);
+		kfree(name);
+	}
+
 	return 0;
 
 out:
@@ -1202,6 +1539,7 @@ static void gb_lights_connection_exit(struct gb_connection *connection)
 {
 	struct gb_lights *glights = connection->private;
 
+	debugfs_remove(glights->setup_dentry);
 	gb_lights_release(glights);
 }
 
@@ -83,6 +83,8 @@ struct gb_loopback {
 	struct gb_loopback_stats requests_per_second;
 	struct gb_loopback_stats apbridge_unipro_latency;
 	struct gb_loopback_stats gpbridge_firmware_latency;
+	/* Module-initiated requests: receive to handler entry, in usec */
+	struct gb_loopback_stats request_dispatch_latency;
 
 	int type;
 	int async;
@@ -280,6 +282,8 @@ gb_loopback_stats_attrs(throughput);
 gb_loopback_stats_attrs(apbridge_unipro_latency);
 /* Firmware induced overhead in the GPBridge */
 gb_loopback_stats_attrs(gpbridge_firmware_latency);
+/* Delay before module-initiated requests reach the loopback handler */
+gb_loopback_stats_attrs(request_dispatch_latency);
 
 /* Number of errors encountered during loop */
 gb_loopback_ro_attr(error);
@@ -332,6 +336,9 @@ static struct attribute *loopback_attrs[] = {
 	&dev_attr_gpbridge_firmware_latency_min.attr,
 	&dev_attr_gpbridge_firmware_latency_max.attr,
 	&dev_attr_gpbridge_firmware_latency_avg.attr,
+	&dev_attr_request_dispatch_latency_min.attr,
+	&dev_attr_request_dispatch_latency_max.attr,
+	&dev_attr_request_dispatch_latency_avg.attr,
 	&dev_attr_type.attr,
 	&dev_attr_size.attr,
 	&dev_attr_us_wait.attr,
@@ -775,6 +782,29 @@ static int gb_loopback_async_ping(struct gb_loopback *gb)
 					   NULL, 0, 0, NULL);
 }
 
+static void gb_loopback_update_stats(struct gb_loopback_stats *stats, u32 val);
+
+/*
+ * Record how long a module-initiated request waited between reception and
+ * its handler, which is what GB_PROTOCOL_ATOMIC_REQUEST_RECV shortens for
+ * unidirectional requests. Called in atomic context for those.
+ */
+static void gb_loopback_record_dispatch(struct gb_operation *operation)
+{
+	struct gb_loopback *gb = operation->connection->bundle->private;
+	unsigned long flags;
+	u32 usec;
+
+	if (!gb)
+		return;
+
+	usec = (u32)ktime_us_delta(ktime_get(), operation->recv_time);
+
+	spin_lock_irqsave(&gb_dev.lock, flags);
+	gb_loopback_update_stats(&gb->request_dispatch_latency, usec);
+	spin_unlock_irqrestore(&gb_dev.lock, flags);
+}
+
 static int gb_loopback_request_recv(u8 type, struct gb_operation *operation)
 {
 	struct gb_connection *connection = operation->connection;
@@ -790,6 +820,7 @@ static int gb_loopback_request_recv(u8 type, struct gb_operation *operation)
 		return -EINVAL;
 	case GB_LOOPBACK_TYPE_PING:
 	case GB_LOOPBACK_TYPE_SINK:
+		gb_loopback_record_dispatch(operation);
 		return 0;
 	case GB_LOOPBACK_TYPE_TRANSFER:
 		if (operation->request->payload_size < sizeof(*request)) {
@@ -828,6 +859,7 @@ static void gb_loopback_reset_stats(struct gb_loopback *gb)
 	struct gb_loopback_stats reset = {
 		.min = U32_MAX,
 	};
+	unsigned long flags;
 
 	/* Reset per-connection stats */
 	memcpy(&gb->latency, &reset,
@@ -840,6 +872,10 @@ static void gb_loopback_reset_stats(struct gb_loopback *gb)
 	       sizeof(struct gb_loopback_stats));
 	memcpy(&gb->gpbridge_firmware_latency, &reset,
 	       sizeof(struct gb_loopback_stats));
+	spin_lock_irqsave(&gb_dev.lock, flags);
+	memcpy(&gb->request_dispatch_latency, &reset,
+	       sizeof(struct gb_loopback_stats));
+	spin_unlock_irqrestore(&gb_dev.lock, flags);
 
 	/* Should be initialized at least once per transaction set */
 	gb->apbridge_latency_ts = 0;
@@ -1216,6 +1252,7 @@ static struct gb_protocol loopback_protocol = {
 	.connection_init	= gb_loopback_connection_init,
 	.connection_exit	= gb_loopback_connection_exit,
 	.request_recv		= gb_loopback_request_recv,
+	.flags			= GB_PROTOCOL_ATOMIC_REQUEST_RECV,
 };
 
 static int loopback_init(void)
@@ -135,6 +135,12 @@ enum MHB_ADDR {
 #define MHB_TYPE_UART_STATUS_RSP (MHB_RSP_MASK|MHB_TYPE_UART_STATUS_REQ)
 #define MHB_TYPE_UART_STATUS_NOT (MHB_NOT_MASK|MHB_TYPE_UART_STATUS_REQ)
 
+/* Several messages, each with its own mhb_hdr, in one frame */
+#define MHB_TYPE_UART_AGG_NOT (MHB_NOT_MASK|3)
+
+#define MHB_TYPE_UART_FEATURES_REQ (4)
+#define MHB_TYPE_UART_FEATURES_RSP (MHB_RSP_MASK|MHB_TYPE_UART_FEATURES_REQ)
+
 /* UniPro */
 #define MHB_TYPE_UNIPRO_CONFIG_REQ (0)
 #define MHB_TYPE_UNIPRO_CONFIG_RSP (MHB_RSP_MASK|MHB_TYPE_UNIPRO_CONFIG_REQ)
@@ -158,6 +164,10 @@ enum MHB_ADDR {
 #define MHB_TYPE_UNIPRO_STATS_RSP (MHB_RSP_MASK|MHB_TYPE_UNIPRO_STATS_REQ)
 #define MHB_TYPE_UNIPRO_STATS_NOT (MHB_NOT_MASK|MHB_TYPE_UNIPRO_STATS_REQ)
 
+#define MHB_TYPE_UNIPRO_BATCH_ATTR_REQ (6)
+#define MHB_TYPE_UNIPRO_BATCH_ATTR_RSP \
+	(MHB_RSP_MASK|MHB_TYPE_UNIPRO_BATCH_ATTR_REQ)
+
 /* CDSI */
 #define MHB_TYPE_CDSI_CONFIG_REQ (0)
 #define MHB_TYPE_CDSI_CONFIG_RSP (MHB_RSP_MASK|MHB_TYPE_CDSI_CONFIG_REQ)
@@ -270,6 +280,23 @@ struct mhb_uart_config_rsp {
 	uint32_t baud;
 } __attribute__((packed));
 
+#define MHB_UART_FEATURE_AGG (1 << 0)
+
+/*
+ * Aggregated frames carry sub-messages back to back, each a mhb_hdr whose
+ * length covers the header and payload only; the frame CRC covers them all.
+ * agg_max is the largest aggregated frame, CRC included, the sender accepts.
+ */
+struct mhb_uart_features_req {
+	uint32_t features;
+	uint16_t agg_max;
+} __attribute__((packed));
+
+struct mhb_uart_features_rsp {
+	uint32_t features;
+	uint16_t agg_max;
+} __attribute__((packed));
+
 /* UNIPRO */
 struct mhb_unipro_gear {
 	uint8_t pwrmode;
@@ -303,6 +330,34 @@ struct mhb_unipro_write_attr_req {
 	uint32_t value;
 } __attribute__((packed));
 
+struct mhb_unipro_batch_attr {
+	uint16_t attribute;
+	uint16_t selector;
+	uint8_t peer;
+	uint8_t write;
+	uint32_t value;
+} __attribute__((packed));
+
+struct mhb_unipro_batch_attr_req {
+	uint16_t tag;
+	uint8_t count;
+	uint8_t rsvd;
+	struct mhb_unipro_batch_attr attrs[0];
+} __attribute__((packed));
+
+struct mhb_unipro_batch_attr_result {
+	uint32_t value;
+	uint8_t result;
+	uint8_t rsvd[3];
+} __attribute__((packed));
+
+struct mhb_unipro_batch_attr_rsp {
+	uint16_t tag;
+	uint8_t count;
+	uint8_t rsvd;
+	struct mhb_unipro_batch_attr_result results[0];
+} __attribute__((packed));
+
 struct mhb_unipro_stats {
 	/* L1 */
 	uint32_t phy_lane_err;
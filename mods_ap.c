@@ -24,8 +24,6 @@
 #include "mods_nw.h"
 #include "muc_svc.h"
 
-static struct gb_host_device *g_hd;
-
 struct mods_ap_data {
 	struct mods_dl_device *dld;
 	struct gb_host_device *hd;
@@ -35,22 +33,25 @@ struct mods_ap_data {
 static int mods_ap_message_send(struct mods_dl_device *dld,
 		uint8_t *buf, size_t len)
 {
+	struct mods_ap_data *ap_data = (struct mods_ap_data *)dld->dl_priv;
 	struct muc_msg *msg = (struct muc_msg *)buf;
 
-	greybus_data_rcvd(g_hd, le16_to_cpu(msg->hdr.cport),
+	greybus_data_rcvd(ap_data->hd, le16_to_cpu(msg->hdr.cport),
 			msg->gb_msg, (len - sizeof(msg->hdr)));
 	return 0;
 }
 
 /* Get the corresponding connection's protocol */
-static int mods_ap_get_protocol(uint16_t cport_id, uint8_t *protocol)
+static int mods_ap_get_protocol(struct mods_dl_device *dld,
+		uint16_t cport_id, uint8_t *protocol)
 {
+	struct mods_ap_data *ap_data = (struct mods_ap_data *)dld->dl_priv;
 	struct gb_connection *conn;
 
-	if (!g_hd)
+	if (!ap_data || !ap_data->hd)
 		return -ENODEV;
 
-	conn = gb_connection_hd_find(g_hd, cport_id);
+	conn = gb_connection_hd_find(ap_data->hd, cport_id);
 	if (!conn) {
 		pr_err("mods_ap: couldn't find protocol for: %d\n", cport_id);
 		return -ENODEV;
@@ -137,16 +138,17 @@ static int mods_ap_probe(struct platform_device *pdev)
 {
 	int err = 0;
 	struct mods_ap_data *ap_data;
+	struct gb_host_device *hd;
 
 	/* setup host device */
-	g_hd = gb_hd_create(&mods_ap_host_driver, &pdev->dev,
+	hd = gb_hd_create(&mods_ap_host_driver, &pdev->dev,
 			PAYLOAD_MAX_SIZE, CPORT_ID_MAX);
-	if (IS_ERR(g_hd)) {
+	if (IS_ERR(hd)) {
 		dev_err(&pdev->dev, "Unable to create greybus host driver.\n");
-		return PTR_ERR(g_hd);
+		return PTR_ERR(hd);
 	}
-	ap_data = (struct mods_ap_data *)&g_hd->hd_priv;
-	ap_data->hd = g_hd;
+	ap_data = (struct mods_ap_data *)&hd->hd_priv;
+	ap_data->hd = hd;
 	platform_set_drvdata(pdev, ap_data);
 
 	/* create our data link device */
@@ -164,8 +166,9 @@ static int mods_ap_probe(struct platform_device *pdev)
 
 		goto err;
 	}
+	ap_data->dld->dl_priv = ap_data;
 
-	err = gb_hd_add(g_hd);
+	err = gb_hd_add(hd);
 	if (err)
 		goto remove_dl;
 
@@ -177,12 +180,11 @@ static int mods_ap_probe(struct platform_device *pdev)
 
 	return 0;
 free_hd:
-	gb_hd_del(g_hd);
+	gb_hd_del(hd);
 remove_dl:
 	mods_remove_dl_device(ap_data->dld);
 err:
-	gb_hd_put(g_hd);
-	g_hd = NULL;
+	gb_hd_put(hd);
 	return err;
 
 }
@@ -194,7 +196,7 @@ static int mods_ap_remove(struct platform_device *pdev)
 	mods_dl_dev_detached(ap_data->dld);
 	mods_remove_dl_device(ap_data->dld);
 	gb_hd_del(ap_data->hd);
-	gb_hd_put(g_hd);
+	gb_hd_put(ap_data->hd);
 
 	return 0;
 }
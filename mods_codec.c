@@ -46,6 +46,8 @@ struct mods_codec_dai {
 	struct gb_aud_devices enabled_devices;
 	bool tx_active;
 	bool rx_active;
+	/* module processing delay per stream, reported on port activation */
+	uint32_t delay_us[SNDRV_PCM_STREAM_LAST + 1];
 };
 
 /* declare 0 to -127.5 vol range with step 0.5 db */
@@ -133,6 +135,7 @@ static void mods_codec_work(struct work_struct *work)
 	bool *port_active;
 	int pcm_triggered;
 	uint16_t port_type;
+	uint32_t delay_us;
 
 	if (!gb_codec) {
 		priv->rx_active = false;
@@ -181,11 +184,18 @@ static void mods_codec_work(struct work_struct *work)
 				__func__, port_type);
 		err = gb_i2s_mgmt_activate_port(gb_codec->mgmt_connection,
 				port_type);
-		if (err)
+		if (err) {
 			pr_err("%s() failed to activate I2S port %d\n",
 				__func__, port_type);
-		else
+		} else {
 			*port_active = true;
+
+			/* optional, older modules don't report a delay */
+			if (gb_i2s_mgmt_get_processing_delay(
+					gb_codec->mgmt_connection, &delay_us))
+				delay_us = 0;
+			priv->delay_us[priv->substream->stream] = delay_us;
+		}
 	} else if ((*port_active) && !pcm_triggered) {
 		pr_debug("%s(): deactivate snd dev i2s port: %d\n",
 				__func__, port_type);
@@ -630,6 +640,17 @@ static void mods_codec_shutdown(struct snd_pcm_substream *substream,
 	mutex_unlock(&gb_codec->lock);
 }
 
+/* Account for the module side of the path in the reported pcm delay */
+static snd_pcm_sframes_t mods_codec_delay(struct snd_pcm_substream *substream,
+				struct snd_soc_dai *dai)
+{
+	struct mods_codec_dai *priv = snd_soc_codec_get_drvdata(dai->codec);
+	uint32_t delay_us = READ_ONCE(priv->delay_us[substream->stream]);
+
+	return div_u64((u64)delay_us * substream->runtime->rate,
+			USEC_PER_SEC);
+}
+
 static const struct snd_soc_dai_ops mods_codec_dai_ops = {
 	.startup    = mods_codec_start,
 	.hw_params = mods_codec_hw_params,
@@ -637,6 +658,7 @@ static const struct snd_soc_dai_ops mods_codec_dai_ops = {
 	.set_fmt	= mods_codec_dai_set_fmt,
 	.set_sysclk = mods_codec_set_dai_sysclk,
 	.shutdown = mods_codec_shutdown,
+	.delay = mods_codec_delay,
 };
 
 
@@ -954,12 +976,30 @@ out:
 
 static DEVICE_ATTR_RO(mods_codec_mic_params);
 
+static ssize_t mods_codec_stats_show(struct device *dev,
+			struct device_attribute *attr,
+			char *buf)
+{
+	struct mods_codec_dai *priv = dev_get_drvdata(dev);
+	struct gb_snd_codec *codec = priv->snd_codec;
+
+	return scnprintf(buf, PAGE_SIZE,
+		"underruns=%d;overruns=%d;playback_delay_us=%u;capture_delay_us=%u\n",
+		atomic_read(&codec->i2s_underruns),
+		atomic_read(&codec->i2s_overruns),
+		priv->delay_us[SNDRV_PCM_STREAM_PLAYBACK],
+		priv->delay_us[SNDRV_PCM_STREAM_CAPTURE]);
+}
+
+static DEVICE_ATTR_RO(mods_codec_stats);
+
 static struct attribute *mods_codec_attrs[] = {
 	&dev_attr_mods_codec_devices.attr,
 	&dev_attr_mods_codec_usecases.attr,
 	&dev_attr_mods_codec_caps.attr,
 	&dev_attr_mods_codec_speaker_preset.attr,
 	&dev_attr_mods_codec_mic_params.attr,
+	&dev_attr_mods_codec_stats.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(mods_codec);
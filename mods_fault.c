@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility LLC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#define pr_fmt(fmt) "MODS_FAULT: " fmt
+
+#include <linux/debugfs.h>
+#include <linux/err.h>
+#include <linux/fault-inject.h>
+#include <linux/kernel.h>
+
+#include "mods_fault.h"
+
+/*
+ * One fault_attr per fault type, all disabled (probability 0) by default.
+ * They are configured through the usual fault injection files under
+ * <debugfs>/mods/fail_link_<type>/, see fault-injection.txt.
+ */
+static struct fault_attr mods_faults[MODS_FAULT_MAX] = {
+	[0 ... MODS_FAULT_MAX - 1] = FAULT_ATTR_INITIALIZER,
+};
+
+bool mods_fault_inject(enum mods_fault type)
+{
+	return should_fail(&mods_faults[type], 1);
+}
+
+#ifdef CONFIG_FAULT_INJECTION_DEBUG_FS
+static const char * const mods_fault_names[MODS_FAULT_MAX] = {
+	[MODS_FAULT_CRC]	= "fail_link_crc",
+	[MODS_FAULT_DROP]	= "fail_link_drop",
+	[MODS_FAULT_ACK]	= "fail_link_ack",
+	[MODS_FAULT_INT]	= "fail_link_int",
+};
+
+void mods_fault_init(struct dentry *parent)
+{
+	struct dentry *dir;
+	int i;
+
+	if (!parent)
+		return;
+
+	for (i = 0; i < MODS_FAULT_MAX; i++) {
+		dir = fault_create_debugfs_attr(mods_fault_names[i], parent,
+						&mods_faults[i]);
+		if (IS_ERR(dir))
+			pr_warn("failed to create %s\n", mods_fault_names[i]);
+	}
+}
+#else
+void mods_fault_init(struct dentry *parent) { }
+#endif
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility LLC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef __MODS_FAULT_H__
+#define __MODS_FAULT_H__
+
+#include <linux/types.h>
+
+struct dentry;
+
+/* Faults the data link drivers can be told to simulate */
+enum mods_fault {
+	MODS_FAULT_CRC,		/* Received packet fails its CRC */
+	MODS_FAULT_DROP,	/* Packet is lost on the bus */
+	MODS_FAULT_ACK,		/* MuC ACK does not show up in time */
+	MODS_FAULT_INT,		/* Spurious INT from the MuC */
+	MODS_FAULT_MAX,
+};
+
+#ifdef CONFIG_FAULT_INJECTION
+bool mods_fault_inject(enum mods_fault type);
+void mods_fault_init(struct dentry *parent);
+#else
+static inline bool mods_fault_inject(enum mods_fault type)
+{
+	return false;
+}
+
+static inline void mods_fault_init(struct dentry *parent) { }
+#endif
+
+#endif /* __MODS_FAULT_H__ */
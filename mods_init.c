@@ -21,6 +21,8 @@
 #include <linux/module.h>
 
 #include "apba.h"
+#include "mods_fault.h"
+#include "mods_nw.h"
 #include "mods_uart.h"
 #include "muc.h"
 
@@ -39,6 +41,9 @@ static int __init mods_init(void)
 	if (!mods_debug_root)
 		pr_warn("failed to create 'mods' debugfs\n");
 
+	mods_fault_init(mods_debug_root);
+	mods_nw_debugfs_init(mods_debug_root);
+
 	err = muc_core_init();
 	if (err) {
 		pr_err("muc_core_init failed: %d\n", err);
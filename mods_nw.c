@@ -15,6 +15,8 @@
 
 #define pr_fmt(fmt) "MDNW: " fmt
 
+#include <linux/completion.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/err.h>
 #include <linux/interrupt.h>
@@ -24,14 +26,59 @@
 #include <linux/of_irq.h>
 #include <linux/platform_device.h>
 #include <linux/radix-tree.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
 
 #include "greybus.h"
 #include "muc_svc.h"
 #include "mods_nw.h"
 #include "mods_trace.h"
 
+/* Bytes a flow of weight 1 may send per round */
+#define SCHED_QUANTUM		1024
+#define SCHED_WEIGHT_MAX	64
+
+static unsigned int sched_depth = 32;
+module_param(sched_depth, uint, 0644);
+MODULE_PARM_DESC(sched_depth, "Max messages queued per cport on a busy link");
+
+/*
+ * Senders to one cport of a shared link. Flows are keyed by the destination
+ * cport and outlive the routes, so a weight survives a module re-attach.
+ */
+struct mods_nw_flow {
+	struct list_head active;	/* On sched->active while waiting */
+	struct list_head waiters;
+	u16 cport;
+	u32 weight;
+	u32 deficit;
+	u32 depth;
+	u64 sent;
+	u64 delayed;
+	u64 drops;
+};
+
+/*
+ * Deficit round robin over the cports of a link, so one chatty protocol
+ * cannot starve the others while the link is busy transferring.
+ */
+struct mods_nw_sched {
+	spinlock_t lock;
+	bool busy;
+	struct list_head active;
+	struct radix_tree_root flows;	/* Protected by list_lock */
+};
+
+struct mods_nw_waiter {
+	struct list_head entry;
+	size_t len;
+	struct completion done;
+};
+
 struct dest_entry {
 	struct mods_dl_device *dev;
+	struct mods_nw_flow *flow;
 	u16 cport;
 	u8 protocol_id;
 	u8 protocol_valid:1;
@@ -124,6 +171,50 @@ mods_nw_find_dest_dl_device(struct mods_dl_device *from, u16 cport)
 	return dest->dev;
 }
 
+static struct mods_nw_flow *
+_mods_nw_get_flow(struct mods_nw_sched *sched, u16 cport)
+{
+	struct mods_nw_flow *flow;
+
+	flow = radix_tree_lookup(&sched->flows, cport);
+	if (flow)
+		return flow;
+
+	flow = kzalloc(sizeof(*flow), GFP_KERNEL);
+	if (!flow)
+		return NULL;
+
+	INIT_LIST_HEAD(&flow->active);
+	INIT_LIST_HEAD(&flow->waiters);
+	flow->cport = cport;
+	flow->weight = 1;
+
+	if (radix_tree_insert(&sched->flows, cport, flow)) {
+		kfree(flow);
+		return NULL;
+	}
+
+	return flow;
+}
+
+/* called with list_lock held */
+static void _mods_nw_sched_free(struct mods_dl_device *mods_dev)
+{
+	struct mods_nw_sched *sched = mods_dev->sched;
+	struct mods_nw_flow *flow;
+
+	if (!sched)
+		return;
+
+	while (radix_tree_gang_lookup(&sched->flows, (void **)&flow, 0, 1)) {
+		radix_tree_delete(&sched->flows, flow->cport);
+		kfree(flow);
+	}
+
+	kfree(sched);
+	mods_dev->sched = NULL;
+}
+
 /* add the dl device to the table */
 /* called by the svc while creating the dl device */
 int mods_nw_add_dl_device(struct mods_dl_device *mods_dev)
@@ -146,6 +237,18 @@ int mods_nw_add_dl_device(struct mods_dl_device *mods_dev)
 		goto unlock;
 	}
 
+	if (mods_dev->drv->fair_sched) {
+		mods_dev->sched = kzalloc(sizeof(*mods_dev->sched), GFP_KERNEL);
+		if (!mods_dev->sched) {
+			kfree(new);
+			ret = -ENOMEM;
+			goto unlock;
+		}
+		spin_lock_init(&mods_dev->sched->lock);
+		INIT_LIST_HEAD(&mods_dev->sched->active);
+		INIT_RADIX_TREE(&mods_dev->sched->flows, GFP_KERNEL);
+	}
+
 	new->dev = mods_dev;
 	INIT_RADIX_TREE(&new->tree, GFP_KERNEL);
 	radix_tree_insert(&nw_interfaces, mods_dev->intf_id, new);
@@ -170,6 +273,7 @@ void mods_nw_del_dl_device(struct mods_dl_device *mods_dev)
 
 	radix_tree_delete(&nw_interfaces, mods_dev->intf_id);
 	kfree(set);
+	_mods_nw_sched_free(mods_dev);
 
 unlock:
 	mutex_unlock(&list_lock);
@@ -229,12 +333,21 @@ int mods_nw_add_route(u8 from_intf, u16 from_cport, u8 to_intf, u16 to_cport)
 	from_entry->cport = to_cport;
 	from_entry->dev = to_cset->dev;
 
+	/* No flow just means the cport bypasses the scheduler */
+	if (to_cset->dev->sched) {
+		mutex_lock(&list_lock);
+		from_entry->flow = _mods_nw_get_flow(to_cset->dev->sched,
+						     to_cport);
+		mutex_unlock(&list_lock);
+	}
+
 	/* If there is no protocol handler, we are done */
 	if (!from_cset->dev->drv->get_protocol)
 		return 0;
 
 	/* Try to get the protocol, any error should be fatal */
-	err = from_cset->dev->drv->get_protocol(from_cport, &protocol);
+	err = from_cset->dev->drv->get_protocol(from_cset->dev, from_cport,
+						&protocol);
 	if (err) {
 		pr_warn("Unable to get a protocol for %d:%d\n",
 				from_intf, from_cport);
@@ -290,6 +403,99 @@ unlock:
 	mutex_unlock(&list_lock);
 }
 
+/*
+ * Wait for the link to be ours. The fast path takes an idle link straight
+ * away; otherwise queue behind the flow and let the sender finishing ahead
+ * of us hand the link over.
+ */
+static int _mods_nw_sched_enter(struct mods_nw_sched *sched,
+				struct mods_nw_flow *flow, size_t len)
+{
+	struct mods_nw_waiter w;
+
+	spin_lock(&sched->lock);
+	if (!sched->busy && list_empty(&sched->active)) {
+		sched->busy = true;
+		spin_unlock(&sched->lock);
+		return 0;
+	}
+
+	if (flow->depth >= sched_depth) {
+		flow->drops++;
+		spin_unlock(&sched->lock);
+		return -EAGAIN;
+	}
+
+	w.len = len;
+	init_completion(&w.done);
+	list_add_tail(&w.entry, &flow->waiters);
+	if (!flow->depth++)
+		list_add_tail(&flow->active, &sched->active);
+	flow->delayed++;
+	spin_unlock(&sched->lock);
+
+	wait_for_completion(&w.done);
+
+	return 0;
+}
+
+/* Pass the link on to the next flow with enough deficit, or release it */
+static void _mods_nw_sched_exit(struct mods_nw_sched *sched,
+				struct mods_nw_flow *flow)
+{
+	struct mods_nw_waiter *w;
+	struct mods_nw_flow *next;
+
+	spin_lock(&sched->lock);
+	flow->sent++;
+
+	while (!list_empty(&sched->active)) {
+		next = list_first_entry(&sched->active, struct mods_nw_flow,
+					active);
+		w = list_first_entry(&next->waiters, struct mods_nw_waiter,
+				     entry);
+
+		if (next->deficit < w->len) {
+			next->deficit += SCHED_QUANTUM * next->weight;
+			list_move_tail(&next->active, &sched->active);
+			continue;
+		}
+
+		next->deficit -= w->len;
+		list_del(&w->entry);
+		if (!--next->depth) {
+			/* An idle flow does not bank credit */
+			next->deficit = 0;
+			list_del_init(&next->active);
+		}
+		spin_unlock(&sched->lock);
+
+		complete(&w->done);
+		return;
+	}
+
+	sched->busy = false;
+	spin_unlock(&sched->lock);
+}
+
+static int _mods_nw_send(struct dest_entry *dest, uint8_t *msg, size_t len)
+{
+	struct mods_dl_device *to = dest->dev;
+	int err;
+
+	if (!to->sched || !dest->flow)
+		return to->drv->message_send(to, msg, len);
+
+	err = _mods_nw_sched_enter(to->sched, dest->flow, len);
+	if (err)
+		return err;
+
+	err = to->drv->message_send(to, msg, len);
+	_mods_nw_sched_exit(to->sched, dest->flow);
+
+	return err;
+}
+
 int mods_nw_switch(struct mods_dl_device *from, uint8_t *msg, size_t len)
 {
 	struct muc_msg *mm;
@@ -331,7 +537,7 @@ int mods_nw_switch(struct mods_dl_device *from, uint8_t *msg, size_t len)
 	 */
 	err = _mods_nw_apply_filter(dest, dest->dev, msg, len);
 	if (err == -ENOENT)
-		err = dest->dev->drv->message_send(dest->dev, msg, len);
+		err = _mods_nw_send(dest, msg, len);
 
 out:
 	return err;
@@ -420,3 +626,115 @@ void mods_nw_unregister_filter(struct mods_nw_msg_filter *filter)
 	/* This was last filter for the protocol, clear its availability */
 	_set_filter(protocol, false);
 }
+
+int mods_nw_set_weight(u8 intf_id, u16 cport, u32 weight)
+{
+	struct cport_set *set;
+	struct mods_nw_flow *flow;
+	int ret = 0;
+
+	if (!weight || weight > SCHED_WEIGHT_MAX)
+		return -EINVAL;
+
+	mutex_lock(&list_lock);
+	set = radix_tree_lookup(&nw_interfaces, intf_id);
+	if (!set || !set->dev->sched) {
+		ret = -ENODEV;
+		goto unlock;
+	}
+
+	flow = _mods_nw_get_flow(set->dev->sched, cport);
+	if (!flow) {
+		ret = -ENOMEM;
+		goto unlock;
+	}
+
+	spin_lock(&set->dev->sched->lock);
+	flow->weight = weight;
+	spin_unlock(&set->dev->sched->lock);
+
+unlock:
+	mutex_unlock(&list_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL(mods_nw_set_weight);
+
+static int mods_nw_sched_show(struct seq_file *s, void *unused)
+{
+	struct radix_tree_iter rt_iter;
+	struct radix_tree_iter fl_iter;
+	void **rt_slot;
+	void **fl_slot;
+	struct cport_set *set;
+	struct mods_nw_flow *flow;
+
+	seq_puts(s, "intf cport weight depth sent delayed drops\n");
+
+	mutex_lock(&list_lock);
+	radix_tree_for_each_slot(rt_slot, &nw_interfaces, &rt_iter, 0) {
+		set = radix_tree_deref_slot(rt_slot);
+		if (!set->dev->sched)
+			continue;
+
+		radix_tree_for_each_slot(fl_slot, &set->dev->sched->flows,
+					 &fl_iter, 0) {
+			flow = radix_tree_deref_slot(fl_slot);
+			seq_printf(s, "%u %u %u %u %llu %llu %llu\n",
+				   set->dev->intf_id, flow->cport,
+				   flow->weight, flow->depth, flow->sent,
+				   flow->delayed, flow->drops);
+		}
+	}
+	mutex_unlock(&list_lock);
+
+	return 0;
+}
+
+static int mods_nw_sched_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mods_nw_sched_show, NULL);
+}
+
+/* "<intf> <cport> <weight>" */
+static ssize_t mods_nw_sched_write(struct file *file, const char __user *ubuf,
+				   size_t count, loff_t *ppos)
+{
+	char buf[32];
+	unsigned int intf, cport, weight;
+	int ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (sscanf(buf, "%u %u %u", &intf, &cport, &weight) != 3)
+		return -EINVAL;
+
+	if (intf > U8_MAX || cport > U16_MAX)
+		return -EINVAL;
+
+	ret = mods_nw_set_weight(intf, cport, weight);
+	if (ret)
+		return ret;
+
+	return count;
+}
+
+static const struct file_operations mods_nw_sched_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mods_nw_sched_open,
+	.read		= seq_read,
+	.write		= mods_nw_sched_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void mods_nw_debugfs_init(struct dentry *parent)
+{
+	debugfs_create_file("nw_sched", S_IRUGO | S_IWUSR, parent, NULL,
+			    &mods_nw_sched_fops);
+}
@@ -16,7 +16,10 @@
 
 #include "operation.h"
 
+struct dentry;
 struct mods_dl_device;
+struct mods_nw_sched;
+struct muc_svc_data;
 
 #pragma pack(push, 1)
 struct muc_msg_hdr {
@@ -35,7 +38,9 @@ struct muc_msg {
 struct mods_dl_driver {
 	int (*message_send)(struct mods_dl_device *nd, uint8_t *payload,
 			size_t size);
-	int (*get_protocol)(uint16_t cport_id, uint8_t *protocol);
+	int (*get_protocol)(struct mods_dl_device *nd, uint16_t cport_id,
+			uint8_t *protocol);
+	bool fair_sched;	/* Arbitrate senders per cport (shared link) */
 };
 
 enum {
@@ -64,12 +69,15 @@ struct mods_dl_device {
 	u8			device_id;
 	bool			hotplug_sent;
 	void			*dl_priv;
+	struct muc_svc_data	*svc;
+	struct mods_nw_sched	*sched;
 	struct kobject		intf_kobj;
 	struct bin_attribute	manifest_attr;
 
 	struct muc_svc_hotplug_work *hpw;
 	char *manifest;
 	__le16 manifest_size;
+	bool manifest_cached;
 	__u8 gb_ctrl_major;
 	__u8 gb_ctrl_minor;
 	__u8 mb_ctrl_major;
@@ -111,6 +119,10 @@ mods_nw_find_dest_dl_device(struct mods_dl_device *from, u16 cport);
 /* send message to switch to connect to destination */
 extern int mods_nw_switch(struct mods_dl_device *from, uint8_t *msg, size_t len);
 
+/* per-cport weight of the fair scheduler on a shared link */
+extern int mods_nw_set_weight(u8 intf_id, u16 cport, u32 weight);
+extern void mods_nw_debugfs_init(struct dentry *parent);
+
 /* register a message filter callback */
 extern int mods_nw_register_filter(struct mods_nw_msg_filter *filter);
 extern void mods_nw_unregister_filter(struct mods_nw_msg_filter *filter);
@@ -61,7 +61,7 @@
 
 /* Version of the Greybus control protocol we support */
 #define MB_CONTROL_VERSION_MAJOR              0x00
-#define MB_CONTROL_VERSION_MINOR              0x09
+#define MB_CONTROL_VERSION_MINOR              0x0a
 
 /* Greybus control request types */
 #define MB_CONTROL_TYPE_INVALID               0x00
@@ -80,6 +80,7 @@
 #define MB_CONTROL_TYPE_CURRENT_RSV           0x0d
 #define MB_CONTROL_TYPE_CURRENT_RSV_ACK       0x0e
 #define MB_CONTROL_TYPE_TEST_MODE             0x0f
+#define MB_CONTROL_TYPE_GET_MANIFEST_HASH     0x10
 
 /* Valid modes for the reboot request */
 #define MB_CONTROL_REBOOT_MODE_RESET          0x01
@@ -135,6 +136,9 @@
 #define MB_CONTROL_SUPPORT_TEST_MODE_MAJOR            0x00
 #define MB_CONTROL_SUPPORT_TEST_MODE_MINOR            0x09
 
+#define MB_CONTROL_SUPPORT_MANIFEST_HASH_MAJOR        0x00
+#define MB_CONTROL_SUPPORT_MANIFEST_HASH_MINOR        0x0a
+
 /* Version Support Macros */
 #define MB_CONTROL_SUPPORTS(mods_dev, name) \
 	((mods_dev->mb_ctrl_major > MB_CONTROL_SUPPORT_##name##_MAJOR) || \
@@ -229,5 +233,11 @@ struct mb_control_test_mode_request {
 	__le32  value;
 } __packed;
 
+/* Control protocol get manifest hash request has no payload */
+struct mb_control_get_manifest_hash_response {
+	__le16  size;
+	__le32  crc32;	/* CRC-32 (IEEE 802.3) over the full manifest */
+} __packed;
+
 
 #endif /* __MODS_PROTOCOLS_H */
@@ -15,6 +15,7 @@
 #include <linux/crc16.h>
 #include <linux/delay.h>
 #include <linux/err.h>
+#include <linux/hrtimer.h>
 #include <linux/interrupt.h>
 #include <linux/jiffies.h>
 #include <linux/module.h>
@@ -25,11 +26,14 @@
 #include <linux/platform_device.h>
 #include <linux/tty.h>
 #include <linux/tty_driver.h>
+#include <linux/workqueue.h>
 
 #include "apba.h"
+#include "mods_fault.h"
 #include "mods_nw.h"
 #include "mods_uart.h"
 #include "mods_uart_pm.h"
+#include "muc_irq_tune.h"
 #include "muc_svc.h"
 #include "mhb_protocol.h"
 
@@ -44,6 +48,14 @@ struct mods_uart_err_stats {
 	uint32_t rx_len;
 };
 
+struct mods_uart_agg_stats {
+	uint32_t tx_frames;
+	uint32_t tx_msgs;
+	uint32_t tx_lost;
+	uint32_t rx_frames;
+	uint32_t rx_msgs;
+};
+
 struct mods_uart_data {
 	struct platform_device *pdev;
 	struct tty_struct *tty;
@@ -59,6 +71,18 @@ struct mods_uart_data {
 	const char *tty_name;
 	uint8_t intf_id;
 	speed_t default_baud;
+	int uart_irq;			/* UART IRQ, 0 if not described */
+	struct muc_irq_tune irq_tune;
+
+	/* Small messages staged for the next aggregated frame */
+	struct mutex agg_lock;
+	size_t agg_max;			/* Negotiated frame size, 0 if off */
+	uint8_t agg_data[MHB_MAX_PAYLOAD_SIZE];
+	size_t agg_len;
+	unsigned int agg_count;
+	struct hrtimer agg_timer;
+	struct work_struct agg_work;
+	struct mods_uart_agg_stats agg_stats;
 };
 
 enum {
@@ -70,6 +94,13 @@ enum {
 
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 
+/* Larger messages are not worth holding back, they go out on their own */
+#define MODS_UART_AGG_MSG_MAX 128
+
+static unsigned int agg_window_us = 500;
+module_param(agg_window_us, uint, 0644);
+MODULE_PARM_DESC(agg_window_us, "Time small MHB messages wait for company");
+
 /* Found in tty_io.c */
 extern struct mutex tty_mutex;
 
@@ -89,8 +120,72 @@ static ssize_t uart_stats_show(struct device *dev,
 
 static DEVICE_ATTR_RO(uart_stats);
 
+static ssize_t uart_agg_stats_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct platform_device *pdev = to_platform_device(dev);
+	struct mods_uart_data *mud = platform_get_drvdata(pdev);
+
+	return scnprintf(buf, PAGE_SIZE,
+			 "max:%zu, tx frames:%u, tx msgs:%u, tx lost:%u, "
+			 "rx frames:%u, rx msgs:%u\n",
+			 mud->agg_max, mud->agg_stats.tx_frames,
+			 mud->agg_stats.tx_msgs, mud->agg_stats.tx_lost,
+			 mud->agg_stats.rx_frames,
+			 mud->agg_stats.rx_msgs);
+}
+
+static DEVICE_ATTR_RO(uart_agg_stats);
+
+static ssize_t uart_pm_stats_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct platform_device *pdev = to_platform_device(dev);
+	struct mods_uart_data *mud = platform_get_drvdata(pdev);
+	ssize_t ret;
+
+	/* PM data only exists while the UART is open */
+	mutex_lock(&mud->tx_mutex);
+	ret = mods_uart_pm_stats_show(mud->mods_uart_pm_data, buf);
+	mutex_unlock(&mud->tx_mutex);
+
+	return ret;
+}
+
+static DEVICE_ATTR_RO(uart_pm_stats);
+
+static ssize_t irq_cpus_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct platform_device *pdev = to_platform_device(dev);
+	struct mods_uart_data *mud = platform_get_drvdata(pdev);
+
+	return muc_irq_tune_cpus_show(&mud->irq_tune, buf);
+}
+
+static ssize_t irq_cpus_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct platform_device *pdev = to_platform_device(dev);
+	struct mods_uart_data *mud = platform_get_drvdata(pdev);
+	int ret;
+
+	if (!mud->uart_irq)
+		return -ENODEV;
+
+	ret = muc_irq_tune_cpus_store(&mud->irq_tune, buf);
+
+	return ret ? ret : count;
+}
+
+static DEVICE_ATTR_RW(irq_cpus);
+
 static struct attribute *uart_attrs[] = {
 	&dev_attr_uart_stats.attr,
+	&dev_attr_uart_agg_stats.attr,
+	&dev_attr_uart_pm_stats.attr,
+	&dev_attr_irq_cpus.attr,
 	NULL,
 };
 
@@ -170,6 +265,146 @@ send_err:
 	return -EIO;
 }
 
+/* Send the staged messages as one aggregated frame, agg_lock held */
+static int __mods_uart_agg_flush(struct mods_uart_data *mud)
+{
+	struct mhb_hdr hdr;
+	int ret;
+
+	if (!mud->agg_count)
+		return 0;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.addr = MHB_ADDR_UART;
+	hdr.type = MHB_TYPE_UART_AGG_NOT;
+
+	ret = mods_uart_send_internal(mud, &hdr, mud->agg_data, mud->agg_len,
+				      0);
+	if (ret) {
+		dev_err(&mud->pdev->dev, "%s: %u messages lost: %d\n",
+			__func__, mud->agg_count, ret);
+		mud->agg_stats.tx_lost += mud->agg_count;
+	} else {
+		mud->agg_stats.tx_frames++;
+		mud->agg_stats.tx_msgs += mud->agg_count;
+	}
+
+	mud->agg_len = 0;
+	mud->agg_count = 0;
+
+	return ret;
+}
+
+static void mods_uart_agg_flush(struct mods_uart_data *mud)
+{
+	mutex_lock(&mud->agg_lock);
+	__mods_uart_agg_flush(mud);
+	mutex_unlock(&mud->agg_lock);
+}
+
+static void mods_uart_agg_work(struct work_struct *work)
+{
+	struct mods_uart_data *mud =
+		container_of(work, struct mods_uart_data, agg_work);
+
+	mods_uart_agg_flush(mud);
+}
+
+static enum hrtimer_restart mods_uart_agg_timer(struct hrtimer *timer)
+{
+	struct mods_uart_data *mud =
+		container_of(timer, struct mods_uart_data, agg_timer);
+
+	schedule_work(&mud->agg_work);
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Stage a small message for the next aggregated frame. Returns false if
+ * the message has to be sent on its own: aggregation is off, it carries
+ * flags, is too large, or is PM/UART link control that must not wait.
+ */
+static bool mods_uart_agg_queue(struct mods_uart_data *mud,
+				struct mhb_hdr *hdr, uint8_t *buf,
+				size_t len, int flag)
+{
+	__u8 func = (hdr->addr & MHB_FUNC_MASK) >> MHB_FUNC_SHIFT;
+	size_t size = sizeof(*hdr) + len;
+	struct mhb_hdr staged;
+	size_t frame_max;
+
+	if (!mud->agg_max || flag || len > MODS_UART_AGG_MSG_MAX ||
+	    func == MHB_FUNC_PM || func == MHB_FUNC_UART)
+		return false;
+
+	mutex_lock(&mud->agg_lock);
+	if (!mud->agg_max) {
+		mutex_unlock(&mud->agg_lock);
+		return false;
+	}
+
+	frame_max = mud->agg_max - sizeof(*hdr) - MHB_CRC_SIZE;
+	if (size > frame_max) {
+		mutex_unlock(&mud->agg_lock);
+		return false;
+	}
+
+	if (mud->agg_len + size > frame_max)
+		__mods_uart_agg_flush(mud);
+
+	/* The caller's header is left alone, the length goes in the copy */
+	staged = *hdr;
+	staged.length = cpu_to_le16(size);
+	memcpy(mud->agg_data + mud->agg_len, &staged, sizeof(staged));
+	memcpy(mud->agg_data + mud->agg_len + sizeof(*hdr), buf, len);
+	mud->agg_len += size;
+
+	if (mud->agg_count++ == 0)
+		hrtimer_start(&mud->agg_timer,
+			      ktime_set(0, agg_window_us * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+	mutex_unlock(&mud->agg_lock);
+
+	return true;
+}
+
+static void mods_uart_agg_stop(struct mods_uart_data *mud)
+{
+	mutex_lock(&mud->agg_lock);
+	__mods_uart_agg_flush(mud);
+	mud->agg_max = 0;
+	mutex_unlock(&mud->agg_lock);
+
+	hrtimer_cancel(&mud->agg_timer);
+	cancel_work_sync(&mud->agg_work);
+}
+
+void mods_uart_set_agg(void *uart_data, size_t max)
+{
+	struct mods_uart_data *mud = (struct mods_uart_data *)uart_data;
+
+	if (!mud)
+		return;
+
+	max = min_t(size_t, max, MHB_MAX_MSG_SIZE);
+
+	/* Too small to hold two messages is not worth the trouble */
+	if (max < 2 * (sizeof(struct mhb_hdr) + MODS_UART_AGG_MSG_MAX) +
+		  sizeof(struct mhb_hdr) + MHB_CRC_SIZE)
+		max = 0;
+
+	if (!max) {
+		mods_uart_agg_stop(mud);
+	} else {
+		mutex_lock(&mud->agg_lock);
+		mud->agg_max = max;
+		mutex_unlock(&mud->agg_lock);
+	}
+
+	dev_info(&mud->pdev->dev, "%s: max=%zu\n", __func__, max);
+}
+
 int mods_uart_send(void *uart_data, struct mhb_hdr *hdr, uint8_t *buf,
 	size_t len, int flag)
 {
@@ -179,6 +414,14 @@ int mods_uart_send(void *uart_data, struct mhb_hdr *hdr, uint8_t *buf,
 	        hdr->addr, hdr->type, hdr->result);
 	print_hex_dump_debug("MHB TX: ", DUMP_PREFIX_OFFSET, 16, 1,
 		buf, len, true);
+
+	/* A staged message that is later lost only shows up in tx_lost */
+	if (mods_uart_agg_queue(mud, hdr, buf, len, flag))
+		return 0;
+
+	/* Keep staged messages ahead of this one */
+	mods_uart_agg_flush(mud);
+
 	return mods_uart_send_internal(mud, hdr, buf, len, flag);
 }
 
@@ -394,9 +637,14 @@ int mods_uart_open(void *uart_data)
 
 	/* Reset sysfs stat entries */
 	memset((void *)&mud->stats, 0, sizeof(struct mods_uart_err_stats));
+	memset(&mud->agg_stats, 0, sizeof(mud->agg_stats));
 
 	mud->tty = tty_tmp;
 
+	/* The UART driver holds its IRQ only while the port is open */
+	if (mud->uart_irq)
+		muc_irq_tune_attach(&mud->irq_tune, mud->uart_irq);
+
 	mods_uart_pm_on(mud);
 
 	mutex_unlock(&mud->tx_mutex);
@@ -432,6 +680,7 @@ int mods_uart_close(void *uart_data)
 	int ret;
 
 	dev_dbg(&mud->pdev->dev, "%s: closing uart\n", __func__);
+	mods_uart_agg_stop(mud);
 	mods_uart_pm_off(mud);
 
 	if (mud->mods_uart_pm_data)
@@ -446,6 +695,9 @@ int mods_uart_close(void *uart_data)
 
 	dev_dbg(&mud->pdev->dev, "%s: really closing\n", __func__);
 
+	if (mud->uart_irq)
+		muc_irq_tune_detach(&mud->irq_tune);
+
 	if (tty_set_ldisc(mud->tty, N_TTY))
 		dev_err(&mud->pdev->dev, "%s: Failed to set ldisc\n", __func__);
 
@@ -530,8 +782,21 @@ static int mods_uart_probe(struct platform_device *pdev)
 		return PTR_ERR(mud->pinctrl_state_active);
 	}
 
+	/*
+	 * Optionally the node repeats the UART's interrupt so its affinity
+	 * can be steered along with the other link IRQs.
+	 */
+	mud->uart_irq = irq_of_parse_and_map(np, 0);
+	muc_irq_tune_init(&mud->irq_tune);
+
 	mutex_init(&mud->tx_mutex);
 
+	/* Off until the APBA agrees to it */
+	mutex_init(&mud->agg_lock);
+	hrtimer_init(&mud->agg_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	mud->agg_timer.function = mods_uart_agg_timer;
+	INIT_WORK(&mud->agg_work, mods_uart_agg_work);
+
 	ret = sysfs_create_groups(&pdev->dev.kobj, uart_groups);
 	if (ret) {
 		dev_err(&pdev->dev, "Failed to create sysfs attributes\n");
@@ -579,6 +844,43 @@ static struct platform_driver mods_uart_driver = {
 	},
 };
 
+/* Hand each message of an aggregated frame to the APBA driver */
+static void mods_uart_consume_agg(struct mods_uart_data *mud,
+				  uint8_t *data, size_t len)
+{
+	struct device *dev = &mud->pdev->dev;
+	struct mhb_hdr *hdr;
+	size_t size;
+
+	mud->agg_stats.rx_frames++;
+
+	while (len) {
+		hdr = (struct mhb_hdr *)data;
+		if (len < sizeof(*hdr))
+			size = 0;
+		else
+			size = le16_to_cpu(hdr->length);
+
+		if (size < sizeof(*hdr) || size > len) {
+			mud->stats.rx_len++;
+			dev_err(dev, "%s: invalid len %zd of %zd\n", __func__,
+				size, len);
+			return;
+		}
+
+		pr_debug("MHB RX: addr=%x, type=%x, result=%x, len=%zd\n",
+			hdr->addr, hdr->type, hdr->result, size);
+		print_hex_dump_debug("MHB RX: ", DUMP_PREFIX_OFFSET, 16, 1,
+			data + sizeof(*hdr), size - sizeof(*hdr), true);
+		apba_handle_message(hdr, data + sizeof(*hdr),
+				    size - sizeof(*hdr));
+
+		mud->agg_stats.rx_msgs++;
+		data += size;
+		len -= size;
+	}
+}
+
 static int mods_uart_consume_segment(struct mods_uart_data *mud)
 {
 	struct device *dev = &mud->pdev->dev;
@@ -610,7 +912,8 @@ static int mods_uart_consume_segment(struct mods_uart_data *mud)
 
 	rcvd_crc = (uint16_t *)&mud->rx_data[content_size];
 	calc_crc = crc16(0, (uint8_t *) mud->rx_data, content_size);
-	if (le16_to_cpu(*rcvd_crc) != calc_crc) {
+	if (le16_to_cpu(*rcvd_crc) != calc_crc ||
+	    mods_fault_inject(MODS_FAULT_CRC)) {
 		mud->stats.rx_crc++;
 		print_hex_dump_debug("RX (CRC error): ", DUMP_PREFIX_OFFSET,
 			16, 1, mud->rx_data, content_size, true);
@@ -625,6 +928,13 @@ static int mods_uart_consume_segment(struct mods_uart_data *mud)
 		 */
 		mud->rx_len = 0;
 		return 0;
+	} else if (mods_fault_inject(MODS_FAULT_DROP)) {
+		dev_dbg(dev, "%s: segment dropped\n", __func__);
+	} else if (hdr->addr == MHB_ADDR_UART &&
+		   hdr->type == MHB_TYPE_UART_AGG_NOT) {
+		payload = ((uint8_t *)mud->rx_data) + sizeof(*hdr);
+		mods_uart_consume_agg(mud, payload,
+				      content_size - sizeof(*hdr));
 	} else {
 		payload = ((uint8_t *)mud->rx_data) + sizeof(*hdr);
 		pr_debug("MHB RX: addr=%x, type=%x, result=%x, len=%zd\n",
@@ -31,6 +31,8 @@ int mods_uart_get_baud(void *uart_data);
 /* Lock the UART while setting the baud. */
 void mods_uart_lock_tx(void *uart_data, bool lock);
 int mods_uart_set_baud(void *uart_data, uint32_t baud);
+/* Aggregate small messages into frames of up to max bytes, 0 disables. */
+void mods_uart_set_agg(void *uart_data, size_t max);
 
 /* Driver Initializations */
 int mods_uart_init(void);
@@ -11,8 +11,12 @@
  * GNU General Public License for more details.
  */
 
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
 #include <linux/mutex.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/timer.h>
 #include <linux/workqueue.h>
 
@@ -21,6 +25,47 @@
 #include "mods_uart_pm.h"
 #include "mhb_protocol.h"
 
+#define MODS_UART_PM_HANDSHAKE_TIMEOUT	1000 /* ms */
+#define MODS_UART_PM_IDLE_TIMEOUT	2000 /* msec, until traffic is learned */
+#define MODS_UART_PM_IDLE_MIN		32 /* msec */
+#define MODS_UART_PM_IDLE_MAX		4096 /* msec */
+/*
+ * Idle awake link time one unit of wake handshake time is worth. During
+ * a handshake the AP and APBA are both resuming and driving the wake
+ * line, which costs far more than keeping an idle UART on.
+ */
+#define MODS_UART_PM_WAKE_WEIGHT	64
+
+/*
+ * Inter-arrival gaps are kept in a log2 histogram, bucket i holding gaps
+ * in [GAP_MIN << i, GAP_MIN << (i + 1)) and the last bucket everything
+ * above. Shorter gaps are part of the same burst and are not recorded.
+ */
+#define PM_GAP_MIN		16 /* msec */
+#define PM_GAP_BUCKETS		10
+#define PM_GAP_WARMUP		8 /* samples before the histogram is used */
+#define PM_GAP_DECAY		64 /* halve the histogram every N samples */
+#define PM_EWMA_SHIFT		3
+
+struct mods_uart_pm_predictor {
+	u32 hist[PM_GAP_BUCKETS];
+	u64 sum[PM_GAP_BUCKETS];	/* msec, total of the gaps in hist */
+	u32 samples;
+	u32 gap_ewma;		/* msec */
+	u32 handshake_ewma;	/* usec */
+	u32 timeout;		/* msec */
+};
+
+struct mods_uart_pm_stats {
+	u32 wake_handshakes;
+	u32 wake_timeouts;
+	u32 handshake_max;	/* usec */
+	u32 sleep_reqs;
+	u32 local_sleeps;
+	u64 awake_ms;
+	u64 asleep_ms;
+};
+
 struct mods_uart_pm_data {
 	void *mods_uart_data;
 	bool on;
@@ -30,20 +75,121 @@ struct mods_uart_pm_data {
 	struct completion pm_handshake_comp;
 	struct work_struct idle_timer_work;
 	struct timer_list idle_timer;
+	spinlock_t predictor_lock;	/* protects predictor and last_activity */
+	struct mods_uart_pm_predictor predictor;
+	ktime_t last_activity;
+	ktime_t last_transition;
+	struct mods_uart_pm_stats stats;
 };
 
-#define MODS_UART_PM_HANDSHAKE_TIMEOUT	1000 /* ms */
-#define MODS_UART_PM_IDLE_TIMEOUT	2000 /* msec */
+static u32 pm_ewma(u32 avg, u32 sample)
+{
+	if (!avg)
+		return sample;
+
+	return avg - (avg >> PM_EWMA_SHIFT) + (sample >> PM_EWMA_SHIFT);
+}
+
+/*
+ * Pick the idle timeout minimising the expected cost over the recorded
+ * gaps: a gap shorter than the timeout costs its length in awake time,
+ * a longer one costs the timeout plus a handshake. Timeouts are bucket
+ * edges, so the gaps below one are exactly those of the lower buckets.
+ * The fixed timeout stays until a handshake latency has been measured.
+ */
+static void pm_predictor_update_timeout(struct mods_uart_pm_predictor *p)
+{
+	u64 best_cost = U64_MAX;
+	u64 wake_cost;
+	u32 timeout;
+	int i;
+	int j;
+
+	if (p->samples < PM_GAP_WARMUP || !p->handshake_ewma) {
+		p->timeout = MODS_UART_PM_IDLE_TIMEOUT;
+		return;
+	}
+
+	wake_cost = div_u64((u64)p->handshake_ewma * MODS_UART_PM_WAKE_WEIGHT,
+			    USEC_PER_MSEC);
+
+	for (i = 0; i < PM_GAP_BUCKETS - 1; i++) {
+		u64 cost = 0;
+
+		timeout = PM_GAP_MIN << (i + 1);
+		if (timeout > MODS_UART_PM_IDLE_MAX)
+			break;
+
+		for (j = 0; j < PM_GAP_BUCKETS; j++) {
+			if (j <= i)
+				cost += p->sum[j];
+			else
+				cost += (u64)p->hist[j] * (timeout + wake_cost);
+		}
+
+		if (cost < best_cost) {
+			best_cost = cost;
+			p->timeout = max_t(u32, timeout, MODS_UART_PM_IDLE_MIN);
+		}
+	}
+}
+
+static void pm_predictor_add_gap(struct mods_uart_pm_predictor *p, u32 gap)
+{
+	int i;
+
+	if (gap < PM_GAP_MIN)
+		return;
+
+	i = min_t(int, ilog2(gap / PM_GAP_MIN), PM_GAP_BUCKETS - 1);
+	p->hist[i]++;
+	p->sum[i] += gap;
+	p->gap_ewma = pm_ewma(p->gap_ewma, gap);
+
+	if (!(++p->samples % PM_GAP_DECAY))
+		for (i = 0; i < PM_GAP_BUCKETS; i++) {
+			p->hist[i] >>= 1;
+			p->sum[i] >>= 1;
+		}
+
+	pm_predictor_update_timeout(p);
+}
+
+static void pm_predictor_reset(struct mods_uart_pm_predictor *p)
+{
+	memset(p, 0, sizeof(*p));
+	p->timeout = MODS_UART_PM_IDLE_TIMEOUT;
+}
+
+static void mods_uart_pm_arm_idle_timer(struct mods_uart_pm_data *data)
+{
+	mod_timer(&data->idle_timer,
+		  jiffies + msecs_to_jiffies(data->predictor.timeout));
+}
 
+/* Record link activity and re-arm the idle timer with the predicted
+ * timeout.
+ */
 void mods_uart_pm_update_idle_timer(void *uart_pm_data)
 {
 	struct mods_uart_pm_data *data =
 		(struct mods_uart_pm_data *)uart_pm_data;
+	unsigned long flags;
+	ktime_t now;
 
-	if (data && data->on)
-		mod_timer(&data->idle_timer,
-			  jiffies +
-			    msecs_to_jiffies(MODS_UART_PM_IDLE_TIMEOUT));
+	if (!data || !data->on)
+		return;
+
+	now = ktime_get();
+
+	spin_lock_irqsave(&data->predictor_lock, flags);
+	pm_predictor_add_gap(&data->predictor,
+		min_t(s64, ktime_to_ms(ktime_sub(now, data->last_activity)),
+		      U32_MAX));
+	data->last_activity = now;
+	spin_unlock_irqrestore(&data->predictor_lock, flags);
+
+	mods_uart_pm_arm_idle_timer(data);
 }
 
 static void idle_timer_callback(unsigned long timer_data)
@@ -98,6 +244,9 @@ void mods_uart_pm_handle_wake_interrupt(void *uart_data)
  */
 static void local_pm_update(struct mods_uart_pm_data *data, bool on)
 {
+	ktime_t now;
+	u64 delta;
+
 	/* No action if state remain unchanged. */
 	if (data->pm_state_local == on)
 		return;
@@ -105,6 +254,17 @@ static void local_pm_update(struct mods_uart_pm_data *data, bool on)
 	if (mods_uart_do_pm(data->mods_uart_data, on))
 		return;
 
+	now = ktime_get();
+	delta = ktime_to_ms(ktime_sub(now, data->last_transition));
+	if (data->pm_state_local)
+		data->stats.awake_ms += delta;
+	else
+		data->stats.asleep_ms += delta;
+	data->last_transition = now;
+
+	if (!on)
+		data->stats.local_sleeps++;
+
 	data->pm_state_local = on;
 }
 
@@ -113,6 +273,10 @@ static void local_pm_update(struct mods_uart_pm_data *data, bool on)
  */
 static void apba_pm_wake_handshake(struct mods_uart_pm_data *data)
 {
+	unsigned long flags;
+	ktime_t start;
+	u32 latency;
+
 	pr_debug("%s: wake handshake\n", __func__);
 	if (data && data->on) {
 		mutex_lock(&data->pm_handshake_mutex);
@@ -120,6 +284,9 @@ static void apba_pm_wake_handshake(struct mods_uart_pm_data *data)
 		/* must reinit because the interrupt can call complete */
 		reinit_completion(&data->pm_handshake_comp);
 
+		data->stats.wake_handshakes++;
+		start = ktime_get();
+
 		/* Wake INT then wait for an ack message. */
 		apba_wake_assert(true);
 
@@ -128,6 +295,17 @@ static void apba_pm_wake_handshake(struct mods_uart_pm_data *data)
 			 msecs_to_jiffies(MODS_UART_PM_HANDSHAKE_TIMEOUT))) {
 			pr_err("%s: WAKE HANDSHAKE () timeout\n", __func__);
 			apba_wake_assert(false);
+			data->stats.wake_timeouts++;
+		} else {
+			latency = ktime_to_us(ktime_sub(ktime_get(), start));
+			data->stats.handshake_max =
+				max(data->stats.handshake_max, latency);
+
+			spin_lock_irqsave(&data->predictor_lock, flags);
+			data->predictor.handshake_ewma =
+				pm_ewma(data->predictor.handshake_ewma,
+					latency);
+			spin_unlock_irqrestore(&data->predictor_lock, flags);
 		}
 
 		mutex_unlock(&data->pm_handshake_mutex);
@@ -191,8 +369,17 @@ void mods_uart_pm_post_tx(void *uart_pm_data, int flag)
 
 	data = (struct mods_uart_pm_data *)uart_pm_data;
 	if (data && data->on) {
-		if (flag == UART_PM_FLAG_SLEEP_IND)
+		/* PM handshake messages are not traffic for the predictor */
+		if (flag == UART_PM_FLAG_SLEEP_IND) {
 			atomic_set(&data->pm_state_remote, 0);
+			mods_uart_pm_arm_idle_timer(data);
+			return;
+		}
+
+		if (flag == UART_PM_FLAG_SLEEP_ACK) {
+			mods_uart_pm_arm_idle_timer(data);
+			return;
+		}
 
 		mods_uart_pm_update_idle_timer(data);
 	}
@@ -220,7 +407,9 @@ static void idle_timeout_work_func(struct work_struct *work)
 	}
 
 	if (apba_send_pm_sleep_req())
-		mods_uart_pm_update_idle_timer(data);
+		mods_uart_pm_arm_idle_timer(data);
+	else
+		data->stats.sleep_reqs++;
 }
 
 void mods_uart_pm_handle_pm_wake_rsp(void *uart_data)
@@ -276,6 +465,11 @@ void *mods_uart_pm_initialize(void *uart_data)
 	mutex_init(&data->pm_handshake_mutex);
 	init_completion(&data->pm_handshake_comp);
 
+	spin_lock_init(&data->predictor_lock);
+	pm_predictor_reset(&data->predictor);
+	data->last_activity = ktime_get();
+	data->last_transition = data->last_activity;
+
 	INIT_WORK(&data->idle_timer_work, idle_timeout_work_func);
 
 	setup_timer(&data->idle_timer, idle_timer_callback,
@@ -300,3 +494,40 @@ void mods_uart_pm_uninitialize(void *uart_pm_data)
 {
 	kfree(uart_pm_data);
 }
+
+ssize_t mods_uart_pm_stats_show(void *uart_pm_data, char *buf)
+{
+	struct mods_uart_pm_data *data;
+	struct mods_uart_pm_predictor p;
+	struct mods_uart_pm_stats stats;
+	unsigned long flags;
+	u64 delta;
+
+	data = (struct mods_uart_pm_data *)uart_pm_data;
+	if (!data)
+		return scnprintf(buf, PAGE_SIZE, "closed\n");
+
+	spin_lock_irqsave(&data->predictor_lock, flags);
+	p = data->predictor;
+	spin_unlock_irqrestore(&data->predictor_lock, flags);
+
+	/* Account for the time spent in the current state */
+	stats = data->stats;
+	delta = ktime_to_ms(ktime_sub(ktime_get(), data->last_transition));
+	if (data->pm_state_local)
+		stats.awake_ms += delta;
+	else
+		stats.asleep_ms += delta;
+
+	return scnprintf(buf, PAGE_SIZE,
+			 "idle_timeout_ms:%u gap_ewma_ms:%u samples:%u\n"
+			 "wakes:%u wake_timeouts:%u sleep_reqs:%u "
+			 "local_sleeps:%u\n"
+			 "handshake_ewma_us:%u handshake_max_us:%u\n"
+			 "awake_ms:%llu asleep_ms:%llu\n",
+			 p.timeout, p.gap_ewma, p.samples,
+			 stats.wake_handshakes, stats.wake_timeouts,
+			 stats.sleep_reqs, stats.local_sleeps,
+			 p.handshake_ewma, stats.handshake_max,
+			 stats.awake_ms, stats.asleep_ms);
+}
@@ -14,6 +14,8 @@
 #ifndef __MODS_UART_PM_H__
 #define __MODS_UART_PM_H__
 
+#include <linux/types.h>
+
 #define UART_PM_FLAG_WAKE_ACK 1
 #define UART_PM_FLAG_SLEEP_ACK 2
 #define UART_PM_FLAG_SLEEP_IND 3
@@ -33,4 +35,6 @@ void mods_uart_pm_uninitialize(void *uart_pm_data);
 
 void mods_uart_pm_handle_pm_wake_rsp(void *uart_data);
 
+ssize_t mods_uart_pm_stats_show(void *uart_pm_data, char *buf);
+
 #endif  /* __MODS_UART__PM_H__ */
@@ -161,6 +161,7 @@ void muc_intr_destroy(struct muc_data *cdata, struct device *dev);
 void muc_simulate_reset(void);
 void muc_soft_reset(void);
 bool muc_core_probed(void);
+bool muc_spi_shared_with_flash(void);
 void muc_enable_det(void);
 void muc_register_spi(void);
 void muc_register_spi_flash(void);
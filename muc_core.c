@@ -46,6 +46,11 @@ bool muc_core_probed(void)
 	return !!muc_misc_data;
 }
 
+bool muc_spi_shared_with_flash(void)
+{
+	return muc_misc_data && muc_misc_data->spi_shared_with_flash;
+}
+
 static int muc_probe(struct platform_device *pdev)
 {
 	struct muc_data *ps_muc;
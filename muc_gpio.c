@@ -664,7 +664,8 @@ int muc_gpio_init(struct device *dev, struct muc_data *cdata)
 	int ret;
 
 	INIT_DELAYED_WORK(&cdata->isr_work.work, attach_work);
-	cdata->attach_wq = alloc_workqueue("muc_attach", WQ_UNBOUND, 1);
+	cdata->attach_wq = alloc_workqueue("muc_attach",
+					    WQ_UNBOUND | WQ_SYSFS, 1);
 	if (!cdata->attach_wq) {
 		dev_err(dev, "Failed to create attach workqueue\n");
 		return -ENOMEM;
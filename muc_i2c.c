@@ -14,22 +14,30 @@
  */
 
 #include <linux/crc16.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/err.h>
 #include <linux/interrupt.h>
 #include <linux/i2c.h>
+#include <linux/log2.h>
 #include <linux/module.h>
 #include <linux/of_gpio.h>
 #include <linux/of_irq.h>
+#include <linux/pm_runtime.h>
 
 #include "greybus.h"
 
+#include "mods_fault.h"
 #include "mods_nw.h"
 #include "muc.h"
+#include "muc_irq_tune.h"
 #include "muc_svc.h"
 
 /* Protocol version supported by this driver */
-#define PROTO_VER               (1)
+#define PROTO_VER               (2)
+
+/* Protocol version change log */
+#define PROTO_VER_PKT_CLASS     (2) /* Version that added packet classes */
 
 #define MSG_TYPE_DL    (0 << 6)     /* Packet for/from data link layer */
 #define MSG_TYPE_NW    (1 << 6)     /* Packet for/from network layer */
@@ -63,6 +71,20 @@
 #define MSG_TYPE_DL    (0 << 6)     /* Packet for/from data link layer */
 #define MSG_TYPE_NW    (1 << 6)     /* Packet for/from network layer */
 
+/* Possible values for bus config features */
+#define DL_BIT_CLASS   (1 << 1)     /* Flag to indicate pkt classes support */
+
+/*
+ * Packet size classes. When both sides support them, writes to the MuC are
+ * sized to the smallest power-of-two payload (from the default up to the
+ * negotiated payload size) that holds the datagram. The MuC sees the length
+ * of each write, so no extra signalling is needed. Reads are always done at
+ * the negotiated packet size.
+ */
+#define PKT_CLASS_PL_MIN        PL_SIZE(DEFAULT_PKT_SZ)
+#define PKT_CLASS_MAX           (8)
+#define PKT_CLASS_PL_SIZE(c)    (PKT_CLASS_PL_MIN << (c))
+
 /* I2C packet CRC size (in bytes) */
 #define CRC_SIZE       (2)
 
@@ -81,6 +103,9 @@
 #define RDY_TIMEOUT_JIFFIES     (HZ /  4) /* 250 milliseconds */
 #define ACK_TIMEOUT_JIFFIES     (HZ / 10) /* 100 milliseconds */
 
+/* Idle time before the link lets the I2C controller runtime suspend */
+#define AUTOSUSPEND_DELAY_MS    (100)
+
 /* The number of times to try sending a datagram to the MuC */
 #define NUM_TRIES      (3)
 
@@ -117,8 +142,11 @@ struct muc_i2c_data {
 	struct work_struct attach_work;    /* Worker to send attach to SVC */
 
 	size_t pkt_size;                   /* Size of hdr + pl + CRC in bytes */
+	bool pkt_classes;                  /* Smaller write classes allowed */
 
 	__u8 *tx_pkt;                      /* Buffer for transmit packets */
+	size_t tx_pkt_size;                /* Write size for current datagram */
+	unsigned int tx_class;             /* Packet class of tx_pkt_size */
 	__u8 *tx_datagram;                 /* Buffer for transmit datagram */
 	uint32_t tx_datagram_ndx;          /* Index into transmit datagram */
 	uint8_t tx_pkts_remaining;         /* Packets needed to complete msg */
@@ -132,6 +160,23 @@ struct muc_i2c_data {
 	size_t rx_datagram_len;            /* bytes */
 	bool rx_ack_pending;               /* received pkt needs ack */
 	bool rx_first_pkt_rcvd;            /* first pkt of datagram received */
+
+	bool suspended;                    /* Link parked for system suspend */
+	bool irq_masked;                   /* IRQ disabled by suspend */
+	wait_queue_head_t resume_wq;       /* Senders waiting for resume */
+	ktime_t resume_time;               /* Set until first xfer on resume */
+	struct muc_irq_tune irq_tune;      /* IRQ affinity and thread priority */
+
+	/* Statistics below */
+	struct dentry *stats_dentry;       /* Debugfs entry */
+	uint32_t class_writes[PKT_CLASS_MAX]; /* Writes per packet class */
+	uint64_t wire_bytes;               /* Bytes written and read */
+	uint64_t payload_bytes;            /* Valid payload bytes written */
+	uint32_t suspends;                 /* System suspends while present */
+	uint32_t suspend_acks;             /* RX ACKs flushed on suspend */
+	uint32_t rpm_resumes;              /* Runtime resumes of the link */
+	uint32_t resume_us_last;           /* Resume to first xfer done */
+	uint32_t resume_us_max;
 };
 
 struct i2c_msg_hdr {
@@ -169,6 +214,8 @@ size_t muc_i2c_get_pkt_sz(size_t pl_size)
 	return PKT_SIZE(pl_size);
 }
 
+static int muc_i2c_runtime_suspend(struct device *dev);
+
 static inline struct muc_i2c_data *dld_to_dd(struct mods_dl_device *dld)
 {
 	return (struct muc_i2c_data *)dld->dl_priv;
@@ -185,14 +232,69 @@ static inline bool check_rx_pkt_crc(struct muc_i2c_data *dd)
 	return crc == *snt_crc;
 }
 
-static inline void set_tx_pkt_crc(struct muc_i2c_data *dd)
+static inline void set_tx_pkt_crc(struct muc_i2c_data *dd, size_t pkt_size)
 {
-	uint16_t *crc = (uint16_t *)&dd->tx_pkt[CRC_NDX(dd->pkt_size)];
+	uint16_t *crc = (uint16_t *)&dd->tx_pkt[CRC_NDX(pkt_size)];
 
-	*crc = crc16(0, dd->tx_pkt, CRC_NDX(dd->pkt_size));
+	*crc = crc16(0, dd->tx_pkt, CRC_NDX(pkt_size));
 	*crc = cpu_to_le16(*crc);
 }
 
+/* Smallest packet class whose payload holds len bytes (or the largest) */
+static unsigned int pkt_class_for(struct muc_i2c_data *dd, size_t len)
+{
+	unsigned int c = 0;
+
+	if (!dd->pkt_classes)
+		return 0;
+
+	while (c < PKT_CLASS_MAX - 1 && PKT_CLASS_PL_SIZE(c) < len &&
+	       PKT_CLASS_PL_SIZE(c) < PL_SIZE(dd->pkt_size))
+		c++;
+
+	return c;
+}
+
+static inline size_t pkt_class_size(struct muc_i2c_data *dd, unsigned int c)
+{
+	if (!dd->pkt_classes)
+		return dd->pkt_size;
+
+	return PKT_SIZE(PKT_CLASS_PL_SIZE(c));
+}
+
+/* Called with dd->mutex held, returns with it held once resumed */
+static void muc_i2c_wait_resumed(struct muc_i2c_data *dd)
+{
+	while (dd->suspended) {
+		mutex_unlock(&dd->mutex);
+		wait_event(dd->resume_wq, !dd->suspended);
+		mutex_lock(&dd->mutex);
+	}
+}
+
+static void muc_i2c_xfer_begin(struct muc_i2c_data *dd)
+{
+	pm_stay_awake(&dd->client->dev);
+	pm_runtime_get_sync(&dd->client->dev);
+}
+
+static void muc_i2c_xfer_end(struct muc_i2c_data *dd, int ret)
+{
+	uint32_t us;
+
+	if (ret >= 0 && ktime_to_ns(dd->resume_time)) {
+		us = ktime_to_us(ktime_sub(ktime_get(), dd->resume_time));
+		dd->resume_us_last = us;
+		dd->resume_us_max = max(dd->resume_us_max, us);
+		dd->resume_time = ktime_set(0, 0);
+	}
+
+	pm_runtime_mark_last_busy(&dd->client->dev);
+	pm_runtime_put_autosuspend(&dd->client->dev);
+	pm_relax(&dd->client->dev);
+}
+
 static int set_packet_size(struct muc_i2c_data *dd, size_t pkt_size)
 {
 	struct device *dev = &dd->client->dev;
@@ -207,6 +309,7 @@ static int set_packet_size(struct muc_i2c_data *dd, size_t pkt_size)
 
 	/* Save the new packet size */
 	dd->pkt_size = pkt_size;
+	dd->tx_pkt_size = pkt_size;
 
 	dev_info(dev, "Packet size is %zu bytes\n", pkt_size);
 
@@ -252,6 +355,15 @@ static int dl_recv(struct mods_dl_device *dld)
 		}
 	}
 
+	dd->pkt_classes = (msg->bus_resp.features & DL_BIT_CLASS) &&
+			  msg->bus_resp.version >= PROTO_VER_PKT_CLASS &&
+			  dd->pkt_size > DEFAULT_PKT_SZ &&
+			  PL_SIZE(dd->pkt_size) <=
+				PKT_CLASS_PL_SIZE(PKT_CLASS_MAX - 1);
+
+	dev_info(dev, "proto_ver=%d, pkt_classes=%d\n",
+		 msg->bus_resp.version, dd->pkt_classes);
+
 	/* Schedule work to send attach to SVC */
 	schedule_work(&dd->attach_work);
 
@@ -306,8 +418,9 @@ static int muc_i2c_read(struct muc_i2c_data *dd)
 	}
 
 	ret = i2c_transfer(dd->client->adapter, msg, 1);
+	dd->wire_bytes += dd->pkt_size;
 
-	if (!check_rx_pkt_crc(dd)) {
+	if (!check_rx_pkt_crc(dd) || mods_fault_inject(MODS_FAULT_CRC)) {
 		dev_err(&dd->client->dev, "CRC mismatch\n");
 		ret = -EIO;
 	}
@@ -315,17 +428,17 @@ out:
 	return ret;
 }
 
-static int muc_i2c_write(struct muc_i2c_data *dd)
+static int muc_i2c_write(struct muc_i2c_data *dd, size_t pkt_size)
 {
 	struct i2c_msg msg[1];
 	int ret;
 
 	msg[0].addr = dd->client->addr;
 	msg[0].flags = dd->client->flags;
-	msg[0].len = dd->pkt_size;
+	msg[0].len = pkt_size;
 	msg[0].buf = dd->tx_pkt;
 
-	set_tx_pkt_crc(dd);
+	set_tx_pkt_crc(dd, pkt_size);
 
 	/* Wait for RDY to be asserted */
 	WAIT_WHILE((ret = muc_gpio_get_ready_n()), RDY_TIMEOUT_JIFFIES, dd);
@@ -336,6 +449,9 @@ static int muc_i2c_write(struct muc_i2c_data *dd)
 	}
 
 	ret = i2c_transfer(dd->client->adapter, msg, 1);
+	dd->wire_bytes += pkt_size;
+	if (ret >= 0 && mods_fault_inject(MODS_FAULT_DROP))
+		ret = -EIO;
 
 out:
 	return ret;
@@ -351,24 +467,28 @@ int muc_i2c_transfer(struct muc_i2c_data *dd, __u16 msg_type)
 	int num_tries_remaining = NUM_TRIES;
 	int num_ack_tries_remaining = NUM_TRIES;
 	bool rx_valid = false;
+	size_t write_size = pkt_class_size(dd, 0);
+	size_t tx_pl_size = PL_SIZE(dd->tx_pkt_size);
 
 	tx_msg->hdr.bitmask = msg_type;
 
 	if (dd->tx_pkts_remaining) {
 		size_t remaining = dd->tx_datagram_len - dd->tx_datagram_ndx;
-		uint8_t pkts_total = (dd->tx_datagram_len / dd->pkt_size) +
-			((dd->tx_datagram_len % dd->pkt_size) > 0);
+		uint8_t pkts_total = (dd->tx_datagram_len / tx_pl_size) +
+			((dd->tx_datagram_len % tx_pl_size) > 0);
 		tx_msg->hdr.bitmask |= HDR_BIT_VALID;
 		tx_msg->hdr.bitmask |= dd->tx_pkts_remaining - 1;
 		if (pkts_total == dd->tx_pkts_remaining)
 			tx_msg->hdr.bitmask |= HDR_BIT_PKT1;
 		memcpy(&tx_msg->data[0], &dd->tx_datagram[dd->tx_datagram_ndx],
-		       MIN(remaining, dd->pkt_size));
+		       MIN(remaining, tx_pl_size));
 
+		write_size = dd->tx_pkt_size;
 		do_write = true;
 	}
 
 	if (dd->rx_ack_pending) {
+		/* ACK-only writes use the smallest packet class */
 		tx_msg->hdr.bitmask |= HDR_BIT_ACK;
 		if (dd->tx_pkts_remaining == 0)
 			tx_msg->hdr.bitmask |= HDR_BIT_DUMMY;
@@ -380,7 +500,7 @@ retry_write:
 		if (muc_gpio_get_wake_n())
 			muc_gpio_set_wake_n(0);     /* Assert WAKE */
 
-		cnt = muc_i2c_write(dd);
+		cnt = muc_i2c_write(dd, write_size);
 		if (cnt < 0) {
 			dev_err(&dd->client->dev, "I2C write error %d\n", cnt);
 			muc_gpio_set_wake_n(1);     /* Deassert WAKE */
@@ -439,11 +559,15 @@ retry_read:
 
 		if ((dd->tx_ack_pending) &&
 				(le16_to_cpu(rx_msg->hdr.bitmask) &
-				HDR_BIT_ACK)) {
+				HDR_BIT_ACK) &&
+				!mods_fault_inject(MODS_FAULT_ACK)) {
 			/* STATE: Expected an ACK
 					- Got an ACK pkt send is complete */
 			dd->tx_ack_pending = false;
-			dd->tx_datagram_ndx += PL_SIZE(dd->pkt_size);
+			dd->class_writes[dd->tx_class]++;
+			dd->payload_bytes += MIN(tx_pl_size,
+				dd->tx_datagram_len - dd->tx_datagram_ndx);
+			dd->tx_datagram_ndx += tx_pl_size;
 			dd->tx_pkts_remaining--;
 
 			if (dd->tx_pkts_remaining == 0) {
@@ -494,13 +618,16 @@ static int __muc_i2c_message_send(struct muc_i2c_data *dd, __u16 msg_type,
 	int ret = 0;
 
 	mutex_lock(&dd->mutex);
-	pm_stay_awake(&dd->client->dev);
+	muc_i2c_wait_resumed(dd);
+	muc_i2c_xfer_begin(dd);
 
 	/* setup structure values for tx datagrams */
+	dd->tx_class = pkt_class_for(dd, len);
+	dd->tx_pkt_size = pkt_class_size(dd, dd->tx_class);
 	dd->tx_datagram_len = len;
 	memcpy(dd->tx_datagram, data, len);
-	dd->tx_pkts_remaining = (len / dd->pkt_size) +
-			((len % dd->pkt_size) > 0);
+	dd->tx_pkts_remaining = (len / PL_SIZE(dd->tx_pkt_size)) +
+			((len % PL_SIZE(dd->tx_pkt_size)) > 0);
 	dd->tx_ack_pending = false;
 	dd->tx_datagram_ndx = 0;
 
@@ -513,7 +640,7 @@ static int __muc_i2c_message_send(struct muc_i2c_data *dd, __u16 msg_type,
 		}
 	}
 
-	pm_relax(&dd->client->dev);
+	muc_i2c_xfer_end(dd, ret);
 	mutex_unlock(&dd->mutex);
 
 	return ret;
@@ -533,12 +660,15 @@ static int muc_i2c_message_send(struct mods_dl_device *dld,
 static irqreturn_t muc_i2c_isr(int irq, void *data)
 {
 	struct muc_i2c_data *dd = data;
+	int ret = 0;
+
+	muc_irq_tune_thread(&dd->irq_tune);
 
 	mutex_lock(&dd->mutex);
-	pm_stay_awake(&dd->client->dev);
+	muc_i2c_xfer_begin(dd);
 
 	while (dd->present && (!muc_gpio_get_int_n() || (dd->rx_ack_pending))) {
-		int ret = muc_i2c_transfer(dd, 0);
+		ret = muc_i2c_transfer(dd, 0);
 
 		if (ret < 0) {
 			dev_err(&dd->client->dev, "i2c failed me\n");
@@ -546,9 +676,13 @@ static irqreturn_t muc_i2c_isr(int irq, void *data)
 		}
 	}
 
-	pm_relax(&dd->client->dev);
+	muc_i2c_xfer_end(dd, ret);
 	mutex_unlock(&dd->mutex);
 
+	/* Run the handler again as if the MuC had pulsed INT */
+	if (mods_fault_inject(MODS_FAULT_INT))
+		irq_wake_thread(irq, dd);
+
 	return IRQ_HANDLED;
 }
 
@@ -562,6 +696,7 @@ static int _muc_i2c_negotiate(struct muc_i2c_data *dd)
 	memset(&msg, 0, sizeof(msg));
 	msg.id = DL_MSG_ID_BUS_CFG_REQ;
 	msg.bus_req.max_pl_size = U16_MAX;
+	msg.bus_req.features = DL_BIT_CLASS;
 	msg.bus_req.version = PROTO_VER;
 
 	do {
@@ -600,6 +735,7 @@ static int muc_attach(struct notifier_block *nb,
 				goto set_missing;
 			}
 
+			muc_irq_tune_attach(&dd->irq_tune, client->irq);
 			enable_irq_wake(client->irq);
 
 			/* First step after attach is to negotiate bus config */
@@ -611,7 +747,9 @@ static int muc_attach(struct notifier_block *nb,
 			}
 		} else {
 			disable_irq_wake(client->irq);
+			muc_irq_tune_detach(&dd->irq_tune);
 			devm_free_irq(&client->dev, client->irq, dd);
+			dd->irq_masked = false;
 
 			flush_work(&dd->attach_work);
 			if (dd->attached) {
@@ -621,6 +759,11 @@ static int muc_attach(struct notifier_block *nb,
 
 			/* Reset bus settings to default values */
 			set_packet_size(dd, DEFAULT_PKT_SZ);
+			dd->pkt_classes = false;
+			dd->tx_class = 0;
+			memset(dd->class_writes, 0, sizeof(dd->class_writes));
+			dd->wire_bytes = 0;
+			dd->payload_bytes = 0;
 			dd->rx_datagram_ndx = 0;
 			dd->rx_datagram_len = 0;
 			dd->rx_pkts_remaining = 0;
@@ -636,6 +779,7 @@ static int muc_attach(struct notifier_block *nb,
 
 free_irq:
 	disable_irq_wake(client->irq);
+	muc_irq_tune_detach(&dd->irq_tune);
 	devm_free_irq(&client->dev, client->irq, dd);
 set_missing:
 	dd->present = 0;
@@ -645,6 +789,95 @@ set_missing:
 
 static struct mods_dl_driver muc_i2c_dl_driver = {
 	.message_send		= muc_i2c_message_send,
+	.fair_sched		= true,
+};
+
+#define STATS_BUF_SZ 512
+static ssize_t muc_i2c_stats_read(struct file *f, char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	struct muc_i2c_data *dd = f->f_inode->i_private;
+	char tmp[STATS_BUF_SZ];
+	int size;
+	int c;
+
+	size = scnprintf(tmp, STATS_BUF_SZ,
+		"Pkt size:     %zu\nPkt classes:  %d\n"
+		"Wire bytes:   %llu\nTX payload:   %llu\n",
+		dd->pkt_size, dd->pkt_classes, dd->wire_bytes,
+		dd->payload_bytes);
+
+	size += scnprintf(tmp + size, STATS_BUF_SZ - size,
+		"Suspends:     %u\nSuspend ACKs: %u\nRPM resumes:  %u\n"
+		"Resume (us):  %u (max %u)\n",
+		dd->suspends, dd->suspend_acks, dd->rpm_resumes,
+		dd->resume_us_last, dd->resume_us_max);
+
+	for (c = 0; c < PKT_CLASS_MAX; c++) {
+		if (!dd->class_writes[c])
+			continue;
+		size += scnprintf(tmp + size, STATS_BUF_SZ - size,
+			"TX class %u (%zu bytes): %u\n", c,
+			pkt_class_size(dd, c), dd->class_writes[c]);
+	}
+
+	return simple_read_from_buffer(buf, count, ppos, tmp, size);
+}
+
+static ssize_t irq_cpus_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct muc_i2c_data *dd = i2c_get_clientdata(to_i2c_client(dev));
+
+	return muc_irq_tune_cpus_show(&dd->irq_tune, buf);
+}
+
+static ssize_t irq_cpus_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct muc_i2c_data *dd = i2c_get_clientdata(to_i2c_client(dev));
+	int ret;
+
+	ret = muc_irq_tune_cpus_store(&dd->irq_tune, buf);
+
+	return ret ? ret : count;
+}
+
+static DEVICE_ATTR_RW(irq_cpus);
+
+static ssize_t irq_prio_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct muc_i2c_data *dd = i2c_get_clientdata(to_i2c_client(dev));
+
+	return muc_irq_tune_prio_show(&dd->irq_tune, buf);
+}
+
+static ssize_t irq_prio_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct muc_i2c_data *dd = i2c_get_clientdata(to_i2c_client(dev));
+	int ret;
+
+	ret = muc_irq_tune_prio_store(&dd->irq_tune, buf);
+
+	return ret ? ret : count;
+}
+
+static DEVICE_ATTR_RW(irq_prio);
+
+static struct attribute *muc_i2c_attrs[] = {
+	&dev_attr_irq_cpus.attr,
+	&dev_attr_irq_prio.attr,
+	NULL,
+};
+
+ATTRIBUTE_GROUPS(muc_i2c);
+
+static const struct file_operations muc_i2c_stats_fops = {
+	.read	= muc_i2c_stats_read,
 };
 
 static int allocate_buffers(struct muc_i2c_data *dd)
@@ -705,15 +938,30 @@ static int muc_i2c_probe(struct i2c_client *client,
 		goto remove_dl_device;
 
 	mutex_init(&dd->mutex);
+	init_waitqueue_head(&dd->resume_wq);
+	muc_irq_tune_init(&dd->irq_tune);
 
 	i2c_set_clientdata(client, dd);
 
+	ret = sysfs_create_groups(&client->dev.kobj, muc_i2c_groups);
+	if (ret) {
+		dev_err(&client->dev, "Failed to create sysfs\n");
+		goto remove_dl_device;
+	}
+
+	pm_runtime_set_autosuspend_delay(&client->dev, AUTOSUSPEND_DELAY_MS);
+	pm_runtime_use_autosuspend(&client->dev);
+	pm_runtime_enable(&client->dev);
+
 	device_set_wakeup_capable(&client->dev, true);
 	if (ret)
 		dev_warn(&client->dev, "Failed to wakeup_enable: %d\n", ret);
 
 	register_muc_attach_notifier(&dd->attach_nb);
 
+	dd->stats_dentry = debugfs_create_file("muc_i2c_stats", S_IRUGO,
+				mods_debugfs_get(), dd, &muc_i2c_stats_fops);
+
 	return 0;
 
 remove_dl_device:
@@ -731,6 +979,7 @@ static int muc_i2c_remove(struct i2c_client *client)
 	unregister_muc_attach_notifier(&dd->attach_nb);
 	if (dd->present) {
 		disable_irq_wake(client->irq);
+		muc_irq_tune_detach(&dd->irq_tune);
 		devm_free_irq(&client->dev, client->irq, dd);
 	}
 
@@ -740,12 +989,103 @@ static int muc_i2c_remove(struct i2c_client *client)
 		dd->attached = false;
 	}
 
+	pm_runtime_disable(&client->dev);
+	pm_runtime_dont_use_autosuspend(&client->dev);
+	if (!pm_runtime_status_suspended(&client->dev))
+		muc_i2c_runtime_suspend(&client->dev);
+	pm_runtime_set_suspended(&client->dev);
+
+	debugfs_remove(dd->stats_dentry);
+	sysfs_remove_groups(&client->dev.kobj, muc_i2c_groups);
 	mods_remove_dl_device(dd->dld);
 	i2c_set_clientdata(client, NULL);
 
 	return 0;
 }
 
+/*
+ * Park the link: wait for the ISR thread and any datagram in flight,
+ * hand back an RX ACK still owed to the MuC, block new senders and mask
+ * the link IRQ (it stays armed as a wakeup source). Negotiated bus
+ * settings are kept so a MuC that stays powered does not need a new bus
+ * config round trip on resume.
+ */
+static int muc_i2c_suspend(struct device *dev)
+{
+	struct muc_i2c_data *dd = i2c_get_clientdata(to_i2c_client(dev));
+
+	/* Waits for the ISR thread, so must not hold dd->mutex */
+	if (dd->present) {
+		disable_irq(dd->client->irq);
+		dd->irq_masked = true;
+		dd->suspends++;
+	}
+
+	mutex_lock(&dd->mutex);
+	if (dd->present && dd->rx_ack_pending) {
+		muc_i2c_xfer_begin(dd);
+		while (dd->present && dd->rx_ack_pending)
+			if (muc_i2c_transfer(dd, 0) < 0)
+				break;
+		muc_i2c_xfer_end(dd, 0);
+		dd->suspend_acks++;
+	}
+	dd->suspended = true;
+
+	/* Leave the MuC free to sleep */
+	muc_gpio_set_wake_n(1);
+	mutex_unlock(&dd->mutex);
+
+	return 0;
+}
+
+static int muc_i2c_resume(struct device *dev)
+{
+	struct muc_i2c_data *dd = i2c_get_clientdata(to_i2c_client(dev));
+
+	mutex_lock(&dd->mutex);
+	dd->suspended = false;
+	if (dd->irq_masked) {
+		dd->irq_masked = false;
+		dd->resume_time = ktime_get();
+		/* A pending MuC interrupt is serviced as soon as this runs */
+		enable_irq(dd->client->irq);
+	}
+	mutex_unlock(&dd->mutex);
+
+	wake_up_all(&dd->resume_wq);
+
+	return 0;
+}
+
+/* While the link is busy it keeps the I2C controller powered */
+static int muc_i2c_runtime_suspend(struct device *dev)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+
+	pm_runtime_put(client->adapter->dev.parent);
+
+	return 0;
+}
+
+static int muc_i2c_runtime_resume(struct device *dev)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct muc_i2c_data *dd = i2c_get_clientdata(client);
+
+	/* Reference is held even on error, dropped by runtime suspend */
+	pm_runtime_get_sync(client->adapter->dev.parent);
+	dd->rpm_resumes++;
+
+	return 0;
+}
+
+static const struct dev_pm_ops muc_i2c_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(muc_i2c_suspend, muc_i2c_resume)
+	SET_RUNTIME_PM_OPS(muc_i2c_runtime_suspend, muc_i2c_runtime_resume,
+			   NULL)
+};
+
 #ifdef CONFIG_OF
 static const struct of_device_id of_muc_i2c_match[] = {
 	{ .compatible = "moto,muc_i2c", },
@@ -763,6 +1103,7 @@ static struct i2c_driver muc_i2c_driver = {
 		.owner = THIS_MODULE,
 		.name = "muc_i2c",
 		.of_match_table = of_match_ptr(of_muc_i2c_match),
+		.pm = &muc_i2c_pm_ops,
 	},
 	.id_table = muc_i2c_id,
 	.probe = muc_i2c_probe,
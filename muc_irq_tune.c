@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility LLC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#define pr_fmt(fmt) "MODS_IRQ: " fmt
+
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/version.h>
+
+#include "muc_irq_tune.h"
+
+/* Priority request_threaded_irq() gives a new IRQ thread */
+#define IRQ_THREAD_DEFAULT_PRIO (MAX_USER_RT_PRIO / 2)
+
+void muc_irq_tune_init(struct muc_irq_tune *t)
+{
+	mutex_init(&t->lock);
+	cpumask_copy(&t->cpus, cpu_possible_mask);
+}
+
+/* Apply the stored settings to a freshly requested IRQ */
+void muc_irq_tune_attach(struct muc_irq_tune *t, int irq)
+{
+	mutex_lock(&t->lock);
+	t->irq = irq;
+	if (t->cpus_set && irq_set_affinity_hint(irq, &t->cpus))
+		pr_warn("irq %d: failed to set affinity\n", irq);
+
+	/* The IRQ thread is new, it starts out at the default priority */
+	t->prio_pending = !!t->prio;
+	mutex_unlock(&t->lock);
+}
+
+/* Must be called before the IRQ is freed, the hint points at t->cpus */
+void muc_irq_tune_detach(struct muc_irq_tune *t)
+{
+	mutex_lock(&t->lock);
+	if (t->irq && t->cpus_set)
+		irq_set_affinity_hint(t->irq, NULL);
+	t->irq = 0;
+	mutex_unlock(&t->lock);
+}
+
+void __muc_irq_tune_thread(struct muc_irq_tune *t)
+{
+	struct sched_param param;
+
+	t->prio_pending = false;
+	param.sched_priority = t->prio ? t->prio : IRQ_THREAD_DEFAULT_PRIO;
+
+	if (sched_setscheduler_nocheck(current, SCHED_FIFO, &param))
+		pr_warn("%s: failed to set priority %d\n", current->comm,
+			param.sched_priority);
+}
+
+ssize_t muc_irq_tune_cpus_show(struct muc_irq_tune *t, char *buf)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 0, 0)
+	return cpumap_print_to_pagebuf(true, buf, &t->cpus);
+#else
+	ssize_t len = cpulist_scnprintf(buf, PAGE_SIZE - 1, &t->cpus);
+
+	buf[len++] = '\n';
+	buf[len] = '\0';
+
+	return len;
+#endif
+}
+
+int muc_irq_tune_cpus_store(struct muc_irq_tune *t, const char *buf)
+{
+	cpumask_var_t mask;
+	char *list;
+	int ret;
+
+	list = kstrdup(buf, GFP_KERNEL);
+	if (!list)
+		return -ENOMEM;
+
+	if (!alloc_cpumask_var(&mask, GFP_KERNEL)) {
+		ret = -ENOMEM;
+		goto free_list;
+	}
+
+	ret = cpulist_parse(strim(list), mask);
+	if (ret)
+		goto free_mask;
+
+	if (!cpumask_intersects(mask, cpu_online_mask)) {
+		ret = -EINVAL;
+		goto free_mask;
+	}
+
+	mutex_lock(&t->lock);
+	cpumask_copy(&t->cpus, mask);
+	t->cpus_set = true;
+	if (t->irq)
+		ret = irq_set_affinity_hint(t->irq, &t->cpus);
+	mutex_unlock(&t->lock);
+
+free_mask:
+	free_cpumask_var(mask);
+free_list:
+	kfree(list);
+
+	return ret;
+}
+
+ssize_t muc_irq_tune_prio_show(struct muc_irq_tune *t, char *buf)
+{
+	return scnprintf(buf, PAGE_SIZE, "%d\n", t->prio);
+}
+
+int muc_irq_tune_prio_store(struct muc_irq_tune *t, const char *buf)
+{
+	int prio;
+
+	if (kstrtoint(buf, 10, &prio) < 0)
+		return -EINVAL;
+
+	if (prio < 0 || prio >= MAX_USER_RT_PRIO)
+		return -EINVAL;
+
+	/* The IRQ thread applies it itself the next time it runs */
+	mutex_lock(&t->lock);
+	t->prio = prio;
+	t->prio_pending = true;
+	mutex_unlock(&t->lock);
+
+	return 0;
+}
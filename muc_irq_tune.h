@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility LLC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef __MUC_IRQ_TUNE_H__
+#define __MUC_IRQ_TUNE_H__
+
+#include <linux/cpumask.h>
+#include <linux/mutex.h>
+#include <linux/types.h>
+
+/*
+ * CPU affinity and SCHED_FIFO priority for a link IRQ and its thread.
+ *
+ * The link drivers request their IRQ on attach and free it on detach, so
+ * the settings are kept here and re-applied every time the IRQ comes back.
+ */
+struct muc_irq_tune {
+	struct mutex lock;
+	int irq;                /* Requested IRQ, 0 while none is */
+	struct cpumask cpus;    /* Affinity hint, valid if cpus_set */
+	bool cpus_set;
+	int prio;               /* IRQ thread RT priority, 0 for default */
+	bool prio_pending;      /* IRQ thread has to pick up prio */
+};
+
+void muc_irq_tune_init(struct muc_irq_tune *t);
+void muc_irq_tune_attach(struct muc_irq_tune *t, int irq);
+void muc_irq_tune_detach(struct muc_irq_tune *t);
+void __muc_irq_tune_thread(struct muc_irq_tune *t);
+
+ssize_t muc_irq_tune_cpus_show(struct muc_irq_tune *t, char *buf);
+int muc_irq_tune_cpus_store(struct muc_irq_tune *t, const char *buf);
+ssize_t muc_irq_tune_prio_show(struct muc_irq_tune *t, char *buf);
+int muc_irq_tune_prio_store(struct muc_irq_tune *t, const char *buf);
+
+/* Called at the top of a threaded IRQ handler */
+static inline void muc_irq_tune_thread(struct muc_irq_tune *t)
+{
+	if (unlikely(t->prio_pending))
+		__muc_irq_tune_thread(t);
+}
+
+#endif /* __MUC_IRQ_TUNE_H__ */
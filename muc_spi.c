@@ -21,22 +21,26 @@
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/of_irq.h>
+#include <linux/pm_runtime.h>
 #include <linux/spi/spi.h>
 #include <linux/wait.h>
 #include <linux/workqueue.h>
 
 #include "crc.h"
+#include "mods_fault.h"
 #include "mods_nw.h"
 #include "muc.h"
+#include "muc_irq_tune.h"
 #include "muc_svc.h"
 
 /* Protocol version supported by this driver */
-#define PROTO_VER           (2)
+#define PROTO_VER           (3)
 
 /* Protocol version change log */
 #define PROTO_VER_PKT1      (1)     /* Version that added PKT1 bit */
 #define PROTO_VER_ACK       (1)     /* Minimum version for ACK support */
 #define PROTO_VER_DUMMY     (2)     /* Version that added DUMMY bit */
+#define PROTO_VER_PKT_CLASS (3)     /* Version that added packet classes */
 
 /*
  * Protocol version support macro for checking if the requested feature (f)
@@ -62,6 +66,7 @@
 #define MAX_PKTS_PER_DG     (64)
 
 /* SPI packet header bit definitions */
+#define HDR_BIT_CLASS  (0x07 << 10) /* Packet size class, see PKT_CLASS_* */
 #define HDR_BIT_DUMMY  (0x01 << 9)  /* 1 = dummy packet */
 #define HDR_BIT_PKT1   (0x01 << 8)  /* 1 = first packet of message */
 #define HDR_BIT_VALID  (0x01 << 7)  /* 1 = packet has valid payload */
@@ -74,6 +79,23 @@
 
 /* Possible values for bus config features */
 #define DL_BIT_ACK     (1 << 0)     /* Flag to indicate ACKing is supported */
+#define DL_BIT_CLASS   (1 << 1)     /* Flag to indicate pkt classes support */
+
+/*
+ * Packet size classes. When both sides support them, every power-of-two
+ * payload size from the default up to the negotiated payload size may be
+ * used. A transfer is sized by the AP to the smallest class that fits the
+ * datagram being sent, and every packet carries its class in the header
+ * so the receiver can locate the CRC. The MuC prepares its TX buffer
+ * before it knows the transfer size, so packets without a payload (idle
+ * and dummy packets) are always built in the smallest class, which fits
+ * any transfer.
+ */
+#define PKT_CLASS_PL_MIN        PL_SIZE(DEFAULT_PKT_SZ)
+#define PKT_CLASS_MAX           (8)
+#define PKT_CLASS_PL_SIZE(c)    (PKT_CLASS_PL_MIN << (c))
+#define HDR_CLASS(c)            (((c) << 10) & HDR_BIT_CLASS)
+#define HDR_GET_CLASS(bitmask)  (((bitmask) & HDR_BIT_CLASS) >> 10)
 
 /* SPI packet CRC size (in bytes) */
 #define CRC_SIZE       (2)
@@ -93,6 +115,9 @@
 #define RDY_TIMEOUT_JIFFIES     (HZ /  4) /* 250 milliseconds */
 #define ACK_TIMEOUT_JIFFIES     (HZ / 10) /* 100 milliseconds */
 
+/* Idle time before the link lets the SPI controller runtime suspend */
+#define AUTOSUSPEND_DELAY_MS    (100)
+
 /* The number of times to try sending a datagram to the MuC */
 #define NUM_TRIES      (3)
 
@@ -139,6 +164,8 @@ struct muc_spi_data {
 	bool ack_supported;                /* MuC supports ACK'ing on success */
 
 	size_t pkt_size;                   /* Size of hdr + pl + CRC in bytes */
+	bool pkt_classes;                  /* Smaller packet classes allowed */
+	size_t xfer_size;                  /* Size of the current transfer */
 	__u8 *tx_pkt;                      /* Buffer for transmit packets */
 	__u8 *rx_pkt;                      /* Buffer for received packets */
 
@@ -146,11 +173,25 @@ struct muc_spi_data {
 	uint32_t rx_datagram_ndx;          /* Index into datagram buffer for new data */
 	uint8_t pkts_remaining;            /* Packets needed to complete msg */
 
+	bool suspended;                    /* Link parked for system suspend */
+	bool irq_masked;                   /* IRQ disabled by suspend */
+	wait_queue_head_t resume_wq;       /* Senders waiting for resume */
+	ktime_t resume_time;               /* Set until first xfer on resume */
+	struct muc_irq_tune irq_tune;      /* IRQ affinity and thread priority */
+
 	/* Statistics below */
 	struct dentry *stats_dentry;       /* Debugfs entry */
 	uint32_t no_ack_sent;              /* Number of times no ACK was sent */
 	uint32_t no_ack_rcvd;              /* Number of times no ACK was received */
 	uint32_t no_ack_abort;             /* Number of times transfer was aborted */
+	uint32_t rx_truncated;             /* RX packets larger than transfer */
+	uint32_t class_xfers[PKT_CLASS_MAX]; /* Transfers per packet class */
+	uint64_t wire_bytes;               /* Bytes clocked on the bus */
+	uint64_t payload_bytes;            /* Valid payload bytes sent */
+	uint32_t suspends;                 /* System suspends while present */
+	uint32_t rpm_resumes;              /* Runtime resumes of the link */
+	uint32_t resume_us_last;           /* Resume to first xfer done */
+	uint32_t resume_us_max;
 
 	/* Quirks below */
 	bool wake_delay;                   /* Delay after wake assert is req'd */
@@ -189,6 +230,7 @@ size_t muc_spi_get_pkt_sz(size_t pl_size)
 static enum ack parse_rx_pkt(struct muc_spi_data *dd);
 static int __muc_spi_message_send(struct muc_spi_data *dd, __u8 msg_type,
 				  uint8_t *buf, size_t len);
+static int muc_spi_runtime_suspend(struct device *dev);
 
 static inline struct muc_spi_data *dld_to_dd(struct mods_dl_device *dld)
 {
@@ -208,14 +250,77 @@ static inline void set_tx_pkt_hdr(struct muc_spi_data *dd, uint16_t bitmask)
 	hdr->bitmask = cpu_to_le16(bitmask);
 }
 
+/* With packet classes the CRC goes where the header's class puts it */
 static inline void set_tx_pkt_crc(struct muc_spi_data *dd)
 {
-	uint16_t *crc = (uint16_t *)&dd->tx_pkt[CRC_NDX(dd->pkt_size)];
+	struct spi_msg_hdr *hdr = (struct spi_msg_hdr *)dd->tx_pkt;
+	size_t pkt_size = dd->xfer_size;
+	uint16_t *crc;
 
-	*crc = crc16_calc(0, dd->tx_pkt, CRC_NDX(dd->pkt_size));
+	if (dd->pkt_classes)
+		pkt_size = PKT_SIZE(PKT_CLASS_PL_SIZE(
+				HDR_GET_CLASS(le16_to_cpu(hdr->bitmask))));
+
+	crc = (uint16_t *)&dd->tx_pkt[CRC_NDX(pkt_size)];
+	*crc = crc16_calc(0, dd->tx_pkt, CRC_NDX(pkt_size));
 	*crc = cpu_to_le16(*crc);
 }
 
+/* Smallest packet class whose payload holds len bytes (or the largest) */
+static unsigned int pkt_class_for(struct muc_spi_data *dd, size_t len)
+{
+	unsigned int c = 0;
+
+	if (!dd->pkt_classes)
+		return 0;
+
+	while (c < PKT_CLASS_MAX - 1 && PKT_CLASS_PL_SIZE(c) < len &&
+	       PKT_CLASS_PL_SIZE(c) < PL_SIZE(dd->pkt_size))
+		c++;
+
+	return c;
+}
+
+static inline size_t pkt_class_size(struct muc_spi_data *dd, unsigned int c)
+{
+	if (!dd->pkt_classes)
+		return dd->pkt_size;
+
+	return PKT_SIZE(PKT_CLASS_PL_SIZE(c));
+}
+
+/* Called with dd->mutex held, returns with it held once resumed */
+static void muc_spi_wait_resumed(struct muc_spi_data *dd)
+{
+	while (dd->suspended) {
+		mutex_unlock(&dd->mutex);
+		wait_event(dd->resume_wq, !dd->suspended);
+		mutex_lock(&dd->mutex);
+	}
+}
+
+static void muc_spi_xfer_begin(struct muc_spi_data *dd)
+{
+	pm_stay_awake(&dd->spi->dev);
+	pm_runtime_get_sync(&dd->spi->dev);
+}
+
+static void muc_spi_xfer_end(struct muc_spi_data *dd, int ret)
+{
+	uint32_t us;
+
+	if (!ret && ktime_to_ns(dd->resume_time)) {
+		us = ktime_to_us(ktime_sub(ktime_get(), dd->resume_time));
+		dd->resume_us_last = us;
+		dd->resume_us_max = max(dd->resume_us_max, us);
+		dd->resume_time = ktime_set(0, 0);
+	}
+
+	pm_runtime_mark_last_busy(&dd->spi->dev);
+	pm_runtime_put_autosuspend(&dd->spi->dev);
+	pm_relax(&dd->spi->dev);
+}
+
 static void set_bus_speed(struct muc_spi_data *dd, __u32 max_speed_hz)
 {
 	struct spi_device *spi = dd->spi;
@@ -253,6 +358,7 @@ static int set_packet_size(struct muc_spi_data *dd, size_t pkt_size)
 
 	/* Save the new packet size */
 	dd->pkt_size = pkt_size;
+	dd->xfer_size = pkt_size;
 
 	dev_info(dev, "Packet size is %zu bytes\n", pkt_size);
 
@@ -320,8 +426,19 @@ static int dl_recv(struct mods_dl_device *dld, uint8_t *msg, size_t len)
 		dd->proto_ver = PROTO_VER_ACK;
 	}
 
-	dev_info(dev, "proto_ver=%d, ack_supported=%d\n",
-		 dd->proto_ver, dd->ack_supported);
+	/*
+	 * Packet classes rely on ACKs: a MuC packet that does not fit in a
+	 * shorter transfer is not ACK'd and gets resent in a full one.
+	 */
+	dd->pkt_classes = (resp.bus_resp.features & DL_BIT_CLASS) &&
+			  MUC_SUPPORTS(dd, PKT_CLASS) && dd->ack_supported &&
+			  dd->pkt_size > DEFAULT_PKT_SZ &&
+			  is_power_of_2(PL_SIZE(dd->pkt_size)) &&
+			  PL_SIZE(dd->pkt_size) <=
+				PKT_CLASS_PL_SIZE(PKT_CLASS_MAX - 1);
+
+	dev_info(dev, "proto_ver=%d, ack_supported=%d, pkt_classes=%d\n",
+		 dd->proto_ver, dd->ack_supported, dd->pkt_classes);
 
 	/* Schedule work to send attach to SVC */
 	schedule_work(&dd->attach_work);
@@ -353,7 +470,7 @@ static int muc_spi_transfer(struct muc_spi_data *dd, bool keep_wake)
 		{
 			.tx_buf = dd->tx_pkt,
 			.rx_buf = dd->rx_pkt,
-			.len = dd->pkt_size,
+			.len = dd->xfer_size,
 		},
 	};
 	int ret;
@@ -402,6 +519,9 @@ retry:
 	}
 
 	ret = spi_sync_transfer(spi, t, 1);
+	dd->wire_bytes += dd->xfer_size;
+	if (!ret && mods_fault_inject(MODS_FAULT_DROP))
+		ret = -EIO;
 
 	if (ret) {
 		if (--num_tries_remaining > 0) {
@@ -427,7 +547,9 @@ retry:
 		dd->no_ack_sent++;
 
 	if (is_tx_pkt_valid(dd)) {
-		WAIT_WHILE(!(ack = muc_gpio_get_ack()) &&
+		bool ack_lost = mods_fault_inject(MODS_FAULT_ACK);
+
+		WAIT_WHILE(!(ack = (muc_gpio_get_ack() && !ack_lost)) &&
 			   (intn = muc_gpio_get_int_n()),
 			   ACK_TIMEOUT_JIFFIES, dd);
 		if (!ack && intn) {
@@ -476,11 +598,28 @@ static enum ack parse_rx_pkt(struct muc_spi_data *dd)
 	struct spi_device *spi = dd->spi;
 	uint16_t *rcvcrc_p;
 	uint16_t calcrc;
-	size_t pl_size = PL_SIZE(dd->pkt_size);
+	size_t rx_pkt_size = dd->xfer_size;
+	size_t pl_size;
 	handler_t handler = mods_nw_switch;
 
-	rcvcrc_p = (uint16_t *)&dd->rx_pkt[CRC_NDX(dd->pkt_size)];
-	calcrc = crc16_calc(0, dd->rx_pkt, CRC_NDX(dd->pkt_size));
+	/* Payload or not, the CRC follows the packet class */
+	if (dd->pkt_classes) {
+		rx_pkt_size = pkt_class_size(dd, HDR_GET_CLASS(bitmask));
+		if (rx_pkt_size > dd->xfer_size) {
+			/*
+			 * MuC queued a packet larger than this transfer. It
+			 * is not ACK'd and will be resent in a full transfer.
+			 */
+			dd->rx_truncated++;
+			return ACK_ERROR;
+		}
+	}
+	pl_size = PL_SIZE(rx_pkt_size);
+
+	rcvcrc_p = (uint16_t *)&dd->rx_pkt[CRC_NDX(rx_pkt_size)];
+	calcrc = crc16_calc(0, dd->rx_pkt, CRC_NDX(rx_pkt_size));
+	if (mods_fault_inject(MODS_FAULT_CRC))
+		calcrc = ~le16_to_cpu(*rcvcrc_p);
 	if (le16_to_cpu(*rcvcrc_p) != calcrc) {
 		dev_err(&spi->dev, "CRC mismatch, received: 0x%x, "
 			"calculated: 0x%x\n", le16_to_cpu(*rcvcrc_p), calcrc);
@@ -519,7 +658,7 @@ static enum ack parse_rx_pkt(struct muc_spi_data *dd)
 		handler = dl_recv;
 
 	/* Check if un-packetizing is not required */
-	if (MAX_DATAGRAM_SZ == pl_size) {
+	if (MAX_DATAGRAM_SZ == PL_SIZE(dd->pkt_size)) {
 		if (!MUC_SUPPORTS(dd, PKT1) || (bitmask & HDR_BIT_PKT1))
 			handler(dd->dld, &dd->rx_pkt[HDR_SIZE],
 				pl_size);
@@ -589,14 +728,17 @@ static irqreturn_t muc_spi_isr(int irq, void *data)
 	struct muc_spi_data *dd = data;
 	int ret = 0;
 
+	muc_irq_tune_thread(&dd->irq_tune);
+
 	/* Any interrupt while the MuC is not present would be spurious */
 	if (!dd->present)
 		return IRQ_HANDLED;
 
 	mutex_lock(&dd->mutex);
-	pm_stay_awake(&dd->spi->dev);
+	muc_spi_xfer_begin(dd);
 
-	/* Populate the SPI dummy message */
+	/* Populate the SPI dummy message, MuC may send any packet class */
+	dd->xfer_size = dd->pkt_size;
 	set_tx_pkt_hdr(dd, HDR_BIT_DUMMY);
 	set_tx_pkt_crc(dd);
 
@@ -608,9 +750,13 @@ static irqreturn_t muc_spi_isr(int irq, void *data)
 		}
 	}
 
-	pm_relax(&dd->spi->dev);
+	muc_spi_xfer_end(dd, ret);
 	mutex_unlock(&dd->mutex);
 
+	/* Run the handler again as if the MuC had pulsed INT */
+	if (mods_fault_inject(MODS_FAULT_INT))
+		irq_wake_thread(irq, dd);
+
 	return IRQ_HANDLED;
 }
 
@@ -627,7 +773,7 @@ static int _muc_spi_negotiate(struct muc_spi_data *dd)
 	msg.bus_req.version = PROTO_VER;
 
 	if (dd->ack_supported)
-		msg.bus_req.features |= DL_BIT_ACK;
+		msg.bus_req.features |= DL_BIT_ACK | DL_BIT_CLASS;
 
 	do {
 		err = __muc_spi_message_send(dd, MSG_TYPE_DL, (uint8_t *)&msg,
@@ -663,6 +809,7 @@ static int muc_attach(struct notifier_block *nb,
 				goto set_missing;
 			}
 
+			muc_irq_tune_attach(&dd->irq_tune, spi->irq);
 			enable_irq_wake(spi->irq);
 
 			/* First step after attach is to negotiate bus config */
@@ -673,7 +820,9 @@ static int muc_attach(struct notifier_block *nb,
 			}
 		} else {
 			disable_irq_wake(spi->irq);
+			muc_irq_tune_detach(&dd->irq_tune);
 			devm_free_irq(&spi->dev, spi->irq, dd);
+			dd->irq_masked = false;
 
 			flush_work(&dd->attach_work);
 			if (dd->attached) {
@@ -693,16 +842,22 @@ static int muc_attach(struct notifier_block *nb,
 			dd->rx_datagram_ndx = 0;
 			dd->pkts_remaining = 0;
 			dd->proto_ver = 0;
+			dd->pkt_classes = false;
 			dd->ack_supported = muc_gpio_ack_is_supported();
 			dd->no_ack_sent = 0;
 			dd->no_ack_rcvd = 0;
 			dd->no_ack_abort = 0;
+			dd->rx_truncated = 0;
+			memset(dd->class_xfers, 0, sizeof(dd->class_xfers));
+			dd->wire_bytes = 0;
+			dd->payload_bytes = 0;
 		}
 	}
 	return NOTIFY_OK;
 
 free_irq:
 	disable_irq_wake(spi->irq);
+	muc_irq_tune_detach(&dd->irq_tune);
 	devm_free_irq(&spi->dev, spi->irq, dd);
 set_missing:
 	dd->present = 0;
@@ -714,7 +869,9 @@ static int __muc_spi_message_send(struct muc_spi_data *dd, __u8 msg_type,
 				  uint8_t *buf, size_t len)
 {
 	int remaining = len;
-	size_t pl_size = PL_SIZE(dd->pkt_size);
+	unsigned int class = pkt_class_for(dd, len);
+	size_t pkt_size = pkt_class_size(dd, class);
+	size_t pl_size = PL_SIZE(pkt_size);
 	int packets;
 	int ret = 0;
 
@@ -728,7 +885,10 @@ static int __muc_spi_message_send(struct muc_spi_data *dd, __u8 msg_type,
 		return -E2BIG;
 
 	mutex_lock(&dd->mutex);
-	pm_stay_awake(&dd->spi->dev);
+	muc_spi_wait_resumed(dd);
+	muc_spi_xfer_begin(dd);
+
+	dd->xfer_size = pkt_size;
 
 	while ((remaining > 0) && (packets > 0)) {
 		int this_pl;
@@ -743,6 +903,8 @@ static int __muc_spi_message_send(struct muc_spi_data *dd, __u8 msg_type,
 		bitmask |= (--packets & HDR_BIT_PKTS);
 		if (remaining == len)
 			bitmask |= HDR_BIT_PKT1;
+		if (dd->pkt_classes)
+			bitmask |= HDR_CLASS(class);
 
 		/* Populate the SPI message */
 		set_tx_pkt_hdr(dd, bitmask);
@@ -753,11 +915,15 @@ static int __muc_spi_message_send(struct muc_spi_data *dd, __u8 msg_type,
 		if (ret)
 			break;
 
+		dd->class_xfers[class]++;
+		dd->payload_bytes += this_pl;
 		remaining -= this_pl;
 		buf += this_pl;
 	}
 
-	pm_relax(&dd->spi->dev);
+	dd->xfer_size = dd->pkt_size;
+
+	muc_spi_xfer_end(dd, ret);
 	mutex_unlock(&dd->mutex);
 
 	return ret;
@@ -774,22 +940,97 @@ static int muc_spi_message_send(struct mods_dl_device *dld,
 
 static struct mods_dl_driver muc_spi_dl_driver = {
 	.message_send		= muc_spi_message_send,
+	.fair_sched		= true,
 };
 
-#define STATS_BUF_SZ 100
+#define STATS_BUF_SZ 512
 static ssize_t muc_spi_stats_read(struct file *f, char __user *buf,
 				size_t count, loff_t *ppos)
 {
 	struct muc_spi_data *dd = f->f_inode->i_private;
 	char tmp[STATS_BUF_SZ];
 	int size;
+	int c;
 
 	size = snprintf(tmp, STATS_BUF_SZ, "No ACK sent:  %u\nNo ACK rcvd:  %u"
 		"\nNo ACK abort: %u\n", dd->no_ack_sent, dd->no_ack_rcvd,
 		dd->no_ack_abort);
+
+	size += scnprintf(tmp + size, STATS_BUF_SZ - size,
+		"Pkt size:     %zu\nPkt classes:  %d\nRX truncated: %u\n"
+		"Wire bytes:   %llu\nTX payload:   %llu\n",
+		dd->pkt_size, dd->pkt_classes, dd->rx_truncated,
+		dd->wire_bytes, dd->payload_bytes);
+
+	size += scnprintf(tmp + size, STATS_BUF_SZ - size,
+		"Suspends:     %u\nRPM resumes:  %u\n"
+		"Resume (us):  %u (max %u)\n",
+		dd->suspends, dd->rpm_resumes, dd->resume_us_last,
+		dd->resume_us_max);
+
+	for (c = 0; c < PKT_CLASS_MAX; c++) {
+		if (!dd->class_xfers[c])
+			continue;
+		size += scnprintf(tmp + size, STATS_BUF_SZ - size,
+			"TX class %u (%zu bytes): %u\n", c,
+			pkt_class_size(dd, c), dd->class_xfers[c]);
+	}
+
 	return simple_read_from_buffer(buf, count, ppos, tmp, size);
 }
 
+static ssize_t irq_cpus_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct muc_spi_data *dd = spi_get_drvdata(to_spi_device(dev));
+
+	return muc_irq_tune_cpus_show(&dd->irq_tune, buf);
+}
+
+static ssize_t irq_cpus_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct muc_spi_data *dd = spi_get_drvdata(to_spi_device(dev));
+	int ret;
+
+	ret = muc_irq_tune_cpus_store(&dd->irq_tune, buf);
+
+	return ret ? ret : count;
+}
+
+static DEVICE_ATTR_RW(irq_cpus);
+
+static ssize_t irq_prio_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct muc_spi_data *dd = spi_get_drvdata(to_spi_device(dev));
+
+	return muc_irq_tune_prio_show(&dd->irq_tune, buf);
+}
+
+static ssize_t irq_prio_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct muc_spi_data *dd = spi_get_drvdata(to_spi_device(dev));
+	int ret;
+
+	ret = muc_irq_tune_prio_store(&dd->irq_tune, buf);
+
+	return ret ? ret : count;
+}
+
+static DEVICE_ATTR_RW(irq_prio);
+
+static struct attribute *muc_spi_attrs[] = {
+	&dev_attr_irq_cpus.attr,
+	&dev_attr_irq_prio.attr,
+	NULL,
+};
+
+ATTRIBUTE_GROUPS(muc_spi);
+
 static const struct file_operations muc_spi_stats_fops = {
 	.read	= muc_spi_stats_read,
 };
@@ -862,9 +1103,21 @@ static int muc_spi_probe(struct spi_device *spi)
 
 	muc_spi_quirks_init(dd);
 	mutex_init(&dd->mutex);
+	init_waitqueue_head(&dd->resume_wq);
+	muc_irq_tune_init(&dd->irq_tune);
 
 	spi_set_drvdata(spi, dd);
 
+	ret = sysfs_create_groups(&spi->dev.kobj, muc_spi_groups);
+	if (ret) {
+		dev_err(&spi->dev, "Failed to create sysfs\n");
+		goto remove_dl_device;
+	}
+
+	pm_runtime_set_autosuspend_delay(&spi->dev, AUTOSUSPEND_DELAY_MS);
+	pm_runtime_use_autosuspend(&spi->dev);
+	pm_runtime_enable(&spi->dev);
+
 	device_set_wakeup_capable(&spi->dev, true);
 	ret = device_wakeup_enable(&spi->dev);
 	if (ret)
@@ -894,6 +1147,7 @@ static int muc_spi_remove(struct spi_device *spi)
 	unregister_muc_attach_notifier(&dd->attach_nb);
 	if (dd->present) {
 		disable_irq_wake(spi->irq);
+		muc_irq_tune_detach(&dd->irq_tune);
 		devm_free_irq(&spi->dev, spi->irq, dd);
 	}
 
@@ -909,13 +1163,96 @@ static int muc_spi_remove(struct spi_device *spi)
 	 */
 	set_bus_speed(dd, dd->default_speed_hz);
 
+	pm_runtime_disable(&spi->dev);
+	pm_runtime_dont_use_autosuspend(&spi->dev);
+	if (!pm_runtime_status_suspended(&spi->dev))
+		muc_spi_runtime_suspend(&spi->dev);
+	pm_runtime_set_suspended(&spi->dev);
+
 	mods_remove_dl_device(dd->dld);
 	debugfs_remove(dd->stats_dentry);
+	sysfs_remove_groups(&spi->dev.kobj, muc_spi_groups);
 	spi_set_drvdata(spi, NULL);
 
 	return 0;
 }
 
+/*
+ * Park the link: wait for the ISR thread and any datagram in flight,
+ * block new senders and mask the link IRQ (it stays armed as a wakeup
+ * source). Negotiated bus settings are kept so a MuC that stays powered
+ * does not need a new bus config round trip on resume.
+ */
+static int muc_spi_suspend(struct device *dev)
+{
+	struct muc_spi_data *dd = spi_get_drvdata(to_spi_device(dev));
+
+	/* Waits for the ISR thread, so must not hold dd->mutex */
+	if (dd->present) {
+		disable_irq(dd->spi->irq);
+		dd->irq_masked = true;
+		dd->suspends++;
+	}
+
+	mutex_lock(&dd->mutex);
+	dd->suspended = true;
+
+	/* Leave the MuC free to sleep */
+	muc_gpio_set_wake_n(1);
+	if (dd->ack_supported)
+		muc_gpio_set_ack(0);
+	mutex_unlock(&dd->mutex);
+
+	return 0;
+}
+
+static int muc_spi_resume(struct device *dev)
+{
+	struct muc_spi_data *dd = spi_get_drvdata(to_spi_device(dev));
+
+	mutex_lock(&dd->mutex);
+	dd->suspended = false;
+	if (dd->irq_masked) {
+		dd->irq_masked = false;
+		dd->resume_time = ktime_get();
+		/* A pending MuC interrupt is serviced as soon as this runs */
+		enable_irq(dd->spi->irq);
+	}
+	mutex_unlock(&dd->mutex);
+
+	wake_up_all(&dd->resume_wq);
+
+	return 0;
+}
+
+/* While the link is busy it keeps the SPI controller powered */
+static int muc_spi_runtime_suspend(struct device *dev)
+{
+	struct spi_device *spi = to_spi_device(dev);
+
+	pm_runtime_put(spi->master->dev.parent);
+
+	return 0;
+}
+
+static int muc_spi_runtime_resume(struct device *dev)
+{
+	struct spi_device *spi = to_spi_device(dev);
+	struct muc_spi_data *dd = spi_get_drvdata(spi);
+
+	/* Reference is held even on error, dropped by runtime suspend */
+	pm_runtime_get_sync(spi->master->dev.parent);
+	dd->rpm_resumes++;
+
+	return 0;
+}
+
+static const struct dev_pm_ops muc_spi_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(muc_spi_suspend, muc_spi_resume)
+	SET_RUNTIME_PM_OPS(muc_spi_runtime_suspend, muc_spi_runtime_resume,
+			   NULL)
+};
+
 #ifdef CONFIG_OF
 static const struct of_device_id of_muc_spi_match[] = {
 	{ .compatible = "moto,muc_spi", },
@@ -933,6 +1270,7 @@ static struct spi_driver muc_spi_driver = {
 		.owner = THIS_MODULE,
 		.name = "muc_spi",
 		.of_match_table = of_match_ptr(of_muc_spi_match),
+		.pm = &muc_spi_pm_ops,
 	},
 	.id_table = muc_spi_id,
 	.probe = muc_spi_probe,
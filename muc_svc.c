@@ -13,6 +13,7 @@
  *
  */
 
+#include <linux/crc32.h>
 #include <linux/delay.h>
 #include <linux/err.h>
 #include <linux/module.h>
@@ -61,12 +62,20 @@ struct muc_svc_data {
 	u8 mod_root_ver;
 	u8 def_root_ver;
 	struct wake_lock wlock;
+
+	struct mutex list_lock;     /* protects ext_intf */
+	struct mutex slave_lock;    /* protects slave_drv */
+	spinlock_t ops_lock;        /* protects operations and op refs */
 };
+
+/*
+ * The SVC instance. SVC state and locks live in muc_svc_data, but only one
+ * instance is supported: the mods_nw route table is keyed by global
+ * interface ids, link drivers and slave-control drivers bind through
+ * svc_dd, and the manifest cache is shared.
+ */
 struct muc_svc_data *svc_dd;
 
-static DEFINE_MUTEX(slave_lock);
-static DEFINE_MUTEX(svc_list_lock);
-static DEFINE_SPINLOCK(svc_ops_lock);
 
 /* Define the SVCs reserved area of CPORTS to create the vendor
  * connections to each interface
@@ -94,7 +103,7 @@ static void muc_svc_broadcast_slave_notification(struct mods_dl_device *master);
 static int muc_svc_send_reboot(struct mods_dl_device *mods_dev, uint8_t mode);
 static int muc_svc_send_current_limit(struct mods_dl_device *dev, uint8_t limit);
 static int muc_svc_send_current_rsv_ack(struct mods_dl_device *dev);
-static int muc_svc_version_heartbeat(void);
+static int muc_svc_version_heartbeat(struct muc_svc_data *dd);
 static int muc_svc_send_rtc_sync(struct mods_dl_device *mods_dev);
 static int muc_svc_send_test_mode(struct mods_dl_device *mods_dev, uint32_t val);
 
@@ -112,95 +121,99 @@ static void muc_svc_send_kobj_uevent(struct kobject *kobj, const char *event)
 	kfree(env);
 }
 
-static inline void muc_svc_send_uevent(const char *event)
+static inline void
+muc_svc_send_uevent(struct muc_svc_data *dd, const char *event)
 {
-	muc_svc_send_kobj_uevent(&svc_dd->pdev->dev.kobj, event);
+	muc_svc_send_kobj_uevent(&dd->pdev->dev.kobj, event);
 }
 
-static void _do_muc_recovery_level(void)
+static void _do_muc_recovery_level(struct muc_svc_data *dd)
 {
-	switch (svc_dd->recovery_level) {
+	switch (dd->recovery_level) {
 	case MUC_SVC_RECOVERY_FULL:
-		muc_reset(svc_dd->mod_root_ver, svc_dd->def_root_ver, false);
+		muc_reset(dd->mod_root_ver, dd->def_root_ver, false);
 		break;
 	case MUC_SVC_RECOVERY_OFF:
-		dev_warn(&svc_dd->pdev->dev, "Recovery reset disabled\n");
+		dev_warn(&dd->pdev->dev, "Recovery reset disabled\n");
 		break;
 	case MUC_SVC_RECOVERY_SOFT:
 		muc_soft_reset();
 		break;
 	default:
-		dev_err(&svc_dd->pdev->dev, "Invalid recovery: %d\n",
-			svc_dd->recovery_level);
+		dev_err(&dd->pdev->dev, "Invalid recovery: %d\n",
+			dd->recovery_level);
 	}
 }
 
 #define MUC_SVC_FAILURE_WINDOW (60 * 5 * HZ) /* 5 minute window */
 #define MUC_SVC_WATCHDOG_MAX_RETRIES 5
-static void muc_svc_recovery(void)
+static void muc_svc_recovery(struct muc_svc_data *dd)
 {
 	unsigned long end_time;
 
 	/* If at least one interface has been successful, we will
 	 * not perform the reset.
 	 */
-	mutex_lock(&svc_list_lock);
-	if (!list_empty(&svc_dd->ext_intf)) {
-		mutex_unlock(&svc_list_lock);
-		dev_warn(&svc_dd->pdev->dev,
+	mutex_lock(&dd->list_lock);
+	if (!list_empty(&dd->ext_intf)) {
+		mutex_unlock(&dd->list_lock);
+		dev_warn(&dd->pdev->dev,
 			"An interface is present; skipping reset\n");
 		return;
 	}
-	mutex_unlock(&svc_list_lock);
+	mutex_unlock(&dd->list_lock);
 
 	/* If this is first failure event, save the timestamp */
-	if (!svc_dd->fail_count)
-		svc_dd->first_fail = jiffies;
+	if (!dd->fail_count)
+		dd->first_fail = jiffies;
 
 	/* If this failure event is sufficient time after the back-off
 	 * time, lets try again in case a new device is attached.
 	 */
-	end_time = svc_dd->first_fail + MUC_SVC_FAILURE_WINDOW;
+	end_time = dd->first_fail + MUC_SVC_FAILURE_WINDOW;
 	if (time_after_eq(jiffies, end_time)) {
-		dev_dbg(&svc_dd->pdev->dev,
+		dev_dbg(&dd->pdev->dev,
 				"Failure window expired, reset count\n");
-		svc_dd->fail_count = 0;
-		svc_dd->first_fail = jiffies;
+		dd->fail_count = 0;
+		dd->first_fail = jiffies;
 	}
 
 	/* Too many failures within the window, shut her down */
-	if (++svc_dd->fail_count > MUC_SVC_WATCHDOG_MAX_RETRIES) {
-		dev_err(&svc_dd->pdev->dev,
+	if (++dd->fail_count > MUC_SVC_WATCHDOG_MAX_RETRIES) {
+		dev_err(&dd->pdev->dev,
 				"Too many failures; shutting down\n");
-		muc_svc_send_uevent("MOD_ERROR=RECOVERY_FAILED");
+		muc_svc_send_uevent(dd, "MOD_ERROR=RECOVERY_FAILED");
 
 		muc_poweroff();
-		svc_dd->fail_count = 0;
+		dd->fail_count = 0;
 	} else {
-		dev_err(&svc_dd->pdev->dev, "Performing recovery\n");
-		muc_svc_send_uevent("MOD_ERROR=RECOVERY_ATTEMPT");
-		_do_muc_recovery_level();
+		dev_err(&dd->pdev->dev, "Performing recovery\n");
+		muc_svc_send_uevent(dd, "MOD_ERROR=RECOVERY_ATTEMPT");
+		_do_muc_recovery_level(dd);
 	}
 }
 
 static void muc_svc_wdog(struct work_struct *work)
 {
-	dev_err(&svc_dd->pdev->dev, "Watchdog waiting for DL device\n");
+	struct muc_svc_data *dd = container_of(to_delayed_work(work),
+					struct muc_svc_data, wdog_work);
+
+	dev_err(&dd->pdev->dev, "Watchdog waiting for DL device\n");
 
 	/* If we are handling watchdog for i2c transport, retry using SPI */
 	if (muc_misc_data && muc_misc_data->i2c_transport_done)
 		muc_misc_data->i2c_transport_err = true;
-	muc_svc_recovery();
+	muc_svc_recovery(dd);
 }
 
-static void send_event_to_userspace(const char *event,
-	struct mods_dl_device *mods_dev)
+static void send_event_to_userspace(struct muc_svc_data *dd,
+	const char *event, struct mods_dl_device *mods_dev)
 {
-	u8 count = svc_dd->fail_count;
+	u8 count = dd->fail_count;
 	struct kobj_uevent_env *env;
 
 	if (!mods_dev) {
-		dev_err(&svc_dd->pdev->dev, "NULL mods_dev, skipping send\n");
+		dev_err(&dd->pdev->dev, "NULL mods_dev, skipping send\n");
 		return;
 	}
 
@@ -219,56 +232,63 @@ static void send_event_to_userspace(const char *event,
 			mods_dev->uid_high, mods_dev->uid_low);
 	}
 	add_uevent_var(env, "RECOVERY_FW_VERSION=0x%08X", mods_dev->fw_version);
-	kobject_uevent_env(&svc_dd->pdev->dev.kobj, KOBJ_CHANGE, env->envp);
-	dev_dbg(&svc_dd->pdev->dev, "report to USERSPACE\n");
+	kobject_uevent_env(&dd->pdev->dev.kobj, KOBJ_CHANGE, env->envp);
+	dev_dbg(&dd->pdev->dev, "report to USERSPACE\n");
 	kfree(env);
 }
 
 static void muc_svc_clear_wdog(struct mods_dl_device *mods_dev)
 {
-	cancel_delayed_work_sync(&svc_dd->wdog_work);
+	struct muc_svc_data *dd = mods_dev->svc;
 
-	if (!svc_dd->fail_count)
+	cancel_delayed_work_sync(&dd->wdog_work);
+
+	if (!dd->fail_count)
 		return;
 
-	send_event_to_userspace("MOD_EVENT=RECOVERY_SUCCESS", mods_dev);
-	svc_dd->fail_count = 0;
+	send_event_to_userspace(dd, "MOD_EVENT=RECOVERY_SUCCESS", mods_dev);
+	dd->fail_count = 0;
 }
 
 #define MUC_SVC_WATCHDOG_ATTACH_TIMEOUT (5 * HZ) /* 5s */
 static int
 muc_svc_attach(struct notifier_block *nb, unsigned long state, void *unused)
 {
+	struct muc_svc_data *dd = container_of(nb, struct muc_svc_data,
+					       attach_nb);
+
 	if (state) {
-		queue_delayed_work(svc_dd->wdog_wq, &svc_dd->wdog_work,
+		queue_delayed_work(dd->wdog_wq, &dd->wdog_work,
 				MUC_SVC_WATCHDOG_ATTACH_TIMEOUT);
-		muc_svc_send_uevent("MOD_EVENT=ATTACHED");
+		muc_svc_send_uevent(dd, "MOD_EVENT=ATTACHED");
 	} else {
-		cancel_delayed_work_sync(&svc_dd->wdog_work);
-		svc_dd->mod_root_ver = svc_dd->def_root_ver;
-		muc_svc_send_uevent("MOD_EVENT=DETACHED");
+		cancel_delayed_work_sync(&dd->wdog_work);
+		dd->mod_root_ver = dd->def_root_ver;
+		muc_svc_send_uevent(dd, "MOD_EVENT=DETACHED");
 	}
 
-	svc_dd->mod_attached = !!state;
+	dd->mod_attached = !!state;
 
 	return 0;
 }
 
 void muc_svc_communication_reset(struct mods_dl_device *error_dev)
 {
+	struct muc_svc_data *dd = error_dev->svc;
+
 	/* Try a heartbeat via the version; if it succeeds we are talking */
-	if (!muc_svc_version_heartbeat())
+	if (!muc_svc_version_heartbeat(dd))
 		return;
 
-	dev_err(&svc_dd->pdev->dev, "%s: resetting via interface: %d\n",
+	dev_err(&dd->pdev->dev, "%s: resetting via interface: %d\n",
 		__func__, error_dev->intf_id);
 
 	/* Increment failure count, and mark the starting time */
-	if (!svc_dd->fail_count++)
-		svc_dd->first_fail = jiffies;
+	if (!dd->fail_count++)
+		dd->first_fail = jiffies;
 
-	send_event_to_userspace("MOD_ERROR=COMMUNICATION_RESET", error_dev);
-	_do_muc_recovery_level();
+	send_event_to_userspace(dd, "MOD_ERROR=COMMUNICATION_RESET", error_dev);
+	_do_muc_recovery_level(dd);
 }
 
 static ssize_t manifest_read(struct file *fp, struct kobject *kobj,
@@ -276,15 +296,12 @@ static ssize_t manifest_read(struct file *fp, struct kobject *kobj,
 				loff_t pos, size_t size)
 {
 	struct mods_dl_device *mods_dev = kobj_to_device(kobj);
-	ssize_t count = 0;
 
 	if (!mods_dev->manifest || !mods_dev->manifest_size)
 		return -EINVAL;
 
-	for ( ; size > 0 && pos < mods_dev->manifest_size; count++, size--)
-		*buf++ = mods_dev->manifest[pos++];
-
-	return count;
+	return memory_read_from_buffer(buf, size, &pos, mods_dev->manifest,
+					mods_dev->manifest_size);
 }
 
 static ssize_t fw_version_show(struct mods_dl_device *dev, char *buf)
@@ -292,6 +309,11 @@ static ssize_t fw_version_show(struct mods_dl_device *dev, char *buf)
 	return scnprintf(buf, PAGE_SIZE, "0x%08X", dev->fw_version);
 }
 
+static ssize_t manifest_cached_show(struct mods_dl_device *dev, char *buf)
+{
+	return scnprintf(buf, PAGE_SIZE, "%d", dev->manifest_cached);
+}
+
 static ssize_t fw_version_str_show(struct mods_dl_device *dev, char *buf)
 {
 	return scnprintf(buf, PAGE_SIZE, "%s", dev->fw_version_str);
@@ -346,10 +368,11 @@ static ssize_t unipro_pid_show(struct mods_dl_device *dev, char *buf)
 static ssize_t
 hotplug_store(struct mods_dl_device *dev, const char *buf, size_t count)
 {
+	struct muc_svc_data *dd = dev->svc;
 	unsigned long val;
 
 	/* If authentication is disabled, this is a no-op */
-	if (!svc_dd->authenticate)
+	if (!dd->authenticate)
 		return count;
 
 	if (kstrtoul(buf, 10, &val) < 0)
@@ -361,15 +384,15 @@ hotplug_store(struct mods_dl_device *dev, const char *buf, size_t count)
 		if (!dev->hpw || dev->hotplug_sent)
 			return -EINVAL;
 
-		queue_work(svc_dd->wq, &dev->hpw->work);
+		queue_work(dd->wq, &dev->hpw->work);
 		break;
 	case 0:
-		dev_info(&svc_dd->pdev->dev,
+		dev_info(&dd->pdev->dev,
 			"%s: hotplug deny/unload; shutting down\n", __func__);
 		muc_poweroff();
 		break;
 	default:
-		dev_err(&svc_dd->pdev->dev, "%s: invalid mode: %ld\n",
+		dev_err(&dd->pdev->dev, "%s: invalid mode: %ld\n",
 			__func__, val);
 		return -EINVAL;
 	}
@@ -380,13 +403,14 @@ hotplug_store(struct mods_dl_device *dev, const char *buf, size_t count)
 static ssize_t
 blank_store(struct mods_dl_device *mods_dev, const char *buf, size_t count)
 {
+	struct muc_svc_data *dd = mods_dev->svc;
 	unsigned long val;
 
 	if (kstrtoul(buf, 10, &val) < 0 || val != 1)
 		return -EINVAL;
 
 	if (muc_svc_send_reboot(mods_dev, MB_CONTROL_REBOOT_BLANK_FLASH)) {
-		dev_err(&svc_dd->pdev->dev,
+		dev_err(&dd->pdev->dev,
 				"INTF: %d, failed to send blankflash\n",
 				mods_dev->intf_id);
 		return -ENODEV;
@@ -524,6 +548,7 @@ static MUC_SVC_ATTR(current_rsv_ack, 0444, NULL, current_rsv_ack_store);
 static MUC_SVC_ATTR(vendor_updates, 0444, vendor_updates_show, NULL);
 static MUC_SVC_ATTR(rtc_sync, 0200, NULL, rtc_sync_store);
 static MUC_SVC_ATTR(test_mode, 0200, NULL, test_mode_store);
+static MUC_SVC_ATTR(manifest_cached, 0444, manifest_cached_show, NULL);
 
 #define to_muc_svc_attr(a) \
 	container_of(a, struct muc_svc_attribute, attr)
@@ -577,6 +602,7 @@ static struct attribute *muc_svc_default_attrs[] = {
 	&muc_svc_attr_vendor_updates.attr,
 	&muc_svc_attr_rtc_sync.attr,
 	&muc_svc_attr_test_mode.attr,
+	&muc_svc_attr_manifest_cached.attr,
 	NULL,
 };
 
@@ -587,9 +613,10 @@ static struct kobj_type ktype_muc_svc = {
 
 static int muc_svc_create_dl_dev_sysfs(struct mods_dl_device *mods_dev)
 {
+	struct muc_svc_data *dd = mods_dev->svc;
 	int err;
 
-	mods_dev->intf_kobj.kset = svc_dd->intf_kset;
+	mods_dev->intf_kobj.kset = dd->intf_kset;
 	err = kobject_init_and_add(&mods_dev->intf_kobj, &ktype_muc_svc,
 					NULL, "%d", mods_dev->intf_id);
 	if (err)
@@ -607,7 +634,7 @@ static int muc_svc_create_dl_dev_sysfs(struct mods_dl_device *mods_dev)
 		goto put_kobj;
 
 	/* Hold a timed wakelock for userspace to handle attach */
-	wake_lock_timeout(&svc_dd->wlock, msecs_to_jiffies(1000));
+	wake_lock_timeout(&dd->wlock, msecs_to_jiffies(1000));
 	kobject_uevent(&mods_dev->intf_kobj, KOBJ_ONLINE);
 
 	return 0;
@@ -620,11 +647,13 @@ put_kobj:
 
 static void muc_svc_destroy_dl_dev_sysfs(struct mods_dl_device *mods_dev)
 {
+	struct muc_svc_data *dd = mods_dev->svc;
+
 	if (!mods_dev->intf_kobj.state_initialized)
 		return;
 
 	/* Hold a timed wakelock for userspace to handle detach */
-	wake_lock_timeout(&svc_dd->wlock, msecs_to_jiffies(1000));
+	wake_lock_timeout(&dd->wlock, msecs_to_jiffies(1000));
 	sysfs_remove_bin_file(&mods_dev->intf_kobj,
 				&mods_dev->manifest_attr);
 	kobject_put(&mods_dev->intf_kobj);
@@ -773,13 +802,13 @@ static inline void svc_op_get_locked(struct svc_op *op)
 	kref_get(&op->kref);
 }
 
-static inline void svc_op_get(struct svc_op *op)
+static inline void svc_op_get(struct muc_svc_data *dd, struct svc_op *op)
 {
 	unsigned long flags;
 
-	spin_lock_irqsave(&svc_ops_lock, flags);
+	spin_lock_irqsave(&dd->ops_lock, flags);
 	svc_op_get_locked(op);
-	spin_unlock_irqrestore(&svc_ops_lock, flags);
+	spin_unlock_irqrestore(&dd->ops_lock, flags);
 }
 
 static void svc_op_kref_release(struct kref *kref)
@@ -792,13 +821,13 @@ static void svc_op_kref_release(struct kref *kref)
 	kfree(op);
 }
 
-static inline void svc_op_put(struct svc_op *op)
+static inline void svc_op_put(struct muc_svc_data *dd, struct svc_op *op)
 {
 	unsigned long flags;
 
-	spin_lock_irqsave(&svc_ops_lock, flags);
+	spin_lock_irqsave(&dd->ops_lock, flags);
 	kref_put(&op->kref, svc_op_kref_release);
-	spin_unlock_irqrestore(&svc_ops_lock, flags);
+	spin_unlock_irqrestore(&dd->ops_lock, flags);
 }
 
 static struct svc_op *svc_find_op(struct muc_svc_data *dd, uint16_t id)
@@ -806,7 +835,7 @@ static struct svc_op *svc_find_op(struct muc_svc_data *dd, uint16_t id)
 	struct svc_op *e, *tmp;
 	unsigned long flags;
 
-	spin_lock_irqsave(&svc_ops_lock, flags);
+	spin_lock_irqsave(&dd->ops_lock, flags);
 	list_for_each_entry_safe(e, tmp, &dd->operations, entry)
 		if (e->msg_id == id) {
 			svc_op_get_locked(e);
@@ -814,7 +843,7 @@ static struct svc_op *svc_find_op(struct muc_svc_data *dd, uint16_t id)
 		}
 	e = NULL;
 found:
-	spin_unlock_irqrestore(&svc_ops_lock, flags);
+	spin_unlock_irqrestore(&dd->ops_lock, flags);
 
 	return e;
 }
@@ -991,6 +1020,7 @@ static int
 svc_gb_dme_get(struct mods_dl_device *dld, struct gb_message *req_msg,
 		uint16_t cport)
 {
+	struct muc_svc_data *dd = dld_get_dd(dld);
 	struct gb_svc_dme_peer_get_request *req;
 	struct gb_svc_dme_peer_get_response resp;
 	struct svc_gb_dme_entry *entry;
@@ -1024,7 +1054,7 @@ send_response:
 	ret = svc_gb_send_response(dld, cport, req_msg, sizeof(resp),
 					&resp, GB_OP_SUCCESS);
 	if (ret)
-		dev_err(&svc_dd->pdev->dev,
+		dev_err(&dd->pdev->dev,
 			"Failed response to DME_GET request for intf_id: %d\n",
 			req->intf_id);
 
@@ -1035,6 +1065,7 @@ static int
 svc_gb_dme_set(struct mods_dl_device *dld, struct gb_message *req_msg,
 		uint16_t cport)
 {
+	struct muc_svc_data *dd = dld_get_dd(dld);
 	struct gb_svc_dme_peer_set_request *req;
 	struct gb_svc_dme_peer_set_response resp;
 	struct svc_gb_dme_entry *entry;
@@ -1066,13 +1097,85 @@ send_response:
 	ret = svc_gb_send_response(dld, cport, req_msg, sizeof(resp),
 					&resp, GB_OP_SUCCESS);
 	if (ret)
-		dev_err(&svc_dd->pdev->dev,
+		dev_err(&dd->pdev->dev,
 			"Failed response to DME_SET request for intf_id: %d\n",
 			req->intf_id);
 
 	return 0;
 }
 
+static int
+svc_gb_dme_batch(struct mods_dl_device *dld, struct gb_message *req_msg,
+		uint16_t cport)
+{
+	struct muc_svc_data *dd = dld_get_dd(dld);
+	struct gb_svc_dme_peer_batch_request *req;
+	struct gb_svc_dme_peer_batch_response *resp;
+	struct svc_gb_dme_entry *entry;
+	size_t resp_size;
+	int ret;
+	int i;
+
+	req = (struct gb_svc_dme_peer_batch_request *)req_msg->payload;
+	if (req_msg->payload_size < sizeof(*req) ||
+	    req_msg->payload_size <
+		sizeof(*req) + req->count * sizeof(req->attrs[0])) {
+		dev_err(&dd->pdev->dev, "Short DME batch request\n");
+		return svc_gb_send_response(dld, cport, req_msg, 0, NULL,
+					    GB_OP_INVALID);
+	}
+
+	resp_size = sizeof(*resp) + req->count * sizeof(resp->results[0]);
+	resp = kzalloc(resp_size, GFP_KERNEL);
+	if (!resp)
+		return svc_gb_send_response(dld, cport, req_msg, 0, NULL,
+					    GB_OP_NO_MEMORY);
+
+	resp->tag = req->tag;
+	resp->count = req->count;
+
+	for (i = 0; i < req->count; i++) {
+		struct gb_svc_dme_batch_attr *attr = &req->attrs[i];
+		struct gb_svc_dme_batch_result *result = &resp->results[i];
+		u16 attr_id = le16_to_cpu(attr->attr);
+		u16 selector = le16_to_cpu(attr->selector);
+		u32 value = 0;
+
+		entry = svc_gb_get_dme_entry(attr_id, selector);
+		if (!entry) {
+			result->result_code = cpu_to_le16(GB_OP_NONEXISTENT);
+			continue;
+		}
+
+		if (attr->op == GB_SVC_DME_BATCH_OP_SET) {
+			ret = entry->dme_set ?
+				entry->dme_set(dld, req->intf_id, attr_id,
+					       selector,
+					       le32_to_cpu(attr->value)) : 0;
+		} else if (entry->dme_get) {
+			ret = entry->dme_get(dld, req->intf_id, attr_id,
+					     selector, &value);
+		} else {
+			ret = 0;
+			value = entry->default_value;
+		}
+
+		result->result_code = cpu_to_le16(gb_operation_errno_map(ret));
+		result->attr_value = cpu_to_le32(value);
+	}
+
+	ret = svc_gb_send_response(dld, cport, req_msg, resp_size, resp,
+				   GB_OP_SUCCESS);
+	if (ret)
+		dev_err(&dd->pdev->dev,
+			"Failed response to DME_BATCH request (tag %u)\n",
+			le16_to_cpu(req->tag));
+
+	kfree(resp);
+
+	return 0;
+}
+
 static int
 muc_svc_handle_ap_request(struct mods_dl_device *dld, uint8_t *data,
 			  size_t msg_size, uint16_t cport)
@@ -1113,6 +1216,9 @@ muc_svc_handle_ap_request(struct mods_dl_device *dld, uint8_t *data,
 	case GB_SVC_TYPE_DME_PEER_SET:
 		ret = svc_gb_dme_set(dld, req, cport);
 		goto free_request;
+	case GB_SVC_TYPE_DME_PEER_BATCH:
+		ret = svc_gb_dme_batch(dld, req, cport);
+		goto free_request;
 	default:
 		dev_err(&dd->pdev->dev, "Unsupported AP Request type: %d\n",
 					hdr.type);
@@ -1139,11 +1245,12 @@ free_request:
 	return ret;
 }
 
-static struct mods_dl_device *dev_from_intf(u8 intf_id)
+static struct mods_dl_device *
+dev_from_intf(struct muc_svc_data *dd, u8 intf_id)
 {
 	struct mods_dl_device *mods_dev;
 
-	list_for_each_entry(mods_dev, &svc_dd->ext_intf, list)
+	list_for_each_entry(mods_dev, &dd->ext_intf, list)
 		if (mods_dev->intf_id == intf_id)
 			return mods_dev;
 
@@ -1159,13 +1266,13 @@ mods_slave_state(struct mods_dl_device *dld, struct gb_message *req,
 	struct gb_control_slave_state_request *msg = req->payload;
 	u8 intf_id;
 
-	mutex_lock(&svc_list_lock);
+	mutex_lock(&dd->list_lock);
 
 	intf_id = SVC_VENDOR_CTRL_INTF(cport);
-	mods_dev = dev_from_intf(intf_id);
+	mods_dev = dev_from_intf(dd, intf_id);
 	if (!mods_dev) {
 		dev_err(&dd->pdev->dev, "Interface not found: %d\n", intf_id);
-		mutex_unlock(&svc_list_lock);
+		mutex_unlock(&dd->list_lock);
 		return -EINVAL;
 	}
 
@@ -1175,7 +1282,7 @@ mods_slave_state(struct mods_dl_device *dld, struct gb_message *req,
 	/* Notify listeners */
 	muc_svc_broadcast_slave_notification(mods_dev);
 
-	mutex_unlock(&svc_list_lock);
+	mutex_unlock(&dd->list_lock);
 	return 0;
 }
 
@@ -1188,12 +1295,12 @@ muc_svc_capability_changed(struct mods_dl_device *dld, struct gb_message *msg,
 	struct mb_control_capability_changed_request *req = msg->payload;
 	u8 intf_id;
 
-	mutex_lock(&svc_list_lock);
+	mutex_lock(&dd->list_lock);
 	intf_id = SVC_VENDOR_CTRL_INTF(cport);
-	mods_dev = dev_from_intf(intf_id);
+	mods_dev = dev_from_intf(dd, intf_id);
 	if (!mods_dev) {
 		dev_err(&dd->pdev->dev, "Interface not found: %d\n", intf_id);
-		mutex_unlock(&svc_list_lock);
+		mutex_unlock(&dd->list_lock);
 		return -EINVAL;
 	}
 
@@ -1204,7 +1311,7 @@ muc_svc_capability_changed(struct mods_dl_device *dld, struct gb_message *msg,
 	muc_svc_send_kobj_uevent(&mods_dev->intf_kobj,
 				"MOD_EVENT=CAPABILITY_CHANGED");
 
-	mutex_unlock(&svc_list_lock);
+	mutex_unlock(&dd->list_lock);
 	return 0;
 }
 
@@ -1217,12 +1324,12 @@ muc_svc_current_rsv(struct mods_dl_device *dld, struct gb_message *msg,
 	struct mb_control_current_rsv_request *req = msg->payload;
 	u8 intf_id;
 
-	mutex_lock(&svc_list_lock);
+	mutex_lock(&dd->list_lock);
 	intf_id = SVC_VENDOR_CTRL_INTF(cport);
-	mods_dev = dev_from_intf(intf_id);
+	mods_dev = dev_from_intf(dd, intf_id);
 	if (!mods_dev) {
 		dev_err(&dd->pdev->dev, "Interface not found: %d\n", intf_id);
-		mutex_unlock(&svc_list_lock);
+		mutex_unlock(&dd->list_lock);
 		return -EINVAL;
 	}
 	mods_dev->high_current_reserved = !!req->rsv;
@@ -1233,7 +1340,7 @@ muc_svc_current_rsv(struct mods_dl_device *dld, struct gb_message *msg,
 			req->rsv ? "MOD_EVENT=RESERVE_CURRENT" :
 				   "MOD_EVENT=RELEASE_CURRENT");
 
-	mutex_unlock(&svc_list_lock);
+	mutex_unlock(&dd->list_lock);
 	return 0;
 }
 
@@ -1320,14 +1427,14 @@ svc_gb_msg_recv(struct mods_dl_device *dld, uint8_t *data,
 
 		op->response = svc_gb_msg_alloc(MUC_SVC_RESPONSE_TYPE, payload_size);
 		if (!op->response) {
-			svc_op_put(op);
+			svc_op_put(dd, op);
 			return -ENOMEM;
 		}
 
 		memcpy(op->response->header, data, msg_size);
 		complete(&op->completion);
 
-		svc_op_put(op);
+		svc_op_put(dd, op);
 
 		return 0;
 	}
@@ -1373,9 +1480,9 @@ _svc_gb_msg_send_sync(struct mods_dl_device *dld, uint8_t *data, uint8_t type,
 		init_completion(&op->completion);
 
 		msg->header->operation_id = cpu_to_le16(op->msg_id);
-		spin_lock_irqsave(&svc_ops_lock, flags);
+		spin_lock_irqsave(&dd->ops_lock, flags);
 		list_add_tail(&op->entry, &dd->operations);
-		spin_unlock_irqrestore(&svc_ops_lock, flags);
+		spin_unlock_irqrestore(&dd->ops_lock, flags);
 	}
 
 	/* Send to NW Routing Layer */
@@ -1389,7 +1496,7 @@ _svc_gb_msg_send_sync(struct mods_dl_device *dld, uint8_t *data, uint8_t type,
 
 	/* If not waiting for response, we're done */
 	if (!response) {
-		svc_op_put(op);
+		svc_op_put(dd, op);
 		return NULL;
 	}
 
@@ -1405,32 +1512,32 @@ _svc_gb_msg_send_sync(struct mods_dl_device *dld, uint8_t *data, uint8_t type,
 	}
 
 	/* Remove and free the request */
-	spin_lock_irqsave(&svc_ops_lock, flags);
+	spin_lock_irqsave(&dd->ops_lock, flags);
 	list_del(&op->entry);
-	spin_unlock_irqrestore(&svc_ops_lock, flags);
+	spin_unlock_irqrestore(&dd->ops_lock, flags);
 
 	msg = op->response;
 	if (msg->header->result) {
 		int err = gb_operation_status_map(msg->header->result);
 
-		svc_op_put(op);
+		svc_op_put(dd, op);
 		return ERR_PTR(err);
 	}
 
 	/* We don't wish to free the response buffer yet */
 	op->response = NULL;
-	svc_op_put(op);
+	svc_op_put(dd, op);
 
 	return msg;
 
 remove_op:
-	spin_lock_irqsave(&svc_ops_lock, flags);
+	spin_lock_irqsave(&dd->ops_lock, flags);
 	if (response)
 		list_del(&op->entry);
-	spin_unlock_irqrestore(&svc_ops_lock, flags);
+	spin_unlock_irqrestore(&dd->ops_lock, flags);
 
 gb_msg_alloc:
-	svc_op_put(op);
+	svc_op_put(dd, op);
 
 	return ERR_PTR(ret);
 }
@@ -1557,32 +1664,34 @@ muc_svc_probe_ap(struct mods_dl_device *dld, uint8_t ap_intf_id)
  *
  * The slave_lock must be held to ensure 'atomic' sequence.
  */
-static void muc_svc_check_slave_present(struct mods_slave_ctrl_driver *drv)
+static void muc_svc_check_slave_present(struct muc_svc_data *dd,
+					struct mods_slave_ctrl_driver *drv)
 {
 	struct mods_dl_device *mods_dev;
 
 	if (!drv->slave_notify)
 		return;
 
-	mutex_lock(&svc_list_lock);
-	list_for_each_entry(mods_dev, &svc_dd->ext_intf, list)
+	mutex_lock(&dd->list_lock);
+	list_for_each_entry(mods_dev, &dd->ext_intf, list)
 		if (mods_dev->slave_mask)
 			drv->slave_notify(mods_dev->intf_id,
 				mods_dev->slave_mask, mods_dev->slave_state);
-	mutex_unlock(&svc_list_lock);
+	mutex_unlock(&dd->list_lock);
 }
 
 /* Notify all Slave Control Drivers of the new slave mask */
 static void muc_svc_broadcast_slave_notification(struct mods_dl_device *master)
 {
+	struct muc_svc_data *dd = master->svc;
 	struct mods_slave_ctrl_driver *drv;
 
-	mutex_lock(&slave_lock);
-	list_for_each_entry(drv, &svc_dd->slave_drv, list)
+	mutex_lock(&dd->slave_lock);
+	list_for_each_entry(drv, &dd->slave_drv, list)
 		if (drv->slave_notify)
 			drv->slave_notify(master->intf_id, master->slave_mask,
 						master->slave_state);
-	mutex_unlock(&slave_lock);
+	mutex_unlock(&dd->slave_lock);
 }
 
 static int
@@ -1772,26 +1881,28 @@ static void muc_svc_destroy_control_route(u8 intf_id, u16 src, u16 dest)
 static void muc_svc_attach_work(struct work_struct *work)
 {
 	struct muc_svc_hotplug_work *hpw;
+	struct muc_svc_data *dd;
 	struct gb_message *msg;
 
 	hpw = container_of(work, struct muc_svc_hotplug_work, work);
+	dd = hpw->dld->svc;
 
 	if (hpw->dld->hotplug_sent)
 		return;
 
-	msg = svc_gb_msg_send_sync_timeout(svc_dd->dld,
+	msg = svc_gb_msg_send_sync_timeout(dd->dld,
 					(uint8_t *)&hpw->hotplug,
 					GB_SVC_TYPE_INTF_HOTPLUG,
 					sizeof(hpw->hotplug), GB_SVC_CPORT_ID,
 					SVC_AP_HOTPLUG_UNPLUG_TIMEOUT);
 	if (IS_ERR(msg)) {
-		dev_err(&svc_dd->pdev->dev, "[%d] Failed to send HOTPLUG\n",
+		dev_err(&dd->pdev->dev, "[%d] Failed to send HOTPLUG\n",
 			hpw->hotplug.intf_id);
 		return;
 	}
 
 	hpw->dld->hotplug_sent = true;
-	dev_info(&svc_dd->pdev->dev, "[%d] Successfully sent HOTPLUG\n",
+	dev_info(&dd->pdev->dev, "[%d] Successfully sent HOTPLUG\n",
 			hpw->hotplug.intf_id);
 
 	svc_gb_msg_free(msg);
@@ -1801,6 +1912,7 @@ static int muc_svc_control_version(struct mods_dl_device *mods_dev, u8 type,
 					u8 host_major, u8 host_minor,
 					uint16_t cport, u8 *major, u8 *minor)
 {
+	struct muc_svc_data *dd = mods_dev->svc;
 	struct gb_protocol_version_response *ver;
 	struct gb_message *msg;
 
@@ -1811,7 +1923,7 @@ static int muc_svc_control_version(struct mods_dl_device *mods_dev, u8 type,
 	ver->major = host_major;
 	ver->minor = host_minor;
 
-	msg = svc_gb_msg_send_sync(svc_dd->dld, (uint8_t *)ver,
+	msg = svc_gb_msg_send_sync(dd->dld, (uint8_t *)ver,
 				type, sizeof(*ver), cport);
 	if (IS_ERR(msg)) {
 		kfree(ver);
@@ -1821,7 +1933,7 @@ static int muc_svc_control_version(struct mods_dl_device *mods_dev, u8 type,
 	kfree(ver);
 	ver = msg->payload;
 
-	dev_dbg(&svc_dd->pdev->dev, "[%d] CONTROL VERSION: %hhu.%hhu\n",
+	dev_dbg(&dd->pdev->dev, "[%d] CONTROL VERSION: %hhu.%hhu\n",
 		cport, ver->major, ver->minor);
 
 	*major = ver->major;
@@ -1832,15 +1944,15 @@ static int muc_svc_control_version(struct mods_dl_device *mods_dev, u8 type,
 	return 0;
 }
 
-static int muc_svc_version_heartbeat(void)
+static int muc_svc_version_heartbeat(struct muc_svc_data *dd)
 {
 	struct mods_dl_device *mods_dev;
 	int ret = -ENODEV;
 	u8 major;
 	u8 minor;
 
-	mutex_lock(&svc_list_lock);
-	list_for_each_entry(mods_dev, &svc_dd->ext_intf, list) {
+	mutex_lock(&dd->list_lock);
+	list_for_each_entry(mods_dev, &dd->ext_intf, list) {
 		ret = muc_svc_control_version(mods_dev,
 				MB_CONTROL_TYPE_PROTOCOL_VERSION,
 				MB_CONTROL_VERSION_MAJOR,
@@ -1850,7 +1962,7 @@ static int muc_svc_version_heartbeat(void)
 		if (ret)
 			break;
 	}
-	mutex_unlock(&svc_list_lock);
+	mutex_unlock(&dd->list_lock);
 
 	if (!ret)
 		pr_debug("%s: version heartbeats succeeded\n", __func__);
@@ -1858,13 +1970,148 @@ static int muc_svc_version_heartbeat(void)
 	return ret;
 }
 
+/*
+ * Manifests of recently attached mods, kept across detach so re-inserting
+ * the same mod (or a soft reset) does not transfer the manifest again.
+ * Entries are only reused when the mod reports the same manifest hash.
+ */
+#define MUC_SVC_MANIFEST_CACHE_MAX	4
+
+struct muc_svc_manifest_entry {
+	struct list_head list;
+	u32 vend_id;
+	u32 prod_id;
+	u32 fw_version;
+	u16 size;
+	u32 crc32;
+	char data[];
+};
+
+static LIST_HEAD(manifest_cache);
+static DEFINE_MUTEX(manifest_cache_lock);
+static int manifest_cache_entries;
+
+static inline u32 muc_svc_manifest_crc32(const char *data, size_t size)
+{
+	return crc32_le(~0, data, size) ^ ~0;
+}
+
+/* Returns a copy of the cached manifest, or NULL on a miss */
+static char *muc_svc_manifest_cache_lookup(struct mods_dl_device *mods_dev,
+					u16 size, u32 crc)
+{
+	struct gb_svc_intf_hotplug_request *hotplug = &mods_dev->hpw->hotplug;
+	struct muc_svc_manifest_entry *entry;
+	char *manifest = NULL;
+
+	mutex_lock(&manifest_cache_lock);
+	list_for_each_entry(entry, &manifest_cache, list) {
+		if (entry->vend_id != hotplug->data.ara_vend_id ||
+		    entry->prod_id != hotplug->data.ara_prod_id ||
+		    entry->fw_version != mods_dev->fw_version ||
+		    entry->size != size || entry->crc32 != crc)
+			continue;
+
+		manifest = kmemdup(entry->data, size, GFP_KERNEL);
+		/* keep the most recently used entry at the head */
+		list_move(&entry->list, &manifest_cache);
+		break;
+	}
+	mutex_unlock(&manifest_cache_lock);
+
+	return manifest;
+}
+
+static void muc_svc_manifest_cache_add(struct mods_dl_device *mods_dev)
+{
+	struct gb_svc_intf_hotplug_request *hotplug = &mods_dev->hpw->hotplug;
+	struct muc_svc_manifest_entry *entry;
+	u16 size = mods_dev->manifest_size;
+
+	entry = kmalloc(sizeof(*entry) + size, GFP_KERNEL);
+	if (!entry)
+		return;
+
+	entry->vend_id = hotplug->data.ara_vend_id;
+	entry->prod_id = hotplug->data.ara_prod_id;
+	entry->fw_version = mods_dev->fw_version;
+	entry->size = size;
+	entry->crc32 = muc_svc_manifest_crc32(mods_dev->manifest, size);
+	memcpy(entry->data, mods_dev->manifest, size);
+
+	mutex_lock(&manifest_cache_lock);
+	list_add(&entry->list, &manifest_cache);
+	if (++manifest_cache_entries > MUC_SVC_MANIFEST_CACHE_MAX) {
+		entry = list_last_entry(&manifest_cache,
+				struct muc_svc_manifest_entry, list);
+		list_del(&entry->list);
+		kfree(entry);
+		manifest_cache_entries--;
+	}
+	mutex_unlock(&manifest_cache_lock);
+}
+
+static void muc_svc_manifest_cache_clear(void)
+{
+	struct muc_svc_manifest_entry *entry, *next;
+
+	mutex_lock(&manifest_cache_lock);
+	list_for_each_entry_safe(entry, next, &manifest_cache, list) {
+		list_del(&entry->list);
+		kfree(entry);
+	}
+	manifest_cache_entries = 0;
+	mutex_unlock(&manifest_cache_lock);
+}
+
+/* Try to satisfy the manifest from the cache, returns true on a hit */
+static bool muc_svc_get_cached_manifest(struct mods_dl_device *mods_dev)
+{
+	struct muc_svc_data *dd = mods_dev->svc;
+	struct mb_control_get_manifest_hash_response *hash;
+	struct gb_message *msg;
+	u16 size;
+	u32 crc;
+
+	if (!MB_CONTROL_SUPPORTS(mods_dev, MANIFEST_HASH))
+		return false;
+
+	/* GET_MANIFEST_HASH has no payload */
+	msg = svc_gb_msg_send_sync(dd->dld, NULL,
+				MB_CONTROL_TYPE_GET_MANIFEST_HASH, 0,
+				SVC_VENDOR_CTRL_CPORT(mods_dev->intf_id));
+	if (IS_ERR(msg))
+		return false;
+
+	if (msg->payload_size < sizeof(*hash)) {
+		svc_gb_msg_free(msg);
+		return false;
+	}
+
+	hash = msg->payload;
+	size = le16_to_cpu(hash->size);
+	crc = le32_to_cpu(hash->crc32);
+	svc_gb_msg_free(msg);
+
+	mods_dev->manifest = muc_svc_manifest_cache_lookup(mods_dev, size, crc);
+	if (!mods_dev->manifest)
+		return false;
+
+	mods_dev->manifest_size = size;
+	mods_dev->manifest_cached = true;
+
+	return true;
+}
+
 static int
 muc_svc_get_manifest(struct mods_dl_device *mods_dev, uint16_t out_cport)
 {
+	struct muc_svc_data *dd = mods_dev->svc;
 	struct gb_control_get_manifest_size_response *size_resp;
-	struct device *dev = &svc_dd->pdev->dev;
+	struct device *dev = &dd->pdev->dev;
 	struct gb_message *msg;
 	u8 type = GB_REQUEST_TYPE_PROTOCOL_VERSION;
+	ktime_t start;
 	int err;
 
 	err = muc_svc_control_version(mods_dev, type,
@@ -1879,8 +2126,14 @@ muc_svc_get_manifest(struct mods_dl_device *mods_dev, uint16_t out_cport)
 		return err;
 	}
 
+	start = ktime_get();
+	mods_dev->manifest_cached = false;
+
+	if (muc_svc_get_cached_manifest(mods_dev))
+		goto manifest_ready;
+
 	/* GET_SIZE has no payload */
-	msg = svc_gb_msg_send_sync(svc_dd->dld, NULL,
+	msg = svc_gb_msg_send_sync(dd->dld, NULL,
 					GB_CONTROL_TYPE_GET_MANIFEST_SIZE,
 					0, out_cport);
 	if (IS_ERR(msg)) {
@@ -1901,7 +2154,7 @@ muc_svc_get_manifest(struct mods_dl_device *mods_dev, uint16_t out_cport)
 	}
 
 	/* GET_MANIFEST has no payload */
-	msg = svc_gb_msg_send_sync(svc_dd->dld, NULL,
+	msg = svc_gb_msg_send_sync(dd->dld, NULL,
 					GB_CONTROL_TYPE_GET_MANIFEST,
 					0, out_cport);
 	if (IS_ERR(msg)) {
@@ -1915,6 +2168,14 @@ muc_svc_get_manifest(struct mods_dl_device *mods_dev, uint16_t out_cport)
 
 	svc_gb_msg_free(msg);
 
+	muc_svc_manifest_cache_add(mods_dev);
+
+manifest_ready:
+	dev_info(dev, "[%d] MANIFEST: %u bytes in %lld us%s\n",
+		mods_dev->intf_id, mods_dev->manifest_size,
+		ktime_us_delta(ktime_get(), start),
+		mods_dev->manifest_cached ? " (cached)" : "");
+
 	/* Update with the latest size and notify userspace */
 	mods_dev->manifest_attr.size = mods_dev->manifest_size;
 
@@ -1935,6 +2196,7 @@ clear_size:
 
 static int muc_svc_send_rtc_sync(struct mods_dl_device *mods_dev)
 {
+	struct muc_svc_data *dd = mods_dev->svc;
 	int ret;
 	struct timespec ts;
 	struct mb_control_rtc_sync_request req;
@@ -1945,7 +2207,7 @@ static int muc_svc_send_rtc_sync(struct mods_dl_device *mods_dev)
 	getnstimeofday(&ts);
 	req.nsec = cpu_to_le64(timespec_to_ns(&ts));
 
-	ret = svc_gb_msg_send_no_resp(svc_dd->dld, (uint8_t *)&req,
+	ret = svc_gb_msg_send_no_resp(dd->dld, (uint8_t *)&req,
 				MB_CONTROL_TYPE_RTC_SYNC, sizeof(req),
 				SVC_VENDOR_CTRL_CPORT(mods_dev->intf_id));
 
@@ -1954,7 +2216,8 @@ static int muc_svc_send_rtc_sync(struct mods_dl_device *mods_dev)
 
 static int muc_svc_send_test_mode(struct mods_dl_device *mods_dev, uint32_t val)
 {
-	struct device *dev = &svc_dd->pdev->dev;
+	struct muc_svc_data *dd = mods_dev->svc;
+	struct device *dev = &dd->pdev->dev;
 	struct gb_message *msg;
 	struct mb_control_test_mode_request request;
 
@@ -1963,7 +2226,7 @@ static int muc_svc_send_test_mode(struct mods_dl_device *mods_dev, uint32_t val)
 
 	request.value = cpu_to_le32(val);
 
-	msg = svc_gb_msg_send_sync(svc_dd->dld, (uint8_t *)&request,
+	msg = svc_gb_msg_send_sync(dd->dld, (uint8_t *)&request,
 				MB_CONTROL_TYPE_TEST_MODE, sizeof(request),
 				SVC_VENDOR_CTRL_CPORT(mods_dev->intf_id));
 
@@ -1980,6 +2243,7 @@ static int muc_svc_send_test_mode(struct mods_dl_device *mods_dev, uint32_t val)
 
 static int muc_svc_create_hotplug_work(struct mods_dl_device *mods_dev)
 {
+	struct muc_svc_data *dd = mods_dev->svc;
 	struct muc_svc_hotplug_work *hpw;
 	int ret;
 
@@ -1996,7 +2260,7 @@ static int muc_svc_create_hotplug_work(struct mods_dl_device *mods_dev)
 	ret = muc_svc_create_control_route(mods_dev->intf_id,
 				mods_dev->intf_id, GB_CONTROL_CPORT_ID);
 	if (ret) {
-		dev_err(&svc_dd->pdev->dev,
+		dev_err(&dd->pdev->dev,
 			"[%d] Failed setup GB CONTROL route\n",
 			mods_dev->intf_id);
 		goto free_hpw;
@@ -2011,7 +2275,7 @@ static int muc_svc_create_hotplug_work(struct mods_dl_device *mods_dev)
 				&mods_dev->mb_ctrl_major,
 				&mods_dev->mb_ctrl_minor);
 	if (ret) {
-		dev_err(&svc_dd->pdev->dev,
+		dev_err(&dd->pdev->dev,
 			"[%d] Failed VERSION on VENDOR CONTROL\n",
 			mods_dev->intf_id);
 		goto free_route;
@@ -2026,7 +2290,7 @@ static int muc_svc_create_hotplug_work(struct mods_dl_device *mods_dev)
 		goto free_route;
 
 	/* Get the hotplug IDs */
-	ret = muc_svc_get_hotplug_data(svc_dd->dld, &hpw->hotplug, mods_dev);
+	ret = muc_svc_get_hotplug_data(dd->dld, &hpw->hotplug, mods_dev);
 	if (ret)
 		goto free_route;
 
@@ -2034,13 +2298,13 @@ static int muc_svc_create_hotplug_work(struct mods_dl_device *mods_dev)
 
 	/* Get the hardware's core version if protocol reported support */
 	if (MB_CONTROL_SUPPORTS(mods_dev, GET_ROOT_VER)) {
-		ret = muc_svc_get_root_version(svc_dd->dld, mods_dev);
+		ret = muc_svc_get_root_version(dd->dld, mods_dev);
 		if (ret)
 			goto free_route;
 	}
 
 	if (MB_CONTROL_SUPPORTS(mods_dev, GET_PWRUP_REASON))
-		muc_svc_get_pwrup_reason(svc_dd->dld, mods_dev);
+		muc_svc_get_pwrup_reason(dd->dld, mods_dev);
 
 	mods_dev->hpw = hpw;
 
@@ -2066,20 +2330,22 @@ free_hpw:
 
 static int muc_svc_generate_hotplug(struct mods_dl_device *mods_dev)
 {
+	struct muc_svc_data *dd = mods_dev->svc;
 	int ret;
 
 	ret = muc_svc_create_hotplug_work(mods_dev);
 	if (ret)
 		return ret;
 
-	if (svc_dd->authenticate == false)
-		queue_work(svc_dd->wq, &mods_dev->hpw->work);
+	if (dd->authenticate == false)
+		queue_work(dd->wq, &mods_dev->hpw->work);
 
 	return 0;
 }
 
 static int muc_svc_generate_unplug(struct mods_dl_device *mods_dev, bool attached)
 {
+	struct muc_svc_data *dd = mods_dev->svc;
 	struct gb_message *msg;
 	struct gb_svc_intf_hot_unplug_request unplug;
 
@@ -2090,19 +2356,19 @@ static int muc_svc_generate_unplug(struct mods_dl_device *mods_dev, bool attache
 	unplug.intf_id = mods_dev->intf_id;
 	unplug.attach_state = attached ? 1 : 0;
 
-	msg = svc_gb_msg_send_sync_timeout(svc_dd->dld, (uint8_t *)&unplug,
+	msg = svc_gb_msg_send_sync_timeout(dd->dld, (uint8_t *)&unplug,
 					GB_SVC_TYPE_INTF_HOT_UNPLUG,
 					sizeof(unplug), GB_SVC_CPORT_ID,
 					SVC_AP_HOTPLUG_UNPLUG_TIMEOUT);
 	if (IS_ERR(msg)) {
-		dev_err(&svc_dd->pdev->dev, "[%d] Failed to send UNPLUG\n",
+		dev_err(&dd->pdev->dev, "[%d] Failed to send UNPLUG\n",
 			mods_dev->intf_id);
 		return PTR_ERR(msg);
 	}
 
 	svc_gb_msg_free(msg);
 
-	dev_info(&svc_dd->pdev->dev, "[%d] Successfully sent UNPLUG\n",
+	dev_info(&dd->pdev->dev, "[%d] Successfully sent UNPLUG\n",
 			mods_dev->intf_id);
 
 	return 0;
@@ -2110,6 +2376,8 @@ static int muc_svc_generate_unplug(struct mods_dl_device *mods_dev, bool attache
 
 void mods_dl_dev_detached(struct mods_dl_device *mods_dev)
 {
+	struct muc_svc_data *dd = mods_dev->svc;
+
 	/* AP is special case */
 	if (mods_dev->intf_id == MODS_INTF_AP) {
 		mods_nw_del_route(MODS_INTF_SVC, 0, MODS_INTF_AP, 0);
@@ -2120,9 +2388,9 @@ void mods_dl_dev_detached(struct mods_dl_device *mods_dev)
 
 	muc_svc_destroy_dl_dev_sysfs(mods_dev);
 
-	mutex_lock(&svc_list_lock);
+	mutex_lock(&dd->list_lock);
 	list_del(&mods_dev->list);
-	mutex_unlock(&svc_list_lock);
+	mutex_unlock(&dd->list_lock);
 
 	flush_work(&mods_dev->hpw->work);
 
@@ -2151,6 +2419,7 @@ EXPORT_SYMBOL_GPL(mods_dl_dev_detached);
  */
 int mods_dl_dev_attached(struct mods_dl_device *mods_dev)
 {
+	struct muc_svc_data *dd = mods_dev->svc;
 	int err;
 	struct mods_dl_device *existing;
 
@@ -2164,7 +2433,7 @@ int mods_dl_dev_attached(struct mods_dl_device *mods_dev)
 		if (err)
 			goto free_svc_to_ap;
 
-		err = muc_svc_probe_ap(svc_dd->dld, MODS_INTF_AP);
+		err = muc_svc_probe_ap(dd->dld, MODS_INTF_AP);
 		if (err)
 			goto free_ap_to_svc;
 
@@ -2172,26 +2441,26 @@ int mods_dl_dev_attached(struct mods_dl_device *mods_dev)
 	}
 
 	/* Make sure the interface doesn't already exist */
-	mutex_lock(&svc_list_lock);
+	mutex_lock(&dd->list_lock);
 
-	list_for_each_entry(existing, &svc_dd->ext_intf, list)
+	list_for_each_entry(existing, &dd->ext_intf, list)
 		if (existing->intf_id == mods_dev->intf_id) {
-			dev_err(&svc_dd->pdev->dev,
+			dev_err(&dd->pdev->dev,
 				"[%d] Interface already exists\n",
 				mods_dev->intf_id);
-			mutex_unlock(&svc_list_lock);
+			mutex_unlock(&dd->list_lock);
 			return -EEXIST;
 		}
 
-	list_add_tail(&mods_dev->list, &svc_dd->ext_intf);
-	mutex_unlock(&svc_list_lock);
+	list_add_tail(&mods_dev->list, &dd->ext_intf);
+	mutex_unlock(&dd->list_lock);
 
 	/* Create route for vendor control protocol on reserved CPORT */
 	err = muc_svc_create_control_route(mods_dev->intf_id,
 				SVC_VENDOR_CTRL_CPORT(mods_dev->intf_id),
 				VENDOR_CTRL_DEST_CPORT);
 	if (err) {
-		dev_err(&svc_dd->pdev->dev,
+		dev_err(&dd->pdev->dev,
 			"[%d] VENDOR CONTROL setup failed\n",
 			mods_dev->intf_id);
 		goto recovery;
@@ -2211,15 +2480,15 @@ free_ext_ctrl:
 			SVC_VENDOR_CTRL_CPORT(mods_dev->intf_id),
 			VENDOR_CTRL_DEST_CPORT);
 recovery:
-	mutex_lock(&svc_list_lock);
+	mutex_lock(&dd->list_lock);
 	list_del(&mods_dev->list);
-	mutex_unlock(&svc_list_lock);
+	mutex_unlock(&dd->list_lock);
 
 	/* Only do a recovery if the mod still here, if it was removed
 	 * we likely failed due to that.
 	 */
-	if (!svc_dd->mod_attached)
-		muc_svc_recovery();
+	if (!dd->mod_attached)
+		muc_svc_recovery(dd);
 
 	return err;
 
@@ -2232,7 +2501,8 @@ free_svc_to_ap:
 }
 EXPORT_SYMBOL_GPL(mods_dl_dev_attached);
 
-struct mods_dl_device *_mods_create_dl_device(struct mods_dl_driver *drv,
+static struct mods_dl_device *
+_mods_create_dl_device(struct muc_svc_data *dd, struct mods_dl_driver *drv,
 		struct device *dev, u8 intf_id)
 {
 	struct mods_dl_device *mods_dev;
@@ -2247,6 +2517,7 @@ struct mods_dl_device *_mods_create_dl_device(struct mods_dl_driver *drv,
 	mods_dev->drv = drv;
 	mods_dev->dev = dev;
 	mods_dev->intf_id = intf_id;
+	mods_dev->svc = dd;
 
 	ret = mods_nw_add_dl_device(mods_dev);
 	if (ret) {
@@ -2262,9 +2533,9 @@ void mods_dl_device_get(struct mods_dl_device *mods_dev)
 {
 	unsigned long flags;
 
-	spin_lock_irqsave(&svc_ops_lock, flags);
+	spin_lock_irqsave(&mods_dev->svc->ops_lock, flags);
 	kref_get(&mods_dev->kref);
-	spin_unlock_irqrestore(&svc_ops_lock, flags);
+	spin_unlock_irqrestore(&mods_dev->svc->ops_lock, flags);
 }
 
 struct mods_dl_device *mods_create_dl_device(struct mods_dl_driver *drv,
@@ -2274,7 +2545,7 @@ struct mods_dl_device *mods_create_dl_device(struct mods_dl_driver *drv,
 	if (!svc_dd)
 		return ERR_PTR(-ENODEV);
 
-	return _mods_create_dl_device(drv, dev, intf_id);
+	return _mods_create_dl_device(svc_dd, drv, dev, intf_id);
 }
 EXPORT_SYMBOL_GPL(mods_create_dl_device);
 
@@ -2289,11 +2560,13 @@ static void mods_dl_device_free(struct kref *kref)
 
 void mods_dl_device_put(struct mods_dl_device *mods_dev)
 {
+	/* mods_dev may be freed by the put, don't unlock through it */
+	struct muc_svc_data *dd = mods_dev->svc;
 	unsigned long flags;
 
-	spin_lock_irqsave(&svc_ops_lock, flags);
+	spin_lock_irqsave(&dd->ops_lock, flags);
 	kref_put(&mods_dev->kref, mods_dl_device_free);
-	spin_unlock_irqrestore(&svc_ops_lock, flags);
+	spin_unlock_irqrestore(&dd->ops_lock, flags);
 }
 
 void mods_remove_dl_device(struct mods_dl_device *dev)
@@ -2308,19 +2581,22 @@ int mods_slave_ctrl_power(uint16_t master_id, uint8_t mode, uint32_t slave_id)
 	struct gb_message *msg;
 	struct mb_svc_slave_power_ctrl power;
 	struct mods_dl_device *mods_dev = mods_nw_get_dl_device(master_id);
+	struct muc_svc_data *dd;
 
 	if (!mods_dev)
 		return -ENODEV;
 
+	dd = mods_dev->svc;
+
 	power.mode = mode;
 	power.slave_id = cpu_to_le32(slave_id);
 
-	msg = svc_gb_msg_send_sync(svc_dd->dld, (uint8_t *)&power,
+	msg = svc_gb_msg_send_sync(dd->dld, (uint8_t *)&power,
 				MB_CONTROL_TYPE_SLAVE_POWER,
 				sizeof(power),
 				SVC_VENDOR_CTRL_CPORT(master_id));
 	if (IS_ERR(msg)) {
-		dev_err(&svc_dd->pdev->dev,
+		dev_err(&dd->pdev->dev,
 			"[%d] Failed send SLAVE_POWER for %d\n",
 			mods_dev->intf_id, slave_id);
 		return PTR_ERR(msg);
@@ -2337,10 +2613,10 @@ int mods_register_slave_ctrl_driver(struct mods_slave_ctrl_driver *drv)
 	if (!svc_dd)
 		return -ENODEV;
 
-	mutex_lock(&slave_lock);
+	mutex_lock(&svc_dd->slave_lock);
 	list_add_tail(&drv->list, &svc_dd->slave_drv);
-	muc_svc_check_slave_present(drv);
-	mutex_unlock(&slave_lock);
+	muc_svc_check_slave_present(svc_dd, drv);
+	mutex_unlock(&svc_dd->slave_lock);
 
 	return 0;
 }
@@ -2351,9 +2627,9 @@ void mods_unregister_slave_ctrl_driver(struct mods_slave_ctrl_driver *drv)
 	if (!svc_dd)
 		return;
 
-	mutex_lock(&slave_lock);
+	mutex_lock(&svc_dd->slave_lock);
 	list_del(&drv->list);
-	mutex_unlock(&slave_lock);
+	mutex_unlock(&svc_dd->slave_lock);
 }
 EXPORT_SYMBOL_GPL(mods_unregister_slave_ctrl_driver);
 
@@ -2374,9 +2650,10 @@ static int
 svc_filter_ap_control_ver(struct mods_dl_device *orig_dev,
 			uint8_t *payload, size_t size)
 {
+	struct muc_svc_data *dd = orig_dev->svc;
 	struct muc_msg *mm = (struct muc_msg *)payload;
 	struct gb_message msg;
-	struct device *dev = &svc_dd->pdev->dev;
+	struct device *dev = &dd->pdev->dev;
 	struct gb_protocol_version_response resp;
 	int ret;
 
@@ -2398,9 +2675,10 @@ static int
 svc_filter_ap_manifest_size(struct mods_dl_device *orig_dev,
 			uint8_t *payload, size_t size)
 {
+	struct muc_svc_data *dd = orig_dev->svc;
 	struct muc_msg *mm = (struct muc_msg *)payload;
 	struct gb_message msg;
-	struct device *dev = &svc_dd->pdev->dev;
+	struct device *dev = &dd->pdev->dev;
 	struct gb_control_get_manifest_size_response resp;
 	int ret;
 
@@ -2424,9 +2702,10 @@ static int
 svc_filter_ap_manifest(struct mods_dl_device *orig_dev,
 			uint8_t *payload, size_t size)
 {
+	struct muc_svc_data *dd = orig_dev->svc;
 	struct muc_msg *mm = (struct muc_msg *)payload;
 	struct gb_message msg;
-	struct device *dev = &svc_dd->pdev->dev;
+	struct device *dev = &dd->pdev->dev;
 	uint16_t mnf_size;
 	int ret;
 
@@ -2452,7 +2731,8 @@ static int
 svc_filter_ready_to_boot(struct mods_dl_device *orig_dev,
 			uint8_t *payload, size_t size)
 {
-	struct device *dev = &svc_dd->pdev->dev;
+	struct muc_svc_data *dd = orig_dev->svc;
+	struct device *dev = &dd->pdev->dev;
 	struct mods_dl_device *mods_dev;
 	bool slave_present;
 
@@ -2461,17 +2741,17 @@ svc_filter_ready_to_boot(struct mods_dl_device *orig_dev,
 
 	/* HACK: Remove once user-space takes on the reset responsibility. */
 	slave_present = false;
-	mutex_lock(&svc_list_lock);
-	list_for_each_entry(mods_dev, &svc_dd->ext_intf, list)
+	mutex_lock(&dd->list_lock);
+	list_for_each_entry(mods_dev, &dd->ext_intf, list)
 		if (mods_dev->slave_mask) {
 			slave_present = true;
 			break;
 	}
-	mutex_unlock(&svc_list_lock);
+	mutex_unlock(&dd->list_lock);
 
 	if (!slave_present) {
 		dev_info(dev, "[%d] Force a reboot\n", orig_dev->intf_id);
-		muc_reset(svc_dd->mod_root_ver, svc_dd->def_root_ver, false);
+		muc_reset(dd->mod_root_ver, dd->def_root_ver, false);
 		return 0;
 	}
 
@@ -2482,6 +2762,7 @@ static int
 svc_filter_ap_connected(struct mods_dl_device *orig_dev,
 			uint8_t *payload, size_t size)
 {
+	struct muc_svc_data *dd = orig_dev->svc;
 	struct mb_control_connected_request conn;
 	struct gb_control_connected_request *req;
 	struct gb_message *msg;
@@ -2493,13 +2774,13 @@ svc_filter_ap_connected(struct mods_dl_device *orig_dev,
 	req = (struct gb_control_connected_request *)(hdr + 1);
 	conn.cport_id = req->cport_id;
 
-	msg = svc_gb_msg_send_sync(svc_dd->dld, (uint8_t *)&conn,
+	msg = svc_gb_msg_send_sync(dd->dld, (uint8_t *)&conn,
 				MB_CONTROL_TYPE_PORT_CONNECTED,
 				sizeof(conn),
 				SVC_VENDOR_CTRL_CPORT(orig_dev->intf_id));
 
 	if (IS_ERR(msg)) {
-		dev_err(&svc_dd->pdev->dev, "[%d] Failed send CONNECTED\n",
+		dev_err(&dd->pdev->dev, "[%d] Failed send CONNECTED\n",
 			orig_dev->intf_id);
 		return -ENOENT;
 	}
@@ -2514,6 +2795,7 @@ static int
 svc_filter_ap_disconnected(struct mods_dl_device *orig_dev,
 			uint8_t *payload, size_t size)
 {
+	struct muc_svc_data *dd = orig_dev->svc;
 	struct mb_control_disconnected_request conn;
 	struct gb_control_disconnected_request *req;
 	struct gb_message *msg;
@@ -2525,13 +2807,13 @@ svc_filter_ap_disconnected(struct mods_dl_device *orig_dev,
 	req = (struct gb_control_disconnected_request *)(hdr + 1);
 	conn.cport_id = req->cport_id;
 
-	msg = svc_gb_msg_send_sync(svc_dd->dld, (uint8_t *)&conn,
+	msg = svc_gb_msg_send_sync(dd->dld, (uint8_t *)&conn,
 				MB_CONTROL_TYPE_PORT_DISCONNECTED,
 				sizeof(conn),
 				SVC_VENDOR_CTRL_CPORT(orig_dev->intf_id));
 
 	if (IS_ERR(msg)) {
-		dev_err(&svc_dd->pdev->dev, "[%d] Failed send DISCONNECTED\n",
+		dev_err(&dd->pdev->dev, "[%d] Failed send DISCONNECTED\n",
 			orig_dev->intf_id);
 		return -ENOENT;
 	}
@@ -2648,12 +2930,13 @@ static int muc_svc_of_parse(struct muc_svc_data *dd, struct device *dev)
 
 static int muc_svc_send_reboot(struct mods_dl_device *mods_dev, uint8_t mode)
 {
+	struct muc_svc_data *dd = mods_dev->svc;
 	int ret;
 	struct mb_control_reboot_request req;
 
 	req.mode = mode;
 
-	ret = svc_gb_msg_send_no_resp(svc_dd->dld, (uint8_t *)&req,
+	ret = svc_gb_msg_send_no_resp(dd->dld, (uint8_t *)&req,
 				MB_CONTROL_TYPE_REBOOT, sizeof(req),
 				SVC_VENDOR_CTRL_CPORT(mods_dev->intf_id));
 
@@ -2662,6 +2945,7 @@ static int muc_svc_send_reboot(struct mods_dl_device *mods_dev, uint8_t mode)
 
 static int muc_svc_send_current_limit(struct mods_dl_device *dev, uint8_t limit)
 {
+	struct muc_svc_data *dd = dev->svc;
 	struct gb_message *msg;
 	struct mb_control_current_limit_request request;
 
@@ -2674,7 +2958,7 @@ static int muc_svc_send_current_limit(struct mods_dl_device *dev, uint8_t limit)
 		/* Set Limit on Device side */
 		muc_current_limit_ctrl(limit);
 
-	msg = svc_gb_msg_send_sync_timeout(svc_dd->dld, (uint8_t *)&request,
+	msg = svc_gb_msg_send_sync_timeout(dd->dld, (uint8_t *)&request,
 			MB_CONTROL_TYPE_SET_CURRENT_LIMIT, sizeof(request),
 			SVC_VENDOR_CTRL_CPORT(dev->intf_id),
 			SVC_CURRENT_LIMIT_TIMEOUT_MS);
@@ -2684,7 +2968,7 @@ static int muc_svc_send_current_limit(struct mods_dl_device *dev, uint8_t limit)
 		muc_current_limit_ctrl(limit);
 
 	if (IS_ERR(msg)) {
-		dev_err(&svc_dd->pdev->dev,
+		dev_err(&dd->pdev->dev,
 			"[%d] Failed to set current limit\n", dev->intf_id);
 		return PTR_ERR(msg);
 	}
@@ -2696,6 +2980,7 @@ static int muc_svc_send_current_limit(struct mods_dl_device *dev, uint8_t limit)
 /* Sent to the mod to acknowledge receipt of high current reservation request */
 static int muc_svc_send_current_rsv_ack(struct mods_dl_device *dld)
 {
+	struct muc_svc_data *dd = dld->svc;
 	struct gb_message *msg;
 	struct mb_control_current_rsv_ack_request req;
 
@@ -2705,13 +2990,13 @@ static int muc_svc_send_current_rsv_ack(struct mods_dl_device *dld)
 	/* Acknowledge the message back to the mod */
 	req.rsv = dld->high_current_reserved ? 1 : 0;
 
-	msg = svc_gb_msg_send_sync_timeout(svc_dd->dld, (uint8_t *)&req,
+	msg = svc_gb_msg_send_sync_timeout(dd->dld, (uint8_t *)&req,
 			MB_CONTROL_TYPE_CURRENT_RSV_ACK, sizeof(req),
 			SVC_VENDOR_CTRL_CPORT(dld->intf_id),
 			SVC_CURRENT_LIMIT_TIMEOUT_MS);
 
 	if (IS_ERR(msg)) {
-		dev_err(&svc_dd->pdev->dev,
+		dev_err(&dd->pdev->dev,
 			"[%d] Failed to set current limit\n", dld->intf_id);
 		return PTR_ERR(msg);
 	}
@@ -2736,24 +3021,24 @@ static int muc_svc_enter_fw_flash(struct device *dev)
 
 	/* Need to generate a hot unplug for each interface and then
 	 * issue the reboot command */
-	mutex_lock(&svc_list_lock);
+	mutex_lock(&dd->list_lock);
 	list_for_each_entry(mods_dev, &dd->ext_intf, list) {
 		muc_svc_generate_unplug(mods_dev, true);
 
 		/* Only do software reboot for hardware that can't
 		 * support force flash via hardware.
 		 */
-		if (muc_can_force_flash(svc_dd->mod_root_ver))
+		if (muc_can_force_flash(dd->mod_root_ver))
 			continue;
 
 		if (muc_svc_send_reboot(mods_dev, mode))
 			dev_warn(dev, "INTF: %d, failed to enter flashmode\n",
 				mods_dev->intf_id);
 	}
-	mutex_unlock(&svc_list_lock);
+	mutex_unlock(&dd->list_lock);
 
 	/* Reset the muc, to trigger the tear-down and re-init */
-	muc_reset(svc_dd->mod_root_ver, svc_dd->def_root_ver, true);
+	muc_reset(dd->mod_root_ver, dd->def_root_ver, true);
 
 	return 0;
 }
@@ -2810,6 +3095,7 @@ static DEVICE_ATTR_WO(forcedetect);
 static ssize_t reset_store(struct device *dev, struct device_attribute *attr,
 			   const char *buf, size_t count)
 {
+	struct muc_svc_data *dd = dev_get_drvdata(dev);
 	unsigned long val;
 
 	if (unlikely(!muc_core_probed()))
@@ -2824,7 +3110,7 @@ static ssize_t reset_store(struct device *dev, struct device_attribute *attr,
 	}
 
 	dev_info(dev, "Reset via userspace\n");
-	muc_reset(svc_dd->mod_root_ver, svc_dd->def_root_ver, false);
+	muc_reset(dd->mod_root_ver, dd->def_root_ver, false);
 
 	return count;
 }
@@ -2834,24 +3120,25 @@ static ssize_t
 recovery_mode_store(struct device *dev, struct device_attribute *attr,
 			   const char *buf, size_t count)
 {
+	struct muc_svc_data *dd = dev_get_drvdata(dev);
 
-	if (!svc_dd)
+	if (!dd)
 		return -ENODEV;
 
 	if (strncmp(buf, "enable", 6) == 0) {
-		svc_dd->recovery_level = MUC_SVC_RECOVERY_FULL;
+		dd->recovery_level = MUC_SVC_RECOVERY_FULL;
 		dev_info(dev, "recovery: fully enabled\n");
 		return count;
 	}
 
 	if (strncmp(buf, "disable", 7) == 0) {
-		svc_dd->recovery_level = MUC_SVC_RECOVERY_OFF;
+		dd->recovery_level = MUC_SVC_RECOVERY_OFF;
 		dev_info(dev, "recovery: fully disabled\n");
 		return count;
 	}
 
 	if (strncmp(buf, "soft", 4) == 0) {
-		svc_dd->recovery_level = MUC_SVC_RECOVERY_SOFT;
+		dd->recovery_level = MUC_SVC_RECOVERY_SOFT;
 		dev_info(dev, "recovery: soft reset\n");
 		return count;
 	}
@@ -2908,8 +3195,14 @@ static void muc_svc_base_sysfs_exit(struct muc_svc_data *dd)
 static int muc_svc_probe(struct platform_device *pdev)
 {
 	struct muc_svc_data *dd;
+	unsigned int wq_flags;
 	int ret;
 
+	if (svc_dd) {
+		dev_err(&pdev->dev, "Only one SVC instance is supported\n");
+		return -EBUSY;
+	}
+
 	dd = devm_kzalloc(&pdev->dev, sizeof(*dd), GFP_KERNEL);
 	if (!dd)
 		return -ENOMEM;
@@ -2921,14 +3214,25 @@ static int muc_svc_probe(struct platform_device *pdev)
 	/* initialize recovery to enabled */
 	dd->recovery_level = MUC_SVC_RECOVERY_FULL;
 
-	dd->dld = _mods_create_dl_device(&muc_svc_dl_driver, &pdev->dev,
+	mutex_init(&dd->list_lock);
+	mutex_init(&dd->slave_lock);
+	spin_lock_init(&dd->ops_lock);
+
+	dd->dld = _mods_create_dl_device(dd, &muc_svc_dl_driver, &pdev->dev,
 			MODS_INTF_SVC);
 	if (IS_ERR(dd->dld)) {
 		dev_err(&pdev->dev, "Failed to create mods DL device.\n");
 		return PTR_ERR(dd->dld);
 	}
 
-	dd->wq = alloc_workqueue("muc_svc_attach", WQ_UNBOUND, 1);
+	/*
+	 * Expose the CPU mask of every instance's workqueues under
+	 * /sys/devices/virtual/workqueue, named after the device.
+	 */
+	wq_flags = WQ_UNBOUND | WQ_SYSFS;
+
+	dd->wq = alloc_workqueue("muc_svc_attach-%s", wq_flags, 1,
+				 dev_name(&pdev->dev));
 	if (!dd->wq) {
 		dev_err(&pdev->dev, "Failed to create attach workqueue.\n");
 		ret = -ENOMEM;
@@ -2936,8 +3240,9 @@ static int muc_svc_probe(struct platform_device *pdev)
 	}
 
 	INIT_DELAYED_WORK(&dd->wdog_work, muc_svc_wdog);
-	dd->wdog_wq = alloc_workqueue("muc_svc_wdog", WQ_UNBOUND, 1);
-	if (!dd->wq) {
+	dd->wdog_wq = alloc_workqueue("muc_svc_wdog-%s", wq_flags, 1,
+				      dev_name(&pdev->dev));
+	if (!dd->wdog_wq) {
 		dev_err(&pdev->dev, "Failed to create WDOG workqueue.\n");
 		ret = -ENOMEM;
 		goto free_wq;
@@ -2959,7 +3264,7 @@ static int muc_svc_probe(struct platform_device *pdev)
 		goto free_wdog_wq;
 	}
 
-	ret = muc_svc_install_ap_filters(svc_dd);
+	ret = muc_svc_install_ap_filters(dd);
 	if (ret) {
 		dev_err(&pdev->dev, "Failed to install nw filters\n");
 		goto free_kset;
@@ -3006,6 +3311,9 @@ static int muc_svc_remove(struct platform_device *pdev)
 	destroy_workqueue(dd->wq);
 	wake_lock_destroy(&dd->wlock);
 	mods_remove_dl_device(dd->dld);
+	muc_svc_manifest_cache_clear();
+
+	svc_dd = NULL;
 
 	return 0;
 }
@@ -40,6 +40,9 @@ static int gb_operation_response_send(struct gb_operation *operation,
  */
 static DEFINE_SPINLOCK(gb_operations_outbound);
 
+/* Idle asynchronous unidirectional operations kept per connection */
+#define GB_OPERATION_ASYNC_CACHE_MAX	8
+
 /*
  * Increment operation active count and add to connection list unless the
  * connection is going away.
@@ -352,6 +355,13 @@ gb_operation_message_alloc(struct gb_host_device *hd, u8 type,
 	if (!message)
 		return NULL;
 
+	/*
+	 * Buffers for incoming requests are overwritten by arriving data,
+	 * everything else must not leak stale bytes in unset fields.
+	 */
+	if (type != GB_OPERATION_TYPE_INVALID)
+		gfp_flags |= __GFP_ZERO;
+
 	message->buffer = gballoc(message_size, gfp_flags);
 	if (!message->buffer)
 		goto err_free_message;
@@ -593,6 +603,7 @@ gb_operation_create_incoming(struct gb_connection *connection, u16 id,
 		return NULL;
 
 	operation->id = id;
+	operation->recv_time = ktime_get();
 	memcpy(operation->request->header, data, size);
 
 	return operation;
@@ -642,6 +653,34 @@ static void gb_operation_sync_callback(struct gb_operation *operation)
 	complete(&operation->completion);
 }
 
+/*
+ * Asynchronous unidirectional operations complete in batches on their
+ * connection's work, everything else completes on its own.
+ */
+static void gb_operation_queue_completion(struct gb_operation *operation)
+{
+	struct gb_connection *connection = operation->connection;
+	unsigned long flags;
+	bool idle;
+
+	if (!(operation->flags & GB_OPERATION_FLAG_ASYNC)) {
+		queue_work(gb_operation_completion_wq, &operation->work);
+		return;
+	}
+
+	spin_lock_irqsave(&connection->lock, flags);
+	idle = list_empty(&connection->async_done);
+	list_add_tail(&operation->async_links, &connection->async_done);
+	spin_unlock_irqrestore(&connection->lock, flags);
+
+	if (idle)
+		queue_work(gb_operation_completion_wq, &connection->async_work);
+}
+
+static int __gb_operation_request_send(struct gb_operation *operation,
+				       gb_operation_callback callback,
+				       gfp_t gfp);
+
 /**
  * gb_operation_request_send() - send an operation request message
  * @operation:	the operation to initiate
@@ -661,15 +700,23 @@ static void gb_operation_sync_callback(struct gb_operation *operation)
 int gb_operation_request_send(struct gb_operation *operation,
 				gb_operation_callback callback,
 				gfp_t gfp)
+{
+	if (!callback)
+		return -EINVAL;
+
+	return __gb_operation_request_send(operation, callback, gfp);
+}
+EXPORT_SYMBOL_GPL(gb_operation_request_send);
+
+static int __gb_operation_request_send(struct gb_operation *operation,
+				       gb_operation_callback callback,
+				       gfp_t gfp)
 {
 	struct gb_connection *connection = operation->connection;
 	struct gb_operation_msg_hdr *header;
 	unsigned int cycle;
 	int ret;
 
-	if (!callback)
-		return -EINVAL;
-
 	/*
 	 * Record the callback function, which is executed in
 	 * non-atomic (workqueue) context when the final result
@@ -715,7 +762,6 @@ err_put:
 
 	return ret;
 }
-EXPORT_SYMBOL_GPL(gb_operation_request_send);
 
 /*
  * Send a synchronous operation.  This function is expected to
@@ -834,20 +880,48 @@ void greybus_message_sent(struct gb_host_device *hd,
 		gb_operation_put_active(operation);
 		gb_operation_put(operation);
 	} else if (status || gb_operation_is_unidirectional(operation)) {
-		if (gb_operation_result_set(operation, status)) {
-			queue_work(gb_operation_completion_wq,
-					&operation->work);
-		}
+		if (gb_operation_result_set(operation, status))
+			gb_operation_queue_completion(operation);
 	}
 }
 EXPORT_SYMBOL_GPL(greybus_message_sent);
 
+/*
+ * Handle an incoming request in the receive context for protocols that
+ * declared GB_PROTOCOL_ATOMIC_REQUEST_RECV. Only unidirectional requests
+ * qualify since sending a response may sleep in the host driver.
+ *
+ * Preemption is disabled around the handler so that a handler which does
+ * sleep is caught by the might_sleep() and lockdep checks rather than
+ * silently blocking the receive path.
+ */
+static bool gb_operation_request_handle_direct(struct gb_operation *operation)
+{
+	struct gb_protocol *protocol = operation->connection->protocol;
+
+	if (!protocol || !(protocol->flags & GB_PROTOCOL_ATOMIC_REQUEST_RECV))
+		return false;
+
+	if (!gb_operation_is_unidirectional(operation))
+		return false;
+
+	preempt_disable();
+	gb_operation_request_handle(operation);
+	preempt_enable();
+
+	gb_operation_put_active(operation);
+	gb_operation_put(operation);
+
+	return true;
+}
+
 /*
  * We've received data on a connection, and it doesn't look like a
  * response, so we assume it's a request.
  *
  * This is called in interrupt context, so just copy the incoming
- * data into the request buffer and handle the rest via workqueue.
+ * data into the request buffer and handle the rest via workqueue,
+ * unless the protocol allows handling it right here.
  */
 static void gb_connection_recv_request(struct gb_connection *connection,
 				       u16 operation_id, u8 type,
@@ -876,8 +950,10 @@ static void gb_connection_recv_request(struct gb_connection *connection,
 	 * The initial reference to the operation will be dropped when the
 	 * request handler returns.
 	 */
-	if (gb_operation_result_set(operation, -EINPROGRESS))
-		queue_work(connection->wq, &operation->work);
+	if (gb_operation_result_set(operation, -EINPROGRESS)) {
+		if (!gb_operation_request_handle_direct(operation))
+			queue_work(connection->wq, &operation->work);
+	}
 }
 
 /*
@@ -1003,7 +1079,7 @@ void gb_operation_cancel(struct gb_operation *operation, int errno)
 
 	if (gb_operation_result_set(operation, errno)) {
 		gb_message_cancel(operation->request);
-		queue_work(gb_operation_completion_wq, &operation->work);
+		gb_operation_queue_completion(operation);
 	}
 	trace_gb_message_cancel_outgoing(operation->request);
 
@@ -1165,6 +1241,213 @@ int gb_operation_unidirectional_timeout(struct gb_connection *connection,
 }
 EXPORT_SYMBOL_GPL(gb_operation_unidirectional_timeout);
 
+/* Keep a sent asynchronous operation for reuse, or drop it */
+static void gb_operation_async_recycle(struct gb_operation *operation)
+{
+	struct gb_connection *connection = operation->connection;
+	unsigned long flags;
+
+	spin_lock_irqsave(&connection->lock, flags);
+	if (connection->state == GB_CONNECTION_STATE_ENABLED &&
+	    connection->async_cached < GB_OPERATION_ASYNC_CACHE_MAX) {
+		list_add(&operation->async_links, &connection->async_cache);
+		connection->async_cached++;
+		operation = NULL;
+	}
+	spin_unlock_irqrestore(&connection->lock, flags);
+
+	if (operation)
+		gb_operation_put(operation);
+}
+
+/* Reuse a cached operation with the same request size, if there is one */
+static struct gb_operation *
+gb_operation_async_get(struct gb_connection *connection, u8 type,
+		       size_t request_size, gfp_t gfp)
+{
+	struct gb_operation *operation;
+	unsigned long flags;
+	bool found = false;
+
+	spin_lock_irqsave(&connection->lock, flags);
+	list_for_each_entry(operation, &connection->async_cache, async_links) {
+		if (operation->request->payload_size == request_size) {
+			list_del(&operation->async_links);
+			connection->async_cached--;
+			found = true;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&connection->lock, flags);
+
+	if (!found)
+		return gb_operation_create_common(connection, type,
+				request_size, 0,
+				GB_OPERATION_FLAG_UNIDIRECTIONAL |
+				GB_OPERATION_FLAG_ASYNC, gfp);
+
+	operation->type = type;
+	operation->request->header->type = type;
+	operation->errno = -EBADR;
+
+	return operation;
+}
+
+/*
+ * Report the operations sent since the last run, one callback for each
+ * run of operations sharing a callback, and recycle them.
+ */
+static void gb_operation_async_work(struct work_struct *work)
+{
+	struct gb_connection *connection;
+	struct gb_operation *operation, *next;
+	gb_operation_async_callback callback;
+	unsigned int count;
+	LIST_HEAD(done);
+	bool enabled;
+	int errno;
+	int ret;
+
+	connection = container_of(work, struct gb_connection, async_work);
+
+	/* Stragglers completing after tear down began are not reported */
+	spin_lock_irq(&connection->lock);
+	list_splice_init(&connection->async_done, &done);
+	enabled = connection->state == GB_CONNECTION_STATE_ENABLED;
+	spin_unlock_irq(&connection->lock);
+
+	while (!list_empty(&done)) {
+		operation = list_first_entry(&done, struct gb_operation,
+					     async_links);
+		callback = operation->async_callback;
+		count = 0;
+		errno = 0;
+
+		list_for_each_entry_safe(operation, next, &done, async_links) {
+			if (operation->async_callback != callback)
+				break;
+
+			list_del(&operation->async_links);
+			ret = gb_operation_result(operation);
+			if (ret && !errno)
+				errno = ret;
+			count++;
+
+			gb_operation_put_active(operation);
+			gb_operation_put(operation);
+			gb_operation_async_recycle(operation);
+		}
+
+		if (callback && enabled)
+			callback(connection, count, errno);
+	}
+}
+
+/**
+ * gb_operation_unidirectional_async() - queue a unidirectional operation
+ * @connection:		connection to use
+ * @type:		type of operation to send
+ * @request:		memory buffer to copy the request from
+ * @request_size:	size of @request
+ * @callback:		batch completion callback, may be NULL
+ *
+ * Send a unidirectional request without waiting for it to complete.
+ * Requests complete in batches: @callback is called from the completion
+ * workqueue once for all consecutive requests of the connection sent with
+ * it. Operations are cached on the connection and reused for requests of
+ * the same size.
+ *
+ * Only the completion is asynchronous. Host drivers may sleep in
+ * message_send (the mods host does), so this must be called from process
+ * context.
+ *
+ * Once the connection is being torn down no more requests are accepted,
+ * and @callback is not called for requests that complete after that.
+ *
+ * Return: 0 if the request was queued in the host-driver queues, or a
+ * negative errno, in which case @callback will not be called for it.
+ */
+int gb_operation_unidirectional_async(struct gb_connection *connection,
+				int type, void *request, int request_size,
+				gb_operation_async_callback callback)
+{
+	struct gb_operation *operation;
+	int ret;
+
+	might_sleep();
+
+	if (request_size && !request)
+		return -EINVAL;
+
+	if (WARN_ON_ONCE(type == GB_OPERATION_TYPE_INVALID ||
+			 type & GB_MESSAGE_TYPE_RESPONSE))
+		return -EINVAL;
+
+	spin_lock_irq(&connection->lock);
+	if (connection->state != GB_CONNECTION_STATE_ENABLED) {
+		spin_unlock_irq(&connection->lock);
+		return -ESHUTDOWN;
+	}
+	spin_unlock_irq(&connection->lock);
+
+	operation = gb_operation_async_get(connection, type, request_size,
+					   GFP_KERNEL);
+	if (!operation)
+		return -ENOMEM;
+
+	if (request_size)
+		memcpy(operation->request->payload, request, request_size);
+
+	operation->async_callback = callback;
+
+	/* Completion goes through gb_operation_async_work, not a callback */
+	ret = __gb_operation_request_send(operation, NULL, GFP_KERNEL);
+	if (ret) {
+		dev_err(&connection->hd->dev,
+			"%s: async unidirectional operation of type 0x%02x failed: %d\n",
+			connection->name, type, ret);
+		gb_operation_async_recycle(operation);
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(gb_operation_unidirectional_async);
+
+void gb_operation_async_init(struct gb_connection *connection)
+{
+	INIT_LIST_HEAD(&connection->async_done);
+	INIT_LIST_HEAD(&connection->async_cache);
+	connection->async_cached = 0;
+	INIT_WORK(&connection->async_work, gb_operation_async_work);
+}
+
+/*
+ * Wait for the pending batch completions and release the cached operations.
+ * Called during connection tear down, after the connection has left the
+ * enabled state and before the protocol's connection_exit, so no callback
+ * runs into a protocol that is going away.
+ */
+void gb_operation_async_flush(struct gb_connection *connection)
+{
+	struct gb_operation *operation;
+
+	flush_work(&connection->async_work);
+
+	spin_lock_irq(&connection->lock);
+	while (!list_empty(&connection->async_cache)) {
+		operation = list_first_entry(&connection->async_cache,
+					     struct gb_operation, async_links);
+		list_del(&operation->async_links);
+		connection->async_cached--;
+		spin_unlock_irq(&connection->lock);
+
+		gb_operation_put(operation);
+
+		spin_lock_irq(&connection->lock);
+	}
+	spin_unlock_irq(&connection->lock);
+}
+
 int __init gb_operation_init(void)
 {
 	gb_message_cache = kmem_cache_create("gb_message_cache",
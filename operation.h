@@ -11,9 +11,11 @@
 #define __OPERATION_H
 
 #include <linux/completion.h>
+#include <linux/ktime.h>
 
 #include "hd.h"
 
+struct gb_connection;
 struct gb_operation;
 
 /* The default amount of time a request is given to complete */
@@ -68,6 +70,7 @@ struct gb_message {
 #define GB_OPERATION_FLAG_INCOMING		BIT(0)
 #define GB_OPERATION_FLAG_UNIDIRECTIONAL	BIT(1)
 #define GB_OPERATION_FLAG_SHORT_RESPONSE	BIT(2)
+#define GB_OPERATION_FLAG_ASYNC			BIT(3)
 
 #define GB_OPERATION_FLAG_USER_MASK	(GB_OPERATION_FLAG_SHORT_RESPONSE | \
 					 GB_OPERATION_FLAG_UNIDIRECTIONAL)
@@ -92,6 +95,14 @@ struct gb_message {
  * gb_operation_result().
  */
 typedef void (*gb_operation_callback)(struct gb_operation *);
+
+/*
+ * Completion of asynchronous unidirectional sends, called once for a
+ * batch of count requests. errno is the first error among them, or 0.
+ */
+typedef void (*gb_operation_async_callback)(struct gb_connection *connection,
+					    unsigned int count, int errno);
+
 struct gb_operation {
 	struct gb_connection	*connection;
 	struct gb_message	*request;
@@ -111,6 +122,11 @@ struct gb_operation {
 
 	int			active;
 	struct list_head	links;		/* connection->operations */
+
+	ktime_t			recv_time;	/* incoming requests only */
+
+	gb_operation_async_callback	async_callback;
+	struct list_head	async_links;	/* connection->async_* */
 };
 
 static inline bool
@@ -183,6 +199,12 @@ int gb_operation_sync_timeout(struct gb_connection *connection, int type,
 int gb_operation_unidirectional_timeout(struct gb_connection *connection,
 				int type, void *request, int request_size,
 				unsigned int timeout);
+int gb_operation_unidirectional_async(struct gb_connection *connection,
+				int type, void *request, int request_size,
+				gb_operation_async_callback callback);
+
+void gb_operation_async_init(struct gb_connection *connection);
+void gb_operation_async_flush(struct gb_connection *connection);
 
 static inline int gb_operation_sync(struct gb_connection *connection, int type,
 		      void *request, int request_size,
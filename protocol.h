@@ -17,6 +17,11 @@ struct gb_operation;
 #define GB_PROTOCOL_SKIP_CONTROL_CONNECTED	BIT(0)	/* Don't sent connected requests */
 #define GB_PROTOCOL_SKIP_CONTROL_DISCONNECTED	BIT(1)	/* Don't sent disconnected requests */
 #define GB_PROTOCOL_SKIP_VERSION		BIT(3)	/* Don't send get_version() requests */
+/*
+ * request_recv never sleeps: unidirectional requests are handled directly in
+ * the receive path instead of being deferred to the connection workqueue.
+ */
+#define GB_PROTOCOL_ATOMIC_REQUEST_RECV		BIT(4)
 
 typedef int (*gb_connection_init_t)(struct gb_connection *);
 typedef void (*gb_connection_exit_t)(struct gb_connection *);
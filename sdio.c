@@ -28,6 +28,10 @@ struct gb_sdio_host {
 	struct workqueue_struct	*mrq_workqueue;
 	struct work_struct	mrqwork;
 	u8			queued_events;
+	struct gb_sdio_set_ios_request	ios;	/* Last applied on the module */
+	bool			ios_valid;
+	unsigned int		ios_sent;
+	unsigned int		ios_elided;
 	bool			removed;
 	bool			card_present;
 	bool			read_only;
@@ -163,33 +167,39 @@ static void _gb_queue_event(struct gb_sdio_host *host, u8 event)
 	host->queued_events |= event;
 }
 
-static int _gb_sdio_process_events(struct gb_sdio_host *host, u8 event)
+/* Update the card state from event, returns true if presence changed */
+static bool _gb_sdio_apply_events(struct gb_sdio_host *host, u8 event)
 {
-	u8 state_changed = 0;
+	bool state_changed = false;
 
 	if (event & GB_SDIO_CARD_INSERTED) {
 		if (host->mmc->caps & MMC_CAP_NONREMOVABLE)
-			return 0;
+			return false;
 		if (host->card_present)
-			return 0;
+			return false;
 		host->card_present = true;
-		state_changed = 1;
+		state_changed = true;
 	}
 
 	if (event & GB_SDIO_CARD_REMOVED) {
 		if (host->mmc->caps & MMC_CAP_NONREMOVABLE)
-			return 0;
+			return false;
 		if (!(host->card_present))
-			return 0;
+			return false;
 		host->card_present = false;
-		state_changed = 1;
+		state_changed = true;
 	}
 
 	if (event & GB_SDIO_WP) {
 		host->read_only = true;
 	}
 
-	if (state_changed) {
+	return state_changed;
+}
+
+static int _gb_sdio_process_events(struct gb_sdio_host *host, u8 event)
+{
+	if (_gb_sdio_apply_events(host, event)) {
 		dev_info(mmc_dev(host->mmc), "card %s now event\n",
 			 (host->card_present ?  "inserted" : "removed"));
 		mmc_detect_change(host->mmc, 0);
@@ -232,11 +242,47 @@ static int gb_sdio_event_recv(u8 type, struct gb_operation *op)
 	return ret;
 }
 
+/*
+ * The core calls set_ios a lot with nothing changed, only send what the
+ * module does not have yet. While the card stays powered off nothing else
+ * matters, the request powering it up carries all the other fields anyway.
+ */
+static bool gb_sdio_set_ios_needed(struct gb_sdio_host *host,
+				   struct gb_sdio_set_ios_request *request)
+{
+	if (!host->ios_valid)
+		return true;
+
+	if (request->power_mode == GB_SDIO_POWER_OFF &&
+	    host->ios.power_mode == GB_SDIO_POWER_OFF)
+		return false;
+
+	return memcmp(&host->ios, request, sizeof(*request));
+}
+
 static int gb_sdio_set_ios(struct gb_sdio_host *host,
 			   struct gb_sdio_set_ios_request *request)
 {
-	return gb_operation_sync(host->connection, GB_SDIO_TYPE_SET_IOS,
-				 request, sizeof(*request), NULL, 0);
+	int ret;
+
+	if (!gb_sdio_set_ios_needed(host, request)) {
+		host->ios_elided++;
+		return 0;
+	}
+
+	ret = gb_operation_sync(host->connection, GB_SDIO_TYPE_SET_IOS,
+				request, sizeof(*request), NULL, 0);
+	if (ret < 0) {
+		/* No telling what the module applied */
+		host->ios_valid = false;
+		return ret;
+	}
+
+	host->ios = *request;
+	host->ios_valid = true;
+	host->ios_sent++;
+
+	return 0;
 }
 
 static int _gb_sdio_send(struct gb_sdio_host *host, struct mmc_data *data,
@@ -680,23 +726,25 @@ out:
 static int gb_mmc_get_ro(struct mmc_host *mmc)
 {
 	struct gb_sdio_host *host = mmc_priv(mmc);
+	int ret;
 
 	mutex_lock(&host->lock);
-	if (host->removed)
-		return -ESHUTDOWN;
+	ret = host->removed ? -ESHUTDOWN : host->read_only;
 	mutex_unlock(&host->lock);
-	return host->read_only;
+
+	return ret;
 }
 
 static int gb_mmc_get_cd(struct mmc_host *mmc)
 {
 	struct gb_sdio_host *host = mmc_priv(mmc);
+	int ret;
 
 	mutex_lock(&host->lock);
-	if (host->removed)
-		return -ESHUTDOWN;
+	ret = host->removed ? -ESHUTDOWN : host->card_present;
 	mutex_unlock(&host->lock);
-	return host->card_present;
+
+	return ret;
 }
 
 static const struct mmc_host_ops gb_sdio_ops = {
@@ -752,6 +800,13 @@ static int gb_sdio_connection_init(struct gb_connection *connection)
 	}
 	INIT_WORK(&host->mrqwork, gb_sdio_mrq_work);
 
+	/*
+	 * Card events that came in so far only need to be in the state, the
+	 * detect mmc_add_host() starts with picks them up.
+	 */
+	_gb_sdio_apply_events(host, host->queued_events);
+	host->queued_events = 0;
+
 	ret = mmc_add_host(mmc);
 	if (ret < 0)
 		goto free_work;
@@ -789,6 +844,8 @@ static void gb_sdio_connection_exit(struct gb_connection *connection)
 	flush_workqueue(host->mrq_workqueue);
 	destroy_workqueue(host->mrq_workqueue);
 	mmc_remove_host(mmc);
+	dev_dbg(&connection->bundle->dev, "set_ios: %u sent, %u elided\n",
+		host->ios_sent, host->ios_elided);
 	kfree(host->xfer_buffer);
 	mmc_free_host(mmc);
 }
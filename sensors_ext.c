@@ -12,6 +12,7 @@
 #include <linux/idr.h>
 #include <linux/kdev_t.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/module.h>
 #include <linux/slab.h>
@@ -184,9 +185,85 @@ int gb_sensors_ext_flush(uint8_t sensor_id)
 	return ret;
 }
 
-static int gb_sensors_ext_config(struct gb_sensors_ext *sensors_ext, u8 id)
+static void gb_sensors_ext_parse_config(struct gb_sensor *sensor,
+					const struct gb_sensor *conf)
+{
+	sensor->version = le32_to_cpu(conf->version);
+	sensor->type = le32_to_cpu(conf->type);
+	sensor->max_range = le32_to_cpu(conf->max_range);
+	sensor->resolution = le32_to_cpu(conf->resolution);
+	sensor->power = le32_to_cpu(conf->power);
+	sensor->min_delay = le32_to_cpu(conf->min_delay);
+	sensor->max_delay = le32_to_cpu(conf->max_delay);
+	sensor->fifo_rec = le32_to_cpu(conf->fifo_rec);
+	sensor->fifo_mec = le32_to_cpu(conf->fifo_mec);
+	sensor->flags = le32_to_cpu(conf->flags);
+	sensor->scale_int = le32_to_cpu(conf->scale_int);
+	sensor->scale_nano = le32_to_cpu(conf->scale_nano);
+	sensor->offset_int = le32_to_cpu(conf->offset_int);
+	sensor->offset_nano = le32_to_cpu(conf->offset_nano);
+	sensor->channels = conf->channels;
+
+	sensor->name_len = le16_to_cpu(conf->name_len);
+	if (sensor->name_len) {
+		if (sensor->name_len > sizeof(sensor->name))
+			sensor->name_len = sizeof(sensor->name);
+		memcpy(&sensor->name[0], &conf->name[0], sensor->name_len);
+	}
+
+	sensor->vendor_len = le16_to_cpu(conf->vendor_len);
+	if (sensor->vendor_len) {
+		if (sensor->vendor_len > sizeof(sensor->vendor))
+			sensor->vendor_len = sizeof(sensor->vendor);
+		memcpy(&sensor->vendor[0], &conf->vendor[0], sensor->vendor_len);
+	}
+
+	sensor->string_type_len = le16_to_cpu(conf->string_type_len);
+	if (sensor->string_type_len) {
+		if (sensor->string_type_len > sizeof(sensor->string_type))
+			sensor->string_type_len = sizeof(sensor->string_type);
+		memcpy(&sensor->string_type[0], &conf->string_type[0],
+			sensor->string_type_len);
+	}
+}
+
+/*
+ * Allocate a sensor for the given id, fill it from the module's descriptor
+ * and register its IIO device right away so userspace does not have to
+ * wait for the rest of the enumeration.
+ */
+static int gb_sensors_ext_add(struct gb_sensors_ext *sensors_ext, u8 id,
+				const struct gb_sensor *conf)
 {
 	struct gb_sensor *sensor;
+	int ret;
+
+	sensor = kzalloc(sizeof(*sensor), GFP_KERNEL);
+	if (!sensor)
+		return -ENOMEM;
+
+	sensor->sensor_id = id;
+	gb_sensors_ext_parse_config(sensor, conf);
+
+	mutex_lock(&sensors_ext->mlock);
+	list_add_tail(&sensor->node, &sensors_ext->sensors_list);
+	mutex_unlock(&sensors_ext->mlock);
+
+	ret = gb_sensors_mod_add_sensor(sensor);
+	if (ret) {
+		dev_err(&sensors_ext->connection->bundle->dev,
+			"Failed to add sensor device %d (err=%d)\n", id, ret);
+		mutex_lock(&sensors_ext->mlock);
+		list_del(&sensor->node);
+		mutex_unlock(&sensors_ext->mlock);
+		kfree(sensor);
+	}
+
+	return ret;
+}
+
+static int gb_sensors_ext_config(struct gb_sensors_ext *sensors_ext, u8 id)
+{
 	struct gb_sensors_ext_sensor_info_request req;
 	struct gb_sensor conf;
 	int ret;
@@ -200,93 +277,158 @@ static int gb_sensors_ext_config(struct gb_sensors_ext *sensors_ext, u8 id)
 	if (ret)
 		return ret;
 
-	sensor = get_sensor_from_id(id);
-
-	sensor->version = le32_to_cpu(conf.version);
-	sensor->type = le32_to_cpu(conf.type);
-	sensor->max_range = le32_to_cpu(conf.max_range);
-	sensor->resolution = le32_to_cpu(conf.resolution);
-	sensor->power = le32_to_cpu(conf.power);
-	sensor->min_delay = le32_to_cpu(conf.min_delay);
-	sensor->max_delay = le32_to_cpu(conf.max_delay);
-	sensor->fifo_rec = le32_to_cpu(conf.fifo_rec);
-	sensor->fifo_mec = le32_to_cpu(conf.fifo_mec);
-	sensor->flags = le32_to_cpu(conf.flags);
-	sensor->scale_int = le32_to_cpu(conf.scale_int);
-	sensor->scale_nano = le32_to_cpu(conf.scale_nano);
-	sensor->offset_int = le32_to_cpu(conf.offset_int);
-	sensor->offset_nano = le32_to_cpu(conf.offset_nano);
-	sensor->channels = conf.channels;
-
-	sensor->name_len = le16_to_cpu(conf.name_len);
-	if (sensor->name_len) {
-		if (sensor->name_len > sizeof(sensor->name))
-			sensor->name_len = sizeof(sensor->name);
-		memcpy(&sensor->name[0], &conf.name[0], sensor->name_len);
+	return gb_sensors_ext_add(sensors_ext, id, &conf);
+}
+
+/*
+ * Fetch as many sensor descriptors as fit in one operation, starting at
+ * start_id, and register each of them. Returns the number of sensors
+ * added or a negative errno.
+ */
+static int gb_sensors_ext_config_page(struct gb_sensors_ext *sensors_ext,
+					u8 start_id, u8 max_count)
+{
+	struct gb_connection *connection = sensors_ext->connection;
+	struct gb_sensors_ext_sensor_info_all_request *req;
+	struct gb_sensors_ext_sensor_info_all_response *resp;
+	const size_t entry_size = offsetof(struct gb_sensor, END_OF_GB_STRUCT);
+	struct gb_operation *op;
+	struct gb_sensor *conf;
+	size_t count;
+	int ret, i;
+
+	op = gb_operation_create_flags(connection,
+				GB_SENSORS_EXT_TYPE_SENSOR_INFO_ALL,
+				sizeof(*req),
+				sizeof(*resp) + max_count * entry_size,
+				GB_OPERATION_FLAG_SHORT_RESPONSE, GFP_KERNEL);
+	if (!op)
+		return -ENOMEM;
+
+	req = op->request->payload;
+	req->start_id = start_id;
+	req->max_count = max_count;
+
+	ret = gb_operation_request_send_sync(op);
+	if (ret)
+		goto out;
+
+	resp = op->response->payload;
+	if (op->response->payload_size < sizeof(*resp)) {
+		ret = -EPROTO;
+		goto out;
 	}
 
-	sensor->vendor_len = le16_to_cpu(conf.vendor_len);
-	if (sensor->vendor_len) {
-		if (sensor->vendor_len > sizeof(sensor->vendor))
-			sensor->vendor_len = sizeof(sensor->vendor);
-		memcpy(&sensor->vendor[0], &conf.vendor[0], sensor->vendor_len);
+	count = (op->response->payload_size - sizeof(*resp)) / entry_size;
+	if (!resp->count || resp->count > count) {
+		dev_err(&connection->bundle->dev,
+			"invalid sensor info page (count=%u, size=%zu)\n",
+			resp->count, op->response->payload_size);
+		ret = -EPROTO;
+		goto out;
 	}
 
-	sensor->string_type_len = le16_to_cpu(conf.string_type_len);
-	if (sensor->string_type_len) {
-		if (sensor->string_type_len > sizeof(sensor->string_type))
-			sensor->string_type_len = sizeof(sensor->string_type);
-		memcpy(&sensor->string_type[0], &conf.string_type[0],
-			sensor->string_type_len);
+	/* gb_sensor is packed, entries are only read up to END_OF_GB_STRUCT */
+	for (i = 0; i < resp->count; i++) {
+		conf = (struct gb_sensor *)&resp->data[i * entry_size];
+		ret = gb_sensors_ext_add(sensors_ext, start_id + i, conf);
+		if (ret)
+			break;
 	}
 
-    return 0;
+	/* report partial progress so the caller resumes at the failed id */
+	if (i)
+		ret = i;
+out:
+	gb_operation_put(op);
+
+	return ret;
 }
 
-static int gb_sensors_ext_setup(struct gb_sensors_ext *sensors_ext)
+/*
+ * Enumerate all sensors through SENSOR_INFO_ALL. On failure, *next_id is
+ * the first sensor id that has not been registered yet.
+ */
+static int gb_sensors_ext_config_all(struct gb_sensors_ext *sensors_ext,
+					u8 *next_id)
+{
+	const size_t entry_size = offsetof(struct gb_sensor, END_OF_GB_STRUCT);
+	const struct gb_sensors_ext_sensor_info_all_response *resp;
+	size_t payload_max;
+	u8 page_max;
+	int ret;
+
+	payload_max = gb_operation_get_payload_size_max(sensors_ext->connection);
+	if (payload_max < sizeof(*resp) + entry_size)
+		return -EMSGSIZE;
+
+	page_max = min_t(size_t, (payload_max - sizeof(*resp)) / entry_size,
+			 U8_MAX);
+
+	while (*next_id < sensors_ext->sensors_cnt) {
+		ret = gb_sensors_ext_config_page(sensors_ext, *next_id,
+			min_t(u8, page_max, sensors_ext->sensors_cnt - *next_id));
+		if (ret < 0)
+			return ret;
+		*next_id += ret;
+	}
+
+	return 0;
+}
+
+static void gb_sensors_ext_free_sensors(struct gb_sensors_ext *sensors_ext)
 {
-	struct gb_connection *connection = sensors_ext->connection;
-	int ret, i;
 	struct list_head *iter, *next;
 	struct gb_sensor *sensor_info;
 
+	list_for_each_safe(iter, next, &sensors_ext->sensors_list) {
+		sensor_info = list_entry(iter, struct gb_sensor, node);
+		list_del(&sensor_info->node);
+		kfree(sensor_info);
+	}
+}
+
+static int gb_sensors_ext_setup(struct gb_sensors_ext *sensors_ext)
+{
+	struct gb_connection *connection = sensors_ext->connection;
+	ktime_t start = ktime_get();
+	u8 id = 0;
+	int ret;
+
 	/* get the sensors count */
 	ret = gb_sensors_ext_get_count(sensors_ext);
 	if (ret)
-		goto error_count;
+		return ret;
 
 	INIT_LIST_HEAD(&sensors_ext->sensors_list);
+	gb_sensors_mod_attached(&sensors_ext->sensors_list);
+
+	if (connection->module_minor >= GB_SENSORS_EXT_VER_SENSOR_INFO_ALL) {
+		ret = gb_sensors_ext_config_all(sensors_ext, &id);
+		if (ret)
+			dev_warn(&connection->bundle->dev,
+				 "bulk sensor info failed at %u (%d), falling back\n",
+				 id, ret);
+	}
 
-	for (i = 0; i < sensors_ext->sensors_cnt; i++) {
-		sensor_info = kzalloc(sizeof(struct gb_sensor), GFP_KERNEL);
-		if (!sensor_info) {
-			ret = -ENOMEM;
-			goto error_out;
-		}
-		list_add(&sensor_info->node, &sensors_ext->sensors_list);
-		sensor_info->sensor_id = i;
-		ret = gb_sensors_ext_config(sensors_ext, i);
+	/* per-id path for older modules, or to finish a failed bulk fetch */
+	for (; id < sensors_ext->sensors_cnt; id++) {
+		ret = gb_sensors_ext_config(sensors_ext, id);
 		if (ret) {
 			dev_err(&connection->bundle->dev,
 				"Failed to config sensor device %d (err=%d)\n",
-				i, ret);
+				id, ret);
 			goto error_out;
 		}
 	}
 
-	ret = gb_sensors_mod_attached(sensors_ext->sensors_cnt,
-					&sensors_ext->sensors_list);
-	if(ret)
-		goto error_out;
+	gb_sensors_mod_attach_done(ktime_us_delta(ktime_get(), start));
 
 	return 0;
 
 error_out:
-	list_for_each_safe(iter, next, &sensors_ext->sensors_list) {
-		sensor_info = list_entry(iter, struct gb_sensor, node);
-		kfree(sensor_info);
-	}
-error_count:
+	gb_sensors_mod_detached();
+	gb_sensors_ext_free_sensors(sensors_ext);
 	return ret;
 }
 
@@ -308,19 +450,21 @@ static int gb_sensors_ext_connection_init(struct gb_connection *connection)
 
 	mutex_init(&sensors_ext->mlock);
 
+	/* sensors become usable as they register, accept their events */
+	connection->private = sensors_ext;
+
 	/* set up the sensors */
 	ret = gb_sensors_ext_setup(sensors_ext);
 	if (ret)
 		goto error_setup;
 
-	connection->private = sensors_ext;
-
 	dev_info(&connection->bundle->dev, "module_minor=%d, count = %d\n",
 		 connection->module_minor, sensors_ext->sensors_cnt);
 
 	return 0;
 
 error_setup:
+	connection->private = NULL;
 	gb_sensors_ext_put();
 	return ret;
 }
@@ -328,15 +472,9 @@ error_setup:
 static void gb_sensors_ext_connection_exit(struct gb_connection *connection)
 {
 	struct gb_sensors_ext *gb = connection->private;
-	struct list_head *iter, *next;
-	struct gb_sensor *sensor_info;
 
 	gb_sensors_mod_detached();
-
-	list_for_each_safe(iter, next, &gb->sensors_list) {
-		sensor_info = list_entry(iter, struct gb_sensor, node);
-		kfree(sensor_info);
-	}
+	gb_sensors_ext_free_sensors(gb);
 
 	gb_sensors_ext_put();
 }
@@ -86,6 +86,7 @@ static const int const gb_sensor_type_map[] = {
 struct iio_gb_sensors_ext {
 	struct dentry		*dbgfs_root;
 	uint8_t			sensors_cnt;
+	uint32_t		attach_time_us;
 	struct list_head	*sensors_list;
 	struct mutex		ilock;
 };
@@ -529,7 +530,7 @@ static size_t gb_sensors_rcv_data_sensor(
 			report->sensor_id, report->readings, report->flags);
 
 	sensor = get_sensor_from_id(report->sensor_id);
-	if (sensor == NULL) {
+	if (sensor == NULL || !sensor->iio) {
 		pr_err("Invalid sensor ID (%d)", report->sensor_id);
 		return -EINVAL;
 	}
@@ -1192,6 +1193,7 @@ error_info:
 	sensor->last_reading = NULL;
 error_last_reading:
 	iio_device_free(indio_dev);
+	sensor->iio = NULL;
 
 	mutex_unlock(&gb_drv.ilock);
 	return retval;
@@ -1241,6 +1243,8 @@ static void gb_sensors_create_dbgfs(void)
 
 	debugfs_create_u16("sensors_cnt", S_IRUGO, gb_drv.dbgfs_root,
 			(uint16_t *)&gb_drv.sensors_cnt);
+	debugfs_create_u32("attach_time_us", S_IRUGO, gb_drv.dbgfs_root,
+			&gb_drv.attach_time_us);
 }
 
 static void gb_sensors_destroy_dbgfs(void)
@@ -1253,41 +1257,46 @@ static void gb_sensors_create_dgbfs(void) { }
 static void gb_sensors_destroy_dgbfs(void) { }
 #endif /* CONFIG_DEBUG_FS */
 
-/** This function is called by the Greybus code when a mod is attached. */
-int gb_sensors_mod_attached(uint16_t count, struct list_head *sensors_list)
+/** This function is called by the Greybus code when a mod is attached,
+ * before any of its sensors have been enumerated. */
+void gb_sensors_mod_attached(struct list_head *sensors_list)
 {
-
-	int retval = 0;
-	struct gb_sensor *sensor;
-
 	pr_info("IIO Greybus Sensors creating\n");
 	mutex_init(&gb_drv.ilock);
 
-	gb_drv.sensors_cnt = count;
+	gb_drv.sensors_cnt = 0;
+	gb_drv.attach_time_us = 0;
 	gb_drv.sensors_list = sensors_list;
 
-	list_for_each_entry(sensor, sensors_list, node) {
-		retval = gb_sensors_add_sensor(sensor);
-		if (retval < 0) {
-			pr_err("Failed adding sensor %s (%d)\n",
-				sensor->name_len ? sensor->name : "Unknown",
-				sensor->sensor_id);
-			goto error_add_sensor;
-		}
-		gb_sensors_ext_get();
-	}
-
 	gb_sensors_create_dbgfs();
+}
 
-	return retval;
+/** Registers one enumerated sensor. Sensors are added as the Greybus code
+ * receives their descriptors, so early ones are usable while the rest of the
+ * mod is still being enumerated. */
+int gb_sensors_mod_add_sensor(struct gb_sensor *sensor)
+{
+	int retval;
 
-error_add_sensor:
-	list_for_each_entry_continue_reverse(sensor, sensors_list, node) {
-		gb_sensors_rm_sensor(sensor);
-		gb_sensors_ext_put();
+	retval = gb_sensors_add_sensor(sensor);
+	if (retval < 0) {
+		pr_err("Failed adding sensor %s (%d)\n",
+			sensor->name_len ? sensor->name : "Unknown",
+			sensor->sensor_id);
+		return retval;
 	}
+	gb_sensors_ext_get();
+	gb_drv.sensors_cnt++;
 
-	return retval;
+	return 0;
+}
+
+/** Called once every sensor of the mod has been added. */
+void gb_sensors_mod_attach_done(s64 attach_time_us)
+{
+	gb_drv.attach_time_us = attach_time_us;
+	pr_info("IIO Greybus Sensors attached %d sensors in %lld us\n",
+		gb_drv.sensors_cnt, attach_time_us);
 }
 
 /** This function is called by the Greybus code when a mod is detached. */
@@ -1305,6 +1314,7 @@ int gb_sensors_mod_detached(void)
 		gb_sensors_rm_sensor(sensor_info);
 		gb_sensors_ext_put();
 	}
+	gb_drv.sensors_cnt = 0;
 
 	mutex_destroy(&gb_drv.ilock);
 
@@ -72,7 +72,9 @@ struct gb_sensor {
 } __packed;
 
 
-int gb_sensors_mod_attached(uint16_t count, struct list_head *sensors_list);
+void gb_sensors_mod_attached(struct list_head *sensors_list);
+int gb_sensors_mod_add_sensor(struct gb_sensor *sensor);
+void gb_sensors_mod_attach_done(s64 attach_time_us);
 int gb_sensors_mod_detached(void);
 int gb_sensors_rcv_data(struct gb_sensors_ext_report_hdr *report, size_t size);
 
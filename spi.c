@@ -7,14 +7,21 @@
  * Released under the GPLv2 only.
  */
 
+#include <linux/async.h>
 #include <linux/bitops.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/spi/spi.h>
 
 #include "greybus.h"
 
+struct gb_spi_device {
+	struct gb_spi		*spi;
+	struct spi_board_info	board;
+};
+
 struct gb_spi {
 	struct gb_connection	*connection;
 	u16			mode;
@@ -23,8 +30,12 @@ struct gb_spi {
 	u8			num_chipselect;
 	u32			min_speed_hz;
 	u32			max_speed_hz;
+	struct gb_spi_device	*devices;	/* One per chip select */
 };
 
+/* spi_device registration, and so child probing, runs out of line */
+static ASYNC_DOMAIN_EXCLUSIVE(gb_spi_async_domain);
+
 static struct spi_master *get_master_from_spi(struct gb_spi *spi)
 {
 	return spi->connection->private;
@@ -277,13 +288,25 @@ static int gb_spi_get_master_config(struct gb_spi *spi)
 	return 0;
 }
 
-static int gb_spi_setup_device(struct gb_spi *spi, u8 cs)
+static void gb_spi_set_board(struct gb_spi *spi, u8 cs,
+		const struct gb_spi_device_config_response *response)
 {
 	struct spi_master *master = get_master_from_spi(spi);
+	struct spi_board_info *spi_board = &spi->devices[cs].board;
+
+	memcpy(spi_board->modalias, response->name,
+	       min(sizeof(spi_board->modalias), sizeof(response->name)));
+	spi_board->modalias[sizeof(spi_board->modalias) - 1] = '\0';
+	spi_board->mode		= le16_to_cpu(response->mode);
+	spi_board->bus_num	= master->bus_num;
+	spi_board->chip_select	= cs;
+	spi_board->max_speed_hz	= le32_to_cpu(response->max_speed_hz);
+}
+
+static int gb_spi_get_device_config(struct gb_spi *spi, u8 cs)
+{
 	struct gb_spi_device_config_request request;
 	struct gb_spi_device_config_response response;
-	struct spi_board_info spi_board = { {0} };
-	struct spi_device *spidev;
 	int ret;
 
 	request.chip_select = cs;
@@ -294,25 +317,112 @@ static int gb_spi_setup_device(struct gb_spi *spi, u8 cs)
 	if (ret < 0)
 		return ret;
 
-	memcpy(spi_board.modalias, response.name, sizeof(spi_board.modalias));
-	spi_board.mode		= le16_to_cpu(response.mode);
-	spi_board.bus_num	= master->bus_num;
-	spi_board.chip_select	= cs;
-	spi_board.max_speed_hz	= le32_to_cpu(response.max_speed_hz);
+	gb_spi_set_board(spi, cs, &response);
+
+	return 0;
+}
+
+/* Returns the number of chip selects configured from this page */
+static int gb_spi_get_device_table_page(struct gb_spi *spi, u8 start_cs,
+					u8 max_count)
+{
+	struct gb_connection *connection = spi->connection;
+	struct gb_spi_device_table_request *request;
+	struct gb_spi_device_table_response *response;
+	struct gb_operation *op;
+	size_t count;
+	int ret;
+	int i;
+
+	op = gb_operation_create_flags(connection, GB_SPI_TYPE_DEVICE_TABLE,
+			sizeof(*request),
+			sizeof(*response) + max_count * sizeof(response->devices[0]),
+			GB_OPERATION_FLAG_SHORT_RESPONSE, GFP_KERNEL);
+	if (!op)
+		return -ENOMEM;
 
-	spidev = spi_new_device(master, &spi_board);
-	if (!spidev)
-		ret = -EINVAL;
+	request = op->request->payload;
+	request->start_cs = start_cs;
+	request->max_count = max_count;
+
+	ret = gb_operation_request_send_sync(op);
+	if (ret)
+		goto out;
+
+	response = op->response->payload;
+	if (op->response->payload_size < sizeof(*response)) {
+		ret = -EPROTO;
+		goto out;
+	}
+
+	count = (op->response->payload_size - sizeof(*response)) /
+		sizeof(response->devices[0]);
+	if (!response->count || response->count > count ||
+	    response->count > max_count) {
+		dev_err(&connection->bundle->dev,
+			"invalid device table page (count=%u, size=%zu)\n",
+			response->count, op->response->payload_size);
+		ret = -EPROTO;
+		goto out;
+	}
+
+	for (i = 0; i < response->count; i++)
+		gb_spi_set_board(spi, start_cs + i, &response->devices[i]);
+
+	ret = response->count;
+out:
+	gb_operation_put(op);
+
+	return ret;
+}
+
+/*
+ * Fetch every chip select through DEVICE_TABLE. On failure, *next_cs is
+ * the first chip select that has not been configured yet.
+ */
+static int gb_spi_get_device_table(struct gb_spi *spi, u8 *next_cs)
+{
+	const struct gb_spi_device_table_response *response;
+	size_t payload_max;
+	u8 page_max;
+	int ret;
+
+	payload_max = gb_operation_get_payload_size_max(spi->connection);
+	if (payload_max < sizeof(*response) + sizeof(response->devices[0]))
+		return -EMSGSIZE;
+
+	page_max = min_t(size_t, (payload_max - sizeof(*response)) /
+			 sizeof(response->devices[0]), U8_MAX);
+
+	while (*next_cs < spi->num_chipselect) {
+		ret = gb_spi_get_device_table_page(spi, *next_cs,
+			min_t(u8, page_max, spi->num_chipselect - *next_cs));
+		if (ret < 0)
+			return ret;
+		*next_cs += ret;
+	}
 
 	return 0;
 }
 
+static void gb_spi_new_device_async(void *data, async_cookie_t cookie)
+{
+	struct gb_spi_device *device = data;
+	struct gb_spi *spi = device->spi;
+
+	if (!spi_new_device(get_master_from_spi(spi), &device->board))
+		dev_err(&spi->connection->bundle->dev,
+			"failed to add spi device %u (%s)\n",
+			device->board.chip_select, device->board.modalias);
+}
+
 static int gb_spi_connection_init(struct gb_connection *connection)
 {
 	struct gb_spi *spi;
 	struct spi_master *master;
+	ktime_t start = ktime_get();
 	int ret;
-	u8 i;
+	u8 i = 0;
 
 	/* Allocate master with space for data */
 	master = spi_alloc_master(&connection->bundle->dev, sizeof(*spi));
@@ -345,17 +455,53 @@ static int gb_spi_connection_init(struct gb_connection *connection)
 	if (ret < 0)
 		goto out_put_master;
 
+	spi->devices = kcalloc(spi->num_chipselect, sizeof(*spi->devices),
+			       GFP_KERNEL);
+	if (!spi->devices) {
+		ret = -ENOMEM;
+		goto out_unregister_master;
+	}
+
 	/* now, fetch the devices configuration */
-	for (i = 0; i < spi->num_chipselect; i++) {
-		ret = gb_spi_setup_device(spi, i);
+	if (connection->module_minor >= GB_SPI_VER_DEVICE_TABLE) {
+		ret = gb_spi_get_device_table(spi, &i);
+		if (ret)
+			dev_warn(&connection->bundle->dev,
+				 "device table failed at cs %u (%d), falling back\n",
+				 i, ret);
+	}
+
+	/* per-cs path for older modules, or to finish a failed table fetch */
+	for (; i < spi->num_chipselect; i++) {
+		ret = gb_spi_get_device_config(spi, i);
 		if (ret < 0) {
 			dev_err(&connection->bundle->dev,
 				"failed to allocated spi device: %d\n", ret);
-			spi_unregister_master(master);
-			break;
+			goto out_free_devices;
 		}
 	}
 
+	dev_dbg(&connection->bundle->dev,
+		"%u chip selects configured in %lld us\n",
+		spi->num_chipselect, ktime_us_delta(ktime_get(), start));
+
+	/*
+	 * The bus is up. Don't hold the connection on the child drivers,
+	 * each device gets added, and probed, as soon as it can.
+	 */
+	for (i = 0; i < spi->num_chipselect; i++) {
+		spi->devices[i].spi = spi;
+		async_schedule_domain(gb_spi_new_device_async, &spi->devices[i],
+				      &gb_spi_async_domain);
+	}
+
+	return 0;
+
+out_free_devices:
+	kfree(spi->devices);
+out_unregister_master:
+	spi_unregister_master(master);
+
 	return ret;
 
 out_put_master:
@@ -367,8 +513,15 @@ out_put_master:
 static void gb_spi_connection_exit(struct gb_connection *connection)
 {
 	struct spi_master *master = connection->private;
+	struct gb_spi *spi = spi_master_get_devdata(master);
+	struct gb_spi_device *devices = spi->devices;
+
+	/* No device may still be on its way in */
+	async_synchronize_full_domain(&gb_spi_async_domain);
 
+	/* This drops the last reference on master, and spi with it */
 	spi_unregister_master(master);
+	kfree(devices);
 }
 
 static struct gb_protocol spi_protocol = {
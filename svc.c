@@ -138,6 +138,153 @@ int gb_svc_dme_peer_set(struct gb_svc *svc, u8 intf_id, u16 attr, u16 selector,
 }
 EXPORT_SYMBOL_GPL(gb_svc_dme_peer_set);
 
+/* Fallback for SVCs that predate GB_SVC_TYPE_DME_PEER_BATCH */
+static int gb_svc_dme_peer_batch_single(struct gb_svc *svc, u8 intf_id,
+					struct gb_svc_dme_attr *attrs,
+					unsigned int count)
+{
+	unsigned int failed = 0;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < count; i++) {
+		if (attrs[i].set)
+			ret = gb_svc_dme_peer_set(svc, intf_id, attrs[i].attr,
+						  attrs[i].selector,
+						  attrs[i].value);
+		else
+			ret = gb_svc_dme_peer_get(svc, intf_id, attrs[i].attr,
+						  attrs[i].selector,
+						  &attrs[i].value);
+		if (ret && ret != -EIO)
+			return ret;
+
+		attrs[i].result = ret ? GB_OP_UNKNOWN_ERROR : GB_OP_SUCCESS;
+		if (ret)
+			failed++;
+	}
+
+	return failed;
+}
+
+/* Returns the number of failed attributes, or a negative errno */
+static int gb_svc_dme_peer_batch_chunk(struct gb_svc *svc, u8 intf_id,
+				       struct gb_svc_dme_attr *attrs,
+				       unsigned int count)
+{
+	struct gb_svc_dme_peer_batch_request *request;
+	struct gb_svc_dme_peer_batch_response *response;
+	struct gb_operation *operation;
+	size_t request_size;
+	size_t response_size;
+	unsigned int failed = 0;
+	unsigned int i;
+	u16 tag;
+	int ret;
+
+	request_size = sizeof(*request) + count * sizeof(request->attrs[0]);
+	response_size = sizeof(*response) + count * sizeof(response->results[0]);
+
+	operation = gb_operation_create(svc->connection,
+					GB_SVC_TYPE_DME_PEER_BATCH,
+					request_size, response_size,
+					GFP_KERNEL);
+	if (!operation)
+		return -ENOMEM;
+
+	tag = (u16)atomic_inc_return(&svc->dme_batch_tag);
+
+	request = operation->request->payload;
+	request->intf_id = intf_id;
+	request->count = count;
+	request->tag = cpu_to_le16(tag);
+	for (i = 0; i < count; i++) {
+		request->attrs[i].attr = cpu_to_le16(attrs[i].attr);
+		request->attrs[i].selector = cpu_to_le16(attrs[i].selector);
+		if (attrs[i].set) {
+			request->attrs[i].op = GB_SVC_DME_BATCH_OP_SET;
+			request->attrs[i].value = cpu_to_le32(attrs[i].value);
+		} else {
+			request->attrs[i].op = GB_SVC_DME_BATCH_OP_GET;
+		}
+	}
+
+	ret = gb_operation_request_send_sync(operation);
+	if (ret) {
+		dev_err(&svc->dev, "failed DME batch of %u attributes (%u, tag %u): %d\n",
+				count, intf_id, tag, ret);
+		goto out;
+	}
+
+	response = operation->response->payload;
+	if (le16_to_cpu(response->tag) != tag || response->count != count) {
+		dev_err(&svc->dev, "mismatched DME batch response (tag %u/%u, count %u/%u)\n",
+				le16_to_cpu(response->tag), tag,
+				response->count, count);
+		ret = -EPROTO;
+		goto out;
+	}
+
+	for (i = 0; i < count; i++) {
+		attrs[i].result = le16_to_cpu(response->results[i].result_code);
+		if (attrs[i].result) {
+			failed++;
+			continue;
+		}
+		if (!attrs[i].set)
+			attrs[i].value =
+				le32_to_cpu(response->results[i].attr_value);
+	}
+	ret = failed;
+
+out:
+	gb_operation_put(operation);
+
+	return ret;
+}
+
+/*
+ * Get and/or set a list of DME attributes of a peer using as few round
+ * trips as the SVC allows. Each entry gets its own result code; -EIO is
+ * returned if any of them failed.
+ */
+int gb_svc_dme_peer_batch(struct gb_svc *svc, u8 intf_id,
+			  struct gb_svc_dme_attr *attrs, unsigned int count)
+{
+	struct gb_connection *connection = svc->connection;
+	struct gb_svc_dme_peer_batch_request *request;
+	size_t max_attrs;
+	unsigned int done = 0;
+	unsigned int failed = 0;
+	int ret;
+
+	if (connection->module_minor < GB_SVC_VER_DME_PEER_BATCH) {
+		ret = gb_svc_dme_peer_batch_single(svc, intf_id, attrs, count);
+		if (ret < 0)
+			return ret;
+		return ret ? -EIO : 0;
+	}
+
+	/* Requests are larger than responses, so they set the limit */
+	max_attrs = (gb_operation_get_payload_size_max(connection) -
+		     sizeof(*request)) / sizeof(request->attrs[0]);
+	max_attrs = min_t(size_t, max_attrs, U8_MAX);
+
+	while (done < count) {
+		unsigned int n = min_t(unsigned int, count - done, max_attrs);
+
+		ret = gb_svc_dme_peer_batch_chunk(svc, intf_id, attrs + done, n);
+		if (ret < 0)
+			return ret;
+
+		failed += ret;
+		done += n;
+	}
+
+	return failed ? -EIO : 0;
+}
+EXPORT_SYMBOL_GPL(gb_svc_dme_peer_batch);
+
 /*
  * T_TstSrcIncrement is written by the module on ES2 as a stand-in for boot
  * status attribute. AP needs to read and clear it, after reading a non-zero
@@ -27,6 +27,8 @@ struct gb_svc {
 
 	u16 endo_id;
 	u8 ap_intf_id;
+
+	atomic_t dme_batch_tag;
 };
 #define to_gb_svc(d) container_of(d, struct gb_svc, d)
 
@@ -45,6 +47,18 @@ int gb_svc_dme_peer_get(struct gb_svc *svc, u8 intf_id, u16 attr, u16 selector,
 int gb_svc_dme_peer_set(struct gb_svc *svc, u8 intf_id, u16 attr, u16 selector,
 			u32 value);
 
+/* One entry of a gb_svc_dme_peer_batch() request */
+struct gb_svc_dme_attr {
+	u16 attr;
+	u16 selector;
+	bool set;
+	u32 value;		/* written for sets, read back for gets */
+	u16 result;		/* result code, 0 on success */
+};
+
+int gb_svc_dme_peer_batch(struct gb_svc *svc, u8 intf_id,
+			  struct gb_svc_dme_attr *attrs, unsigned int count);
+
 int gb_svc_protocol_init(void);
 void gb_svc_protocol_exit(void);
 
@@ -11,28 +11,91 @@
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/device.h>
+#include <linux/input.h>
 #include <linux/kdev_t.h>
 #include <linux/idr.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
 #include "greybus.h"
 
+/* effect ids are a u8 */
+#define	GB_VIBRATOR_MAX_EFFECTS			256
+
 struct gb_vibrator_device {
 	struct gb_connection	*connection;
 	struct device		*dev;
 	int			minor;		/* vibrator minor number */
+	struct input_dev	*input;		/* force feedback, if supported */
+	u16			custom_max;
+
+	/* playback requests, sent from play_work */
+	spinlock_t		play_lock;
+	struct work_struct	play_work;
+	DECLARE_BITMAP(play_pending, GB_VIBRATOR_MAX_EFFECTS);
+	u16			play_count[GB_VIBRATOR_MAX_EFFECTS];
 };
 
 /* Version of the Greybus vibrator protocol we support */
 #define	GB_VIBRATOR_VERSION_MAJOR		0x00
-#define	GB_VIBRATOR_VERSION_MINOR		0x01
+#define	GB_VIBRATOR_VERSION_MINOR		0x02
+
+/* Minimum module minor version supporting preloaded effects */
+#define	GB_VIBRATOR_VER_EFFECTS			0x02
 
 /* Greybus Vibrator operation types */
 #define	GB_VIBRATOR_TYPE_ON			0x02
 #define	GB_VIBRATOR_TYPE_OFF			0x03
+#define	GB_VIBRATOR_TYPE_EFFECT_CAPS		0x04	/* added in ver 00.02 */
+#define	GB_VIBRATOR_TYPE_EFFECT_UPLOAD		0x05	/* added in ver 00.02 */
+#define	GB_VIBRATOR_TYPE_EFFECT_ERASE		0x06	/* added in ver 00.02 */
+#define	GB_VIBRATOR_TYPE_EFFECT_PLAY		0x07	/* added in ver 00.02 */
 
 struct gb_vibrator_on_request {
 	__le16	timeout_ms;
 };
 
+/* effect caps request has no payload */
+struct gb_vibrator_effect_caps_response {
+	__u8	max_effects;
+	__u8	reserved;
+	__le16	custom_max;	/* samples in a custom waveform */
+} __packed;
+
+/*
+ * Effects are stored on the module under an id, playing one is then a
+ * single unidirectional request. Magnitudes are 0 (off) to 0x7fff.
+ */
+struct gb_vibrator_effect_upload_request {
+	__u8	id;
+	__u8	type;
+#define	GB_VIBRATOR_EFFECT_RUMBLE		0x01
+#define	GB_VIBRATOR_EFFECT_PERIODIC		0x02
+	__u8	waveform;
+#define	GB_VIBRATOR_WAVE_SQUARE			0x01
+#define	GB_VIBRATOR_WAVE_TRIANGLE		0x02
+#define	GB_VIBRATOR_WAVE_SINE			0x03
+#define	GB_VIBRATOR_WAVE_CUSTOM			0x04
+	__u8	reserved;
+	__le16	length_ms;
+	__le16	delay_ms;
+	__le16	strong;		/* rumble: strong motor; periodic: magnitude */
+	__le16	weak;		/* rumble: weak motor; periodic: offset */
+	__le16	period_ms;
+	__le16	custom_len;
+	__le16	custom[0];
+} __packed;
+
+struct gb_vibrator_effect_erase_request {
+	__u8	id;
+} __packed;
+
+/* unidirectional, count 0 stops the effect */
+struct gb_vibrator_effect_play_request {
+	__u8	id;
+	__u8	reserved;
+	__le16	count;
+} __packed;
+
 static int turn_on(struct gb_vibrator_device *vib, u16 timeout_ms)
 {
 	struct gb_vibrator_on_request request;
@@ -88,6 +151,211 @@ static struct class vibrator_class = {
 
 static DEFINE_IDA(minors);
 
+static int gb_vibrator_waveform(struct ff_periodic_effect *periodic)
+{
+	switch (periodic->waveform) {
+	case FF_SQUARE:
+		return GB_VIBRATOR_WAVE_SQUARE;
+	case FF_TRIANGLE:
+		return GB_VIBRATOR_WAVE_TRIANGLE;
+	case FF_SINE:
+		return GB_VIBRATOR_WAVE_SINE;
+	case FF_CUSTOM:
+		return GB_VIBRATOR_WAVE_CUSTOM;
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Called with the ff mutex held, from the uploading process */
+static int gb_vibrator_ff_upload(struct input_dev *input,
+				 struct ff_effect *effect,
+				 struct ff_effect *old)
+{
+	struct gb_vibrator_device *vib = input_get_drvdata(input);
+	struct gb_vibrator_effect_upload_request *request;
+	struct ff_periodic_effect *periodic = &effect->u.periodic;
+	struct ff_rumble_effect *rumble = &effect->u.rumble;
+	size_t custom_len = 0;
+	size_t size;
+	int waveform = 0;
+	int ret;
+
+	if (effect->type == FF_PERIODIC) {
+		waveform = gb_vibrator_waveform(periodic);
+		if (waveform < 0)
+			return waveform;
+		if (waveform == GB_VIBRATOR_WAVE_CUSTOM) {
+			custom_len = periodic->custom_len;
+			if (!custom_len || custom_len > vib->custom_max)
+				return -EINVAL;
+		}
+	}
+
+	size = sizeof(*request) + custom_len * sizeof(request->custom[0]);
+	request = kzalloc(size, GFP_KERNEL);
+	if (!request)
+		return -ENOMEM;
+
+	request->id = effect->id;
+	request->length_ms = cpu_to_le16(effect->replay.length);
+	request->delay_ms = cpu_to_le16(effect->replay.delay);
+
+	switch (effect->type) {
+	case FF_RUMBLE:
+		request->type = GB_VIBRATOR_EFFECT_RUMBLE;
+		request->strong = cpu_to_le16(rumble->strong_magnitude >> 1);
+		request->weak = cpu_to_le16(rumble->weak_magnitude >> 1);
+		break;
+	case FF_PERIODIC:
+		request->type = GB_VIBRATOR_EFFECT_PERIODIC;
+		request->waveform = waveform;
+		request->strong = cpu_to_le16(abs(periodic->magnitude));
+		request->weak = cpu_to_le16(periodic->offset);
+		request->period_ms = cpu_to_le16(periodic->period);
+		break;
+	default:
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* custom_data is still the uploader's buffer */
+	if (custom_len) {
+		request->custom_len = cpu_to_le16(custom_len);
+		if (copy_from_user(request->custom, periodic->custom_data,
+				   custom_len * sizeof(request->custom[0]))) {
+			ret = -EFAULT;
+			goto out;
+		}
+	}
+
+	ret = gb_operation_sync(vib->connection, GB_VIBRATOR_TYPE_EFFECT_UPLOAD,
+				request, size, NULL, 0);
+out:
+	kfree(request);
+
+	return ret;
+}
+
+static int gb_vibrator_ff_erase(struct input_dev *input, int effect_id)
+{
+	struct gb_vibrator_device *vib = input_get_drvdata(input);
+	struct gb_vibrator_effect_erase_request request;
+
+	request.id = effect_id;
+
+	return gb_operation_sync(vib->connection, GB_VIBRATOR_TYPE_EFFECT_ERASE,
+				 &request, sizeof(request), NULL, 0);
+}
+
+static void gb_vibrator_play_work(struct work_struct *work)
+{
+	struct gb_vibrator_device *vib =
+		container_of(work, struct gb_vibrator_device, play_work);
+	struct gb_vibrator_effect_play_request request;
+	unsigned long flags;
+	int id;
+
+	request.reserved = 0;
+
+	/* Only the latest state of each effect is sent */
+	spin_lock_irqsave(&vib->play_lock, flags);
+	while ((id = find_first_bit(vib->play_pending,
+				    GB_VIBRATOR_MAX_EFFECTS)) <
+	       GB_VIBRATOR_MAX_EFFECTS) {
+		clear_bit(id, vib->play_pending);
+		request.id = id;
+		request.count = cpu_to_le16(vib->play_count[id]);
+		spin_unlock_irqrestore(&vib->play_lock, flags);
+
+		gb_operation_unidirectional_async(vib->connection,
+					GB_VIBRATOR_TYPE_EFFECT_PLAY,
+					&request, sizeof(request), NULL);
+
+		spin_lock_irqsave(&vib->play_lock, flags);
+	}
+	spin_unlock_irqrestore(&vib->play_lock, flags);
+}
+
+/*
+ * Called with the input event lock held and interrupts off. Sending may
+ * sleep in the host driver, so record the request and let play_work send.
+ */
+static int gb_vibrator_ff_playback(struct input_dev *input, int effect_id,
+				   int value)
+{
+	struct gb_vibrator_device *vib = input_get_drvdata(input);
+	unsigned long flags;
+
+	spin_lock_irqsave(&vib->play_lock, flags);
+	vib->play_count[effect_id] = min_t(int, value, U16_MAX);
+	set_bit(effect_id, vib->play_pending);
+	spin_unlock_irqrestore(&vib->play_lock, flags);
+
+	schedule_work(&vib->play_work);
+
+	return 0;
+}
+
+static int gb_vibrator_input_init(struct gb_vibrator_device *vib)
+{
+	struct gb_connection *connection = vib->connection;
+	struct gb_vibrator_effect_caps_response caps;
+	struct input_dev *input;
+	struct ff_device *ff;
+	int ret;
+
+	ret = gb_operation_sync(connection, GB_VIBRATOR_TYPE_EFFECT_CAPS,
+				NULL, 0, &caps, sizeof(caps));
+	if (ret)
+		return ret;
+
+	if (!caps.max_effects)
+		return 0;
+
+	vib->custom_max = le16_to_cpu(caps.custom_max);
+
+	input = input_allocate_device();
+	if (!input)
+		return -ENOMEM;
+
+	input->name = "gb-vibrator";
+	input->id.bustype = BUS_VIRTUAL;
+	input->dev.parent = &connection->bundle->dev;
+	input_set_drvdata(input, vib);
+
+	input_set_capability(input, EV_FF, FF_RUMBLE);
+	input_set_capability(input, EV_FF, FF_PERIODIC);
+	input_set_capability(input, EV_FF, FF_SQUARE);
+	input_set_capability(input, EV_FF, FF_TRIANGLE);
+	input_set_capability(input, EV_FF, FF_SINE);
+	if (vib->custom_max)
+		input_set_capability(input, EV_FF, FF_CUSTOM);
+
+	ret = input_ff_create(input, caps.max_effects);
+	if (ret)
+		goto err_free_input;
+
+	ff = input->ff;
+	ff->upload = gb_vibrator_ff_upload;
+	ff->erase = gb_vibrator_ff_erase;
+	ff->playback = gb_vibrator_ff_playback;
+
+	ret = input_register_device(input);
+	if (ret)
+		goto err_free_input;
+
+	vib->input = input;
+
+	return 0;
+
+err_free_input:
+	/* also destroys the ff device, if created */
+	input_free_device(input);
+
+	return ret;
+}
+
 static int gb_vibrator_connection_init(struct gb_connection *connection)
 {
 	struct gb_vibrator_device *vib;
@@ -100,6 +368,8 @@ static int gb_vibrator_connection_init(struct gb_connection *connection)
 
 	vib->connection = connection;
 	connection->private = vib;
+	spin_lock_init(&vib->play_lock);
+	INIT_WORK(&vib->play_work, gb_vibrator_play_work);
 
 	/*
 	 * For now we create a device in sysfs for the vibrator, but odds are
@@ -132,6 +402,14 @@ static int gb_vibrator_connection_init(struct gb_connection *connection)
 	}
 #endif
 
+	/* The timeout attribute stays, effects are an addition */
+	if (connection->module_minor >= GB_VIBRATOR_VER_EFFECTS) {
+		retval = gb_vibrator_input_init(vib);
+		if (retval)
+			dev_warn(&connection->bundle->dev,
+				 "no force feedback device: %d\n", retval);
+	}
+
 	return 0;
 
 err_ida_remove:
@@ -145,6 +423,11 @@ static void gb_vibrator_connection_exit(struct gb_connection *connection)
 {
 	struct gb_vibrator_device *vib = connection->private;
 
+	if (vib->input) {
+		input_unregister_device(vib->input);
+		cancel_work_sync(&vib->play_work);
+	}
+
 #if LINUX_VERSION_CODE <= KERNEL_VERSION(3,11,0)
 	sysfs_remove_group(&vib->dev->kobj, vibrator_groups[0]);
 #endif